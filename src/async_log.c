@@ -0,0 +1,323 @@
+// ----------------------------------------------------------------------------
+// BSD 3-Clause License
+
+// Copyright (c) 2016, qbrobotics
+// Copyright (c) 2017-2024, Centro "E.Piaggio"
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// POSSIBILITY OF SUCH DAMAGE.
+// ----------------------------------------------------------------------------
+
+/**
+* \file         async_log.c
+*
+* \brief        Asynchronous CSV logger for the control loops
+* \author       _Centro "E.Piaggio"_
+* \copyright    (C) 2017-2024 Centro "E.Piaggio". All rights reserved.
+*/
+
+#include "async_log.h"
+#include "byte_order.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+//==============================================================================
+//                                                                       records
+//==============================================================================
+
+static void log_encode(const log_record* r, uint8_t* buf) {
+    uint64_t u64 = QB_LE64((uint64_t)r->time);
+    uint16_t u16[10];
+    uint32_t u32 = QB_LE32((uint32_t)ASYNC_LOG_COMMIT);
+    int k;
+
+    for (k = 0; k < 2; k++) {
+        u16[k] = QB_LE16((uint16_t)r->inputs[k]);
+        u16[6 + k] = QB_LE16((uint16_t)r->currents[k]);
+    }
+    for (k = 0; k < 4; k++)
+        u16[2 + k] = QB_LE16((uint16_t)r->measurements[k]);
+    u16[8] = QB_LE16((uint16_t)r->sensor_num);
+    u16[9] = QB_LE16((uint16_t)r->id);
+
+    memcpy(buf, &u64, 8);
+    memcpy(buf + 8, u16, 20);
+    memcpy(buf + 28, &u32, 4);
+}
+
+/** Return 0 if buf is not a committed record
+ */
+static int log_decode(const uint8_t* buf, log_record* r) {
+    uint64_t u64;
+    uint16_t u16[10];
+    uint32_t u32;
+    int k;
+
+    memcpy(&u32, buf + 28, 4);
+    if (QB_LE32(u32) != ASYNC_LOG_COMMIT)
+        return 0;
+
+    memcpy(&u64, buf, 8);
+    memcpy(u16, buf + 8, 20);
+    r->time = (long long)QB_LE64(u64);
+    for (k = 0; k < 2; k++) {
+        r->inputs[k] = (int16_t)QB_LE16(u16[k]);
+        r->currents[k] = (int16_t)QB_LE16(u16[6 + k]);
+    }
+    for (k = 0; k < 4; k++)
+        r->measurements[k] = (int16_t)QB_LE16(u16[2 + k]);
+    r->sensor_num = (int16_t)QB_LE16(u16[8]);
+    r->id = QB_LE16(u16[9]);
+    if (r->sensor_num > 4)
+        r->sensor_num = 4;
+
+    return 1;
+}
+
+/** CSV row of a record, same layout the -f and -y loops used to print
+ */
+static void log_print(FILE* file, int format, const log_record* r) {
+    int k;
+
+    switch (format) {
+        case ASYNC_LOG_DEVICES:
+            fprintf(file, "%d,\t", r->id);
+            // fall through
+        case ASYNC_LOG_FILE:
+            for (k = 0; k < r->sensor_num; k++)
+                fprintf(file, "%d,\t", r->measurements[k]);
+            fprintf(file, "%d,\t%d,\t", r->inputs[0], r->inputs[1]);
+            fprintf(file, "%d,\t%d\n", r->currents[0], r->currents[1]);
+            break;
+
+        case ASYNC_LOG_SIN:
+            fprintf(file, "%lld\t", r->time / 1000);
+            fprintf(file, "%d,\t%d\t", r->inputs[0], r->inputs[1]);
+            for (k = 0; k < r->sensor_num; k++)
+                fprintf(file, "%d,\t", r->measurements[k]);
+            fprintf(file, "%d,\t%d\n", r->currents[0], r->currents[1]);
+            break;
+    }
+}
+
+//==============================================================================
+//                                                                 writer thread
+//==============================================================================
+
+static void* async_log_thread(void* arg) {
+    async_log* log = (async_log*) arg;
+    unsigned long head;
+    unsigned long tail = 0;
+    uint8_t buf[ASYNC_LOG_RECORD_LEN];
+
+    while (1) {
+        head = __atomic_load_n(&log->head, __ATOMIC_ACQUIRE);
+
+        if (tail == head) {
+            if (__atomic_load_n(&log->stop, __ATOMIC_ACQUIRE) && tail == __atomic_load_n(&log->head, __ATOMIC_ACQUIRE))
+                break;
+            usleep(ASYNC_LOG_IDLE);
+            continue;
+        }
+
+        // Append everything queued so far, stdio writes it in large blocks
+        while (tail != head) {
+            log_encode(&log->ring[tail % ASYNC_LOG_RING_SIZE], buf);
+            fwrite(buf, 1, ASYNC_LOG_RECORD_LEN, log->file);
+            tail++;
+            __atomic_store_n(&log->tail, tail, __ATOMIC_RELEASE);
+        }
+    }
+
+    return NULL;
+}
+
+//==============================================================================
+//                                                                          open
+//==============================================================================
+
+int async_log_open(async_log* log, const char* filename, int format, const char* header) {
+    uint8_t file_header[ASYNC_LOG_HEADER_LEN];
+    uint16_t u16;
+    uint32_t u32;
+
+    if (header == NULL)
+        header = "";
+
+    log->file = fopen(filename, "wb");
+    if (log->file == NULL) {
+        printf("Error opening log file %s\n", filename);
+        return -1;
+    }
+
+    log->buffer = (char*) malloc(ASYNC_LOG_BUFFER_SIZE);
+    setvbuf(log->file, log->buffer, _IOFBF, ASYNC_LOG_BUFFER_SIZE);
+
+    memcpy(file_header, ASYNC_LOG_MAGIC, 4);
+    u16 = QB_LE16((uint16_t)ASYNC_LOG_VERSION);
+    memcpy(file_header + 4, &u16, 2);
+    u16 = QB_LE16((uint16_t)format);
+    memcpy(file_header + 6, &u16, 2);
+    u32 = QB_LE32((uint32_t)strlen(header));
+    memcpy(file_header + 8, &u32, 4);
+    u32 = QB_LE32((uint32_t)ASYNC_LOG_RECORD_LEN);
+    memcpy(file_header + 12, &u32, 4);
+    fwrite(file_header, 1, ASYNC_LOG_HEADER_LEN, log->file);
+    fputs(header, log->file);
+
+    log->ring = (log_record*) calloc(ASYNC_LOG_RING_SIZE, sizeof(log_record));
+    log->head = 0;
+    log->tail = 0;
+    log->stop = 0;
+    log->dropped = 0;
+
+    if (pthread_create(&log->thread, NULL, async_log_thread, log)) {
+        puts("Cannot start the log writer thread");
+        fclose(log->file);
+        free(log->buffer);
+        free(log->ring);
+        log->file = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+//==============================================================================
+//                                                                          push
+//==============================================================================
+
+void async_log_push(async_log* log, const log_record* record) {
+    unsigned long head = log->head;
+
+    if (head - __atomic_load_n(&log->tail, __ATOMIC_ACQUIRE) >= ASYNC_LOG_RING_SIZE) {
+        log->dropped++;
+        return;
+    }
+
+    log->ring[head % ASYNC_LOG_RING_SIZE] = *record;
+    __atomic_store_n(&log->head, head + 1, __ATOMIC_RELEASE);
+}
+
+//==============================================================================
+//                                                                         close
+//==============================================================================
+
+void async_log_close(async_log* log) {
+    if (log->file == NULL)
+        return;
+
+    __atomic_store_n(&log->stop, 1, __ATOMIC_RELEASE);
+    pthread_join(log->thread, NULL);
+
+    fclose(log->file);
+    log->file = NULL;
+    free(log->buffer);
+    free(log->ring);
+}
+
+//==============================================================================
+//                                                                        export
+//==============================================================================
+
+long async_log_export(const char* log_name, const char* csv_name) {
+    FILE* in;
+    FILE* out;
+    uint8_t file_header[ASYNC_LOG_HEADER_LEN];
+    uint8_t buf[ASYNC_LOG_RECORD_LEN];
+    char* header;
+    uint16_t version, format;
+    uint32_t header_len, record_len;
+    log_record record;
+    long records = 0;
+    size_t n;
+
+    in = fopen(log_name, "rb");
+    if (in == NULL) {
+        perror("Error opening file");
+        return -1;
+    }
+
+    if (fread(file_header, 1, ASYNC_LOG_HEADER_LEN, in) != ASYNC_LOG_HEADER_LEN ||
+            memcmp(file_header, ASYNC_LOG_MAGIC, 4)) {
+        printf("%s is not a log file\n", log_name);
+        fclose(in);
+        return -1;
+    }
+
+    memcpy(&version, file_header + 4, 2);
+    memcpy(&format, file_header + 6, 2);
+    memcpy(&header_len, file_header + 8, 4);
+    memcpy(&record_len, file_header + 12, 4);
+    version = QB_LE16(version);
+    format = QB_LE16(format);
+    header_len = QB_LE32(header_len);
+    record_len = QB_LE32(record_len);
+
+    if (version != ASYNC_LOG_VERSION || record_len != ASYNC_LOG_RECORD_LEN || header_len > 4096) {
+        printf("Unsupported log file %s\n", log_name);
+        fclose(in);
+        return -1;
+    }
+
+    header = (char*) calloc(header_len + 1, 1);
+    if (fread(header, 1, header_len, in) != header_len) {
+        printf("Corrupted log file %s\n", log_name);
+        free(header);
+        fclose(in);
+        return -1;
+    }
+
+    out = fopen(csv_name, "w");
+    if (out == NULL) {
+        perror("Error opening file");
+        free(header);
+        fclose(in);
+        return -1;
+    }
+    fputs(header, out);
+    free(header);
+
+    while ((n = fread(buf, 1, ASYNC_LOG_RECORD_LEN, in)) == ASYNC_LOG_RECORD_LEN) {
+        if (!log_decode(buf, &record))
+            break;
+        log_print(out, format, &record);
+        records++;
+    }
+
+    if (n != 0 || !feof(in))
+        printf("Skipped the incomplete last record of %s\n", log_name);
+
+    fclose(in);
+    fclose(out);
+
+    return records;
+}
+
+/* [] END OF FILE */
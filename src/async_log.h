@@ -0,0 +1,134 @@
+// ----------------------------------------------------------------------------
+// BSD 3-Clause License
+
+// Copyright (c) 2016, qbrobotics
+// Copyright (c) 2017-2024, Centro "E.Piaggio"
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// POSSIBILITY OF SUCH DAMAGE.
+// ----------------------------------------------------------------------------
+
+/**
+* \file         async_log.h
+*
+* \brief        Asynchronous CSV logger for the control loops
+* \author       _Centro "E.Piaggio"_
+* \copyright    (C) 2017-2024 Centro "E.Piaggio". All rights reserved.
+*
+* \details      The control loop pushes fixed-size records into a lock-free
+*               single-producer/single-consumer ring; a writer thread
+*               appends them to the file in large blocks. A slow disk can
+*               never stall the control tick: when the ring is full the
+*               record is dropped and counted instead.
+*
+*               The file is append-only and record framed, so it never needs
+*               to be repaired: a record cut by CTRL-C or a crash has no
+*               commit marker and readers simply ignore it. All fields are
+*               little endian:
+*               [ 0] char     magic[4] = "QBLG"
+*               [ 4] uint16   version = 1
+*               [ 6] uint16   format, see async_log_format
+*               [ 8] uint32   header_len
+*               [12] uint32   record_len = 32
+*               [16] char     header[header_len], first line of the CSV export
+*               then every record is
+*               [ 0] int64    time since the start of the loop [us]
+*               [ 8] int16    inputs[2]
+*               [12] int16    measurements[4]
+*               [20] int16    currents[2]
+*               [24] int16    sensor_num
+*               [26] uint16   device id, 0 in single device logs
+*               [28] uint32   commit marker = ASYNC_LOG_COMMIT
+*/
+
+#ifndef ASYNC_LOG_H_INCLUDED
+#define ASYNC_LOG_H_INCLUDED
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#define ASYNC_LOG_RING_SIZE     65536       ///< Records buffered (power of 2)
+#define ASYNC_LOG_BUFFER_SIZE   (1 << 20)   ///< Bytes written at once
+#define ASYNC_LOG_IDLE          10000       ///< Writer thread sleep when idle [us]
+#define ASYNC_LOG_MAGIC         "QBLG"
+#define ASYNC_LOG_VERSION       1
+#define ASYNC_LOG_HEADER_LEN    16
+#define ASYNC_LOG_RECORD_LEN    32
+#define ASYNC_LOG_COMMIT        0x51424C43  ///< Last field of a complete record
+
+/** Row layout of the CSV export
+ */
+enum async_log_format {
+    ASYNC_LOG_FILE,             ///< -f: sensor_1..n, input_1, input_2, current_1, current_2
+    ASYNC_LOG_SIN,              ///< -y: t(ms), I[0], I[1], M[0..n], C[0], C[1]
+    ASYNC_LOG_DEVICES           ///< -f --devices: id, then as ASYNC_LOG_FILE
+};
+
+/** One control tick
+ */
+typedef struct log_record {
+    long long time;             ///< Time since the start of the loop [us]
+    short int inputs[2];
+    short int measurements[4];
+    short int currents[2];
+    int sensor_num;             ///< Valid measurements, may be negative on errors
+    int id;                     ///< Device, 0 in single device logs
+} log_record;
+
+typedef struct async_log {
+    FILE* file;
+    char* buffer;               ///< stdio buffer of file
+
+    log_record* ring;
+    unsigned long head;         ///< Records pushed by the control loop
+    unsigned long tail;         ///< Records written by the writer thread
+    int stop;
+    long dropped;               ///< Records lost because the ring was full
+    pthread_t thread;
+} async_log;
+
+/** Create filename, store header (the first line of the CSV export, may
+ *  be NULL) and start the writer thread. Returns 0 on success.
+ */
+int async_log_open(async_log* log, const char* filename, int format, const char* header);
+
+/** Queue a record, never blocks
+ */
+void async_log_push(async_log* log, const log_record* record);
+
+/** Write the queued records, stop the writer thread and close the file
+ */
+void async_log_close(async_log* log);
+
+/** Convert a framed log to CSV, return the number of records or -1.
+ *  A partial last record is skipped.
+ */
+long async_log_export(const char* log_name, const char* csv_name);
+
+#endif
+/* [] END OF FILE */
@@ -0,0 +1,268 @@
+// ----------------------------------------------------------------------------
+// BSD 3-Clause License
+
+// Copyright (c) 2016, qbrobotics
+// Copyright (c) 2017-2024, Centro "E.Piaggio"
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// POSSIBILITY OF SUCH DAMAGE.
+// ----------------------------------------------------------------------------
+
+/**
+* \file         bench.c
+*
+* \brief        Round trip benchmark of the serial link
+* \author       _Centro "E.Piaggio"_
+* \copyright    (C) 2017-2024 Centro "E.Piaggio". All rights reserved.
+*/
+
+#include "bench.h"
+#include "rt_sched.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/** State shared by the requests of a run
+ */
+typedef struct bench_state {
+    short int values[4];
+    short int inputs[2];
+    int inputs_known;
+    char info[10000];
+} bench_state;
+
+static int bench_get_measurements(comm_settings* cs, int id, bench_state* st) {
+    return commGetMeasurements(cs, id, st->values);
+}
+
+static int bench_get_velocities(comm_settings* cs, int id, bench_state* st) {
+    return commGetVelocities(cs, id, st->values);
+}
+
+static int bench_get_accelerations(comm_settings* cs, int id, bench_state* st) {
+    return commGetAccelerations(cs, id, st->values);
+}
+
+static int bench_get_currents(comm_settings* cs, int id, bench_state* st) {
+    return commGetCurrents(cs, id, st->values);
+}
+
+static int bench_get_inputs(comm_settings* cs, int id, bench_state* st) {
+    if (commGetInputs(cs, id, st->inputs) < 0)
+        return -1;
+    st->inputs_known = 1;
+    return 0;
+}
+
+static int bench_get_activate(comm_settings* cs, int id, bench_state* st) {
+    char activate;
+
+    return commGetActivate(cs, id, &activate);
+}
+
+static int bench_get_info(comm_settings* cs, int id, bench_state* st) {
+    return commGetInfo(cs, id, INFO_ALL, st->info);
+}
+
+static int bench_set_get(comm_settings* cs, int id, bench_state* st) {
+    commSetInputs(cs, id, st->inputs);
+    return commGetMeasurements(cs, id, st->values);
+}
+
+/** Commands in the order they are run, get_inputs before set_get
+ */
+static const struct {
+    const char* name;
+    int (*request)(comm_settings*, int, bench_state*);
+} bench_table[] = {
+    { "get_measurements",  bench_get_measurements },
+    { "get_velocities",    bench_get_velocities },
+    { "get_accelerations", bench_get_accelerations },
+    { "get_currents",      bench_get_currents },
+    { "get_inputs",        bench_get_inputs },
+    { "get_activate",      bench_get_activate },
+    { "get_info",          bench_get_info },
+    { "set_get",           bench_set_get }
+};
+
+static int compare_latency(const void* a, const void* b) {
+    long long x = *(const long long*)a;
+    long long y = *(const long long*)b;
+
+    return (x > y) - (x < y);
+}
+
+/** Nearest rank percentile of the sorted latencies
+ */
+static long long percentile(bench_command* cmd, int percent) {
+    long rank = (cmd->ok * percent + 99) / 100;
+
+    if (rank < 1)
+        rank = 1;
+    return cmd->latency[rank - 1];
+}
+
+//==============================================================================
+//                                                                           run
+//==============================================================================
+
+int bench_run(bench* b, comm_settings* cs, int id, long iterations) {
+    bench_state* st;
+    bench_command* cmd;
+    long long begin, end;
+    long i;
+    int c;
+
+    st = (bench_state*) calloc(1, sizeof(bench_state));
+    if (st == NULL)
+        return -1;
+
+    b->id = id;
+    b->iterations = iterations;
+    b->num_commands = sizeof(bench_table) / sizeof(bench_table[0]);
+
+    for (c = 0; c < b->num_commands; c++) {
+        cmd = &b->commands[c];
+        memset(cmd, 0, sizeof(bench_command));
+        cmd->name = bench_table[c].name;
+
+        if (b->stop || (bench_table[c].request == bench_set_get && !st->inputs_known)) {
+            cmd->skipped = 1;
+            continue;
+        }
+
+        cmd->latency = (long long*) malloc(iterations * sizeof(long long));
+        if (cmd->latency == NULL) {
+            free(st);
+            return -1;
+        }
+
+        // leftovers of the previous series must not end up in this one
+        usleep(BENCH_PAUSE);
+
+        cmd->total = rt_sched_now_us();
+        for (i = 0; i < iterations && !b->stop; i++) {
+            begin = rt_sched_now_us();
+            if (bench_table[c].request(cs, id, st) < 0) {
+                cmd->errors++;
+                continue;
+            }
+            end = rt_sched_now_us();
+            cmd->latency[cmd->ok++] = end - begin;
+        }
+        cmd->total = rt_sched_now_us() - cmd->total;
+
+        if (cmd->ok == 0)
+            continue;
+
+        qsort(cmd->latency, cmd->ok, sizeof(long long), compare_latency);
+        cmd->min = cmd->latency[0];
+        cmd->p50 = percentile(cmd, 50);
+        cmd->p99 = percentile(cmd, 99);
+        cmd->max = cmd->latency[cmd->ok - 1];
+        cmd->rate = cmd->ok * 1e6 / cmd->total;
+    }
+
+    free(st);
+    return 0;
+}
+
+void bench_free(bench* b) {
+    int c;
+
+    for (c = 0; c < b->num_commands; c++) {
+        free(b->commands[c].latency);
+        b->commands[c].latency = NULL;
+    }
+}
+
+//==============================================================================
+//                                                                        output
+//==============================================================================
+
+void bench_print(bench* b, FILE* out) {
+    bench_command* cmd;
+    double sustained = 0;
+    int c;
+
+    if (b->baudrate)
+        fprintf(out, "Device %d at %d baud, %ld iterations\n", b->id, b->baudrate, b->iterations);
+    else
+        fprintf(out, "Device %d through qbadmind, %ld iterations\n", b->id, b->iterations);
+
+    fprintf(out, "  %-17s  %6s  %6s  %6s  %6s  %9s  %7s\n", "command",
+            "min", "p50", "p99", "max", "rate", "errors");
+    for (c = 0; c < b->num_commands; c++) {
+        cmd = &b->commands[c];
+        if (cmd->skipped) {
+            fprintf(out, "  %-17s  skipped\n", cmd->name);
+            continue;
+        }
+        if (cmd->ok == 0) {
+            fprintf(out, "  %-17s  %6s  %6s  %6s  %6s  %9s  %6.1f%%\n", cmd->name,
+                    "-", "-", "-", "-", "-", 100.0);
+            continue;
+        }
+        fprintf(out, "  %-17s  %6lld  %6lld  %6lld  %6lld  %9.1f  %6.1f%%\n", cmd->name,
+                cmd->min, cmd->p50, cmd->p99, cmd->max, cmd->rate,
+                100.0 * cmd->errors / (cmd->ok + cmd->errors));
+        if (cmd->rate > sustained)
+            sustained = cmd->rate;
+    }
+    fprintf(out, "Round trips in usec, rate in transactions/s\n");
+    fprintf(out, "Max sustained rate: %.1f transactions/s\n", sustained);
+}
+
+void bench_print_json(bench* b, FILE* out) {
+    bench_command* cmd;
+    int c;
+
+    fprintf(out, "{\"id\": %d, \"baudrate\": %d, \"iterations\": %ld, \"commands\": [",
+            b->id, b->baudrate, b->iterations);
+    for (c = 0; c < b->num_commands; c++) {
+        cmd = &b->commands[c];
+        fprintf(out, "%s\n  {\"name\": \"%s\", ", c ? "," : "", cmd->name);
+        if (cmd->skipped) {
+            fprintf(out, "\"skipped\": true}");
+            continue;
+        }
+        fprintf(out, "\"ok\": %ld, \"errors\": %ld, ", cmd->ok, cmd->errors);
+        if (cmd->ok == 0) {
+            fprintf(out, "\"min_us\": null, \"p50_us\": null, \"p99_us\": null, "
+                    "\"max_us\": null, \"rate_hz\": 0}");
+            continue;
+        }
+        fprintf(out, "\"min_us\": %lld, \"p50_us\": %lld, \"p99_us\": %lld, "
+                "\"max_us\": %lld, \"rate_hz\": %.1f}",
+                cmd->min, cmd->p50, cmd->p99, cmd->max, cmd->rate);
+    }
+    fprintf(out, "\n]}\n");
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,109 @@
+// ----------------------------------------------------------------------------
+// BSD 3-Clause License
+
+// Copyright (c) 2016, qbrobotics
+// Copyright (c) 2017-2024, Centro "E.Piaggio"
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// POSSIBILITY OF SUCH DAMAGE.
+// ----------------------------------------------------------------------------
+
+/**
+* \file         bench.h
+*
+* \brief        Round trip benchmark of the serial link
+* \author       _Centro "E.Piaggio"_
+* \copyright    (C) 2017-2024 Centro "E.Piaggio". All rights reserved.
+*
+* \details      Every command qbadmin uses in its loops is sent N times back
+*               to back to one device, and the round trip of each request is
+*               measured on CLOCK_MONOTONIC. The summary gives min, median,
+*               99th percentile and max of the successful requests, the
+*               transactions per second the series sustained and the
+*               failures. The qbAPI does not tell a timeout from a corrupted
+*               reply, both are counted as errors.
+*
+*               set_get is one control cycle of -f: commSetInputs with the
+*               inputs read by get_inputs, so the motors hold their
+*               references, followed by commGetMeasurements. It is skipped
+*               when the inputs cannot be read.
+*/
+
+#ifndef BENCH_H_INCLUDED
+#define BENCH_H_INCLUDED
+
+#include <stdio.h>
+#include <signal.h>
+
+#include "../../qbAPI/src/qbmove_communications.h"
+
+#define BENCH_MAX_COMMANDS      8
+#define BENCH_PAUSE             10000   ///< Quiet bus between two series [us]
+
+typedef struct bench_command {
+    const char* name;
+    long long* latency;             ///< Round trips of the successful requests [us]
+    long ok;
+    long errors;
+    int skipped;                    ///< Not run, see set_get
+    long long total;                ///< Duration of the series [us]
+    long long min;
+    long long p50;
+    long long p99;
+    long long max;
+    double rate;                    ///< Successful transactions per second
+} bench_command;
+
+typedef struct bench {
+    int id;
+    int baudrate;                   ///< Of the port, 0 through qbadmind
+    long iterations;
+    volatile sig_atomic_t stop;     ///< Set by the CTRL-C handler
+
+    int num_commands;
+    bench_command commands[BENCH_MAX_COMMANDS];
+} bench;
+
+/** Run every series on device id. A CTRL-C ends the current series and
+ *  skips the next ones. Returns 0, or -1 if out of memory.
+ */
+int bench_run(bench* b, comm_settings* cs, int id, long iterations);
+
+/** Summary table
+ */
+void bench_print(bench* b, FILE* out);
+
+/** Same summary as a JSON object
+ */
+void bench_print_json(bench* b, FILE* out);
+
+/** Free the latencies
+ */
+void bench_free(bench* b);
+
+#endif
+/* [] END OF FILE */
@@ -0,0 +1,154 @@
+// ----------------------------------------------------------------------------
+// BSD 3-Clause License
+
+// Copyright (c) 2016, qbrobotics
+// Copyright (c) 2017-2024, Centro "E.Piaggio"
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// POSSIBILITY OF SUCH DAMAGE.
+// ----------------------------------------------------------------------------
+
+/**
+* \file         bus_sched.c
+*
+* \brief        Round-robin control of several devices on one serial port
+* \author       _Centro "E.Piaggio"_
+* \copyright    (C) 2017-2024 Centro "E.Piaggio". All rights reserved.
+*/
+
+#include "bus_sched.h"
+#include "qbmetered.h"
+#include "rt_sched.h"
+
+#include <string.h>
+#include <time.h>
+
+static void timing_add(bus_timing* timing, long long value) {
+    if (timing->count == 0 || value < timing->min)
+        timing->min = value;
+    if (timing->count == 0 || value > timing->max)
+        timing->max = value;
+    timing->sum += value;
+    timing->count++;
+}
+
+//==============================================================================
+//                                                                       devices
+//==============================================================================
+
+int bus_parse_devices(bus_sched* bus, const char* list) {
+    const char* p = list;
+    int id, n;
+
+    memset(bus, 0, sizeof(*bus));
+
+    while (*p) {
+        if (sscanf(p, "%d%n", &id, &n) != 1 || id < 1 || id > 255 ||
+                bus->num_devices == BUS_MAX_DEVICES) {
+            printf("Wrong device list %s\n", list);
+            return -1;
+        }
+        bus->devices[bus->num_devices++].id = id;
+
+        p += n;
+        if (*p == ',')
+            p++;
+        else if (*p) {
+            printf("Wrong device list %s\n", list);
+            return -1;
+        }
+    }
+
+    return bus->num_devices;
+}
+
+//==============================================================================
+//                                                                         cycle
+//==============================================================================
+
+int bus_cycle(bus_sched* bus, comm_settings* cs) {
+    bus_device* dev;
+    long long start, t0, t1;
+    int failed = 0;
+    int i;
+
+    start = rt_sched_now_us();
+    t0 = start;
+
+    for (i = 0; i < bus->num_devices; i++) {
+        dev = &bus->devices[i];
+
+        commSetInputs(cs, dev->id, dev->inputs);
+        dev->sensor_num = commGetMeasurements(cs, dev->id, dev->measurements);
+        if (dev->sensor_num < 0) {
+            dev->errors++;
+            failed++;
+        }
+
+        t1 = rt_sched_now_us();
+        timing_add(&dev->timing, t1 - t0);
+        t0 = t1;
+    }
+
+    timing_add(&bus->cycle, t0 - start);
+
+    return failed;
+}
+
+void bus_zero(bus_sched* bus, comm_settings* cs) {
+    int i;
+
+    for (i = 0; i < bus->num_devices; i++) {
+        bus->devices[i].inputs[0] = 0;
+        bus->devices[i].inputs[1] = 0;
+        commSetInputs(cs, bus->devices[i].id, bus->devices[i].inputs);
+    }
+}
+
+//==============================================================================
+//                                                                    statistics
+//==============================================================================
+
+void bus_print(bus_sched* bus, FILE* out) {
+    bus_device* dev;
+    int i;
+
+    if (bus->cycle.count == 0)
+        return;
+
+    fprintf(out, "  ID   min (usec)   avg (usec)   max (usec)   errors\n");
+    for (i = 0; i < bus->num_devices; i++) {
+        dev = &bus->devices[i];
+        fprintf(out, "  %3d  %10lld   %10.1f   %10lld   %6ld\n", dev->id,
+                dev->timing.min, dev->timing.sum / dev->timing.count,
+                dev->timing.max, dev->errors);
+    }
+    fprintf(out, "  all  %10lld   %10.1f   %10lld\n", bus->cycle.min,
+            bus->cycle.sum / bus->cycle.count, bus->cycle.max);
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,103 @@
+// ----------------------------------------------------------------------------
+// BSD 3-Clause License
+
+// Copyright (c) 2016, qbrobotics
+// Copyright (c) 2017-2024, Centro "E.Piaggio"
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// POSSIBILITY OF SUCH DAMAGE.
+// ----------------------------------------------------------------------------
+
+/**
+* \file         bus_sched.h
+*
+* \brief        Round-robin control of several devices on one serial port
+* \author       _Centro "E.Piaggio"_
+* \copyright    (C) 2017-2024 Centro "E.Piaggio". All rights reserved.
+*
+* \details      In every control tick each device of the chain gets its
+*               commSetInputs and commGetMeasurements, one device after the
+*               other, so one process owns the bus and the requests never
+*               collide. The time spent on every device and on the whole
+*               cycle is recorded to find the slowest joint and the highest
+*               tick rate the chain can sustain.
+*/
+
+#ifndef BUS_SCHED_H_INCLUDED
+#define BUS_SCHED_H_INCLUDED
+
+#include <stdio.h>
+
+#include "../../qbAPI/src/qbmove_communications.h"
+
+#define BUS_MAX_DEVICES     16
+
+/** Min/avg/max of a duration [us]
+ */
+typedef struct bus_timing {
+    long count;
+    long long min;
+    long long max;
+    double sum;
+} bus_timing;
+
+typedef struct bus_device {
+    int id;
+    short int inputs[2];            ///< Sent in the next cycle
+    short int measurements[4];      ///< Read in the last cycle
+    int sensor_num;                 ///< Of the last cycle, < 0 on errors
+
+    long errors;                    ///< Failed commGetMeasurements
+    bus_timing timing;              ///< Time spent on the device in a cycle
+} bus_device;
+
+typedef struct bus_sched {
+    int num_devices;
+    bus_device devices[BUS_MAX_DEVICES];
+    bus_timing cycle;               ///< Time of a whole cycle
+} bus_sched;
+
+/** Parse a comma separated list of device IDs. Returns the number of
+ *  devices, or -1 on a malformed list.
+ */
+int bus_parse_devices(bus_sched* bus, const char* list);
+
+/** One round of commSetInputs + commGetMeasurements on every device.
+ *  Returns the number of devices that failed.
+ */
+int bus_cycle(bus_sched* bus, comm_settings* cs);
+
+/** Send inputs 0,0 to every device
+ */
+void bus_zero(bus_sched* bus, comm_settings* cs);
+
+/** Print per device and per cycle timing
+ */
+void bus_print(bus_sched* bus, FILE* out);
+
+#endif
+/* [] END OF FILE */
@@ -0,0 +1,313 @@
+// ----------------------------------------------------------------------------
+// BSD 3-Clause License
+
+// Copyright (c) 2016, qbrobotics
+// Copyright (c) 2017-2024, Centro "E.Piaggio"
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// POSSIBILITY OF SUCH DAMAGE.
+// ----------------------------------------------------------------------------
+
+/**
+* \file         capture.c
+*
+* \brief        Capture of the serial traffic and its replay file format
+* \author       _Centro "E.Piaggio"_
+* \copyright    (C) 2017-2024 Centro "E.Piaggio". All rights reserved.
+*/
+
+#include "capture.h"
+#include "byte_order.h"
+#include "rt_sched.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if !(defined(_WIN32) || defined(_WIN64))
+    #include <errno.h>
+    #include <poll.h>
+    #include <sys/socket.h>
+#endif
+
+#if !(defined(_WIN32) || defined(_WIN64))
+
+static int write_all(int fd, const uint8_t* data, int len) {
+    int sent, n;
+
+    for (sent = 0; sent < len; sent += n) {
+        n = write(fd, data + sent, len - sent);
+        if (n < 0 && errno == EINTR)
+            n = 0;
+        else if (n <= 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+static void capture_record_write(capture* c, long long time, int direction, const uint8_t* data, int len) {
+    uint8_t header[CAPTURE_RECORD_HEADER];
+    long long delta = time - c->last;
+    uint32_t u32;
+    uint16_t u16;
+
+    if (delta < 0)
+        delta = 0;
+    if (delta > 0xFFFFFFFFLL)
+        delta = 0xFFFFFFFFLL;
+    c->last += delta;
+
+    u32 = QB_LE32((uint32_t)delta);
+    memcpy(header, &u32, 4);
+    u16 = QB_LE16((uint16_t)len);
+    memcpy(header + 4, &u16, 2);
+    header[6] = (uint8_t)direction;
+    header[7] = 0;
+
+    fwrite(header, 1, CAPTURE_RECORD_HEADER, c->file);
+    fwrite(data, 1, len, c->file);
+    c->records++;
+    c->bytes += len;
+}
+
+//==============================================================================
+//                                                                         proxy
+//==============================================================================
+
+/** Forward the bytes both ways, the record goes to the file after the
+ *  bytes went on, so the disk never delays the traffic. Runs until the
+ *  tool's end of the pair is shut down and everything it wrote is on the
+ *  port.
+ */
+static void* capture_proxy(void* arg) {
+    capture* c = (capture*) arg;
+    uint8_t buf[CAPTURE_MAX_CHUNK];
+    struct pollfd fds[2];
+    long long time;
+    int n;
+
+    fds[0].fd = c->proxy_fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = c->port_fd;
+    fds[1].events = POLLIN;
+
+    while (1) {
+        if (poll(fds, 2, -1) <= 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        if (fds[0].revents & (POLLIN | POLLHUP)) {
+            n = read(c->proxy_fd, buf, sizeof(buf));
+            if (n <= 0)
+                break;                  // end of the tool's writes
+            time = rt_sched_now_us();
+            if (write_all(c->port_fd, buf, n))
+                break;
+            capture_record_write(c, time - c->start, CAPTURE_TO_DEVICE, buf, n);
+        }
+
+        if (fds[1].revents & POLLIN) {
+            n = read(c->port_fd, buf, sizeof(buf));
+            if (n <= 0)
+                break;
+            time = rt_sched_now_us();
+            if (write_all(c->proxy_fd, buf, n))
+                break;
+            capture_record_write(c, time - c->start, CAPTURE_TO_HOST, buf, n);
+        }
+    }
+
+    return NULL;
+}
+
+int capture_start(capture* c, comm_settings* cs, const char* filename, int baudrate) {
+    uint8_t header[CAPTURE_HEADER_LEN];
+    uint32_t u32;
+    uint16_t u16;
+    int pair[2];
+
+    c->file = fopen(filename, "wb");
+    if (c->file == NULL) {
+        perror("Error opening capture file");
+        return -1;
+    }
+    c->buffer = (char*) malloc(CAPTURE_BUFFER_SIZE);
+    if (c->buffer != NULL)
+        setvbuf(c->file, c->buffer, _IOFBF, CAPTURE_BUFFER_SIZE);
+
+    memset(header, 0, sizeof(header));
+    memcpy(header, CAPTURE_MAGIC, 4);
+    u16 = QB_LE16((uint16_t)CAPTURE_VERSION);
+    memcpy(header + 4, &u16, 2);
+    u16 = QB_LE16((uint16_t)CAPTURE_RECORD_HEADER);
+    memcpy(header + 6, &u16, 2);
+    u32 = QB_LE32((uint32_t)baudrate);
+    memcpy(header + 8, &u32, 4);
+    fwrite(header, 1, CAPTURE_HEADER_LEN, c->file);
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair)) {
+        perror("Cannot create the capture socket pair");
+        fclose(c->file);
+        free(c->buffer);
+        return -1;
+    }
+
+    c->handle = &cs->file_handle;
+    c->port_fd = cs->file_handle;
+    c->host_fd = pair[0];
+    c->proxy_fd = pair[1];
+    c->start = rt_sched_now_us();
+    c->last = 0;
+    c->records = 0;
+    c->bytes = 0;
+
+    if (pthread_create(&c->thread, NULL, capture_proxy, c)) {
+        puts("Cannot start the capture thread");
+        close(pair[0]);
+        close(pair[1]);
+        fclose(c->file);
+        free(c->buffer);
+        return -1;
+    }
+
+    cs->file_handle = c->host_fd;
+
+    return 0;
+}
+
+void capture_stop(capture* c) {
+    if (c->file == NULL)
+        return;
+
+    // the proxy drains what is still queued, then reads the end of file
+    shutdown(c->host_fd, SHUT_WR);
+    pthread_join(c->thread, NULL);
+
+    close(c->host_fd);
+    close(c->proxy_fd);
+    *c->handle = c->port_fd;
+
+    fclose(c->file);
+    free(c->buffer);
+    c->file = NULL;
+    c->buffer = NULL;
+}
+
+#else
+
+int capture_start(capture* c, comm_settings* cs, const char* filename, int baudrate) {
+    puts("Capturing the serial traffic is only available on Linux and macOS.");
+    c->file = NULL;
+    return -1;
+}
+
+void capture_stop(capture* c) {}
+
+#endif
+
+//==============================================================================
+//                                                                        reader
+//==============================================================================
+
+int capture_open(capture* c, const char* filename, int* baudrate) {
+    uint8_t header[CAPTURE_HEADER_LEN];
+    uint32_t u32;
+    uint16_t u16;
+
+    c->file = fopen(filename, "rb");
+    if (c->file == NULL) {
+        perror("Error opening capture file");
+        return -1;
+    }
+    c->buffer = NULL;
+    c->last = 0;
+    c->records = 0;
+    c->bytes = 0;
+
+    if (fread(header, 1, CAPTURE_HEADER_LEN, c->file) != CAPTURE_HEADER_LEN ||
+            memcmp(header, CAPTURE_MAGIC, 4)) {
+        printf("%s is not a capture file\n", filename);
+        fclose(c->file);
+        c->file = NULL;
+        return -1;
+    }
+
+    memcpy(&u16, header + 4, 2);
+    if (QB_LE16(u16) != CAPTURE_VERSION) {
+        printf("Unsupported capture version %d\n", QB_LE16(u16));
+        fclose(c->file);
+        c->file = NULL;
+        return -1;
+    }
+
+    memcpy(&u32, header + 8, 4);
+    if (baudrate != NULL)
+        *baudrate = QB_LE32(u32);
+
+    return 0;
+}
+
+int capture_next(capture* c, capture_record* r) {
+    uint8_t header[CAPTURE_RECORD_HEADER];
+    uint32_t u32;
+    uint16_t u16;
+    size_t n;
+
+    // a record cut by CTRL-C ends the capture
+    n = fread(header, 1, CAPTURE_RECORD_HEADER, c->file);
+    if (n != CAPTURE_RECORD_HEADER)
+        return 0;
+
+    memcpy(&u32, header, 4);
+    memcpy(&u16, header + 4, 2);
+    c->last += QB_LE32(u32);
+
+    r->time = c->last;
+    r->len = QB_LE16(u16);
+    r->direction = header[6];
+    if (r->len > CAPTURE_MAX_CHUNK || r->direction > CAPTURE_TO_HOST)
+        return -1;
+
+    if (fread(r->data, 1, r->len, c->file) != (size_t)r->len)
+        return 0;
+
+    c->records++;
+    c->bytes += r->len;
+    return 1;
+}
+
+void capture_close(capture* c) {
+    if (c->file != NULL)
+        fclose(c->file);
+    c->file = NULL;
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,130 @@
+// ----------------------------------------------------------------------------
+// BSD 3-Clause License
+
+// Copyright (c) 2016, qbrobotics
+// Copyright (c) 2017-2024, Centro "E.Piaggio"
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// POSSIBILITY OF SUCH DAMAGE.
+// ----------------------------------------------------------------------------
+
+/**
+* \file         capture.h
+*
+* \brief        Capture of the serial traffic and its replay file format
+* \author       _Centro "E.Piaggio"_
+* \copyright    (C) 2017-2024 Centro "E.Piaggio". All rights reserved.
+*
+* \details      While capturing, the tools talk to one end of a socket pair
+*               instead of the serial port. A proxy thread moves the bytes
+*               between the pair and the port and stores every chunk with
+*               its CLOCK_MONOTONIC time, so the qbAPI and the control
+*               loops do not change at all. qbsim -r plays a capture back
+*               with the same timing (see qbsim.c).
+*
+*               Capture file, little endian:
+*               [ 0] char     magic[4] = "QBCP"
+*               [ 4] uint16   version = 1
+*               [ 6] uint16   record header length = 8
+*               [ 8] uint32   baud rate of the port, 0 if unknown
+*               [12] uint32   reserved
+*               then every record is
+*               [ 0] uint32   time since the previous record [us]
+*               [ 4] uint16   length of the data
+*               [ 6] uint8    direction, CAPTURE_TO_DEVICE or CAPTURE_TO_HOST
+*               [ 7] uint8    reserved
+*               [ 8] uint8    data[length], the bytes of one read
+*/
+
+#ifndef CAPTURE_H_INCLUDED
+#define CAPTURE_H_INCLUDED
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "../../qbAPI/src/qbmove_communications.h"
+
+#define CAPTURE_MAGIC           "QBCP"
+#define CAPTURE_VERSION         1
+#define CAPTURE_HEADER_LEN      16
+#define CAPTURE_RECORD_HEADER   8
+#define CAPTURE_MAX_CHUNK       4096        ///< Bytes of a record
+#define CAPTURE_BUFFER_SIZE     (1 << 20)   ///< stdio buffer of the file
+
+enum capture_direction {
+    CAPTURE_TO_DEVICE,          ///< Written by the tool, a request
+    CAPTURE_TO_HOST             ///< Read from the port, a reply
+};
+
+typedef struct capture_record {
+    long long time;             ///< Since the start of the capture [us]
+    int direction;
+    int len;
+    uint8_t data[CAPTURE_MAX_CHUNK];
+} capture_record;
+
+typedef struct capture {
+    FILE* file;
+    char* buffer;               ///< stdio buffer of file
+    int port_fd;                ///< The serial port
+    int host_fd;                ///< End of the pair given to the tool
+    int proxy_fd;               ///< End of the pair of the proxy thread
+    int* handle;                ///< file_handle of the tool, restored at the end
+    long long start;
+    long long last;             ///< Time of the previous record
+    long records;
+    long long bytes;
+    pthread_t thread;
+} capture;
+
+/** Route the traffic of cs through a proxy thread that stores it in
+ *  filename. Returns 0 on success.
+ */
+int capture_start(capture* c, comm_settings* cs, const char* filename, int baudrate);
+
+/** Stop the proxy once it has forwarded every byte the tool wrote (the
+ *  last inputs of a CTRL-C handler too), give the port back to cs and
+ *  close the file
+ */
+void capture_stop(capture* c);
+
+/** Open a capture to read it. Returns 0 on success.
+ */
+int capture_open(capture* c, const char* filename, int* baudrate);
+
+/** Read the next record. Returns 1, 0 at the end of the capture or -1 if
+ *  the capture is corrupted.
+ */
+int capture_next(capture* c, capture_record* r);
+
+/** Close a capture opened by capture_open
+ */
+void capture_close(capture* c);
+
+#endif
+/* [] END OF FILE */
@@ -69,6 +69,10 @@
 #define DEFAULT_INCREMENT 1 //in degrees
 #define DEFAULT_STIFFNESS 30 //in degrees
 #define DEFAULT_MAX_EXCURSION 330 //in degrees
+#define POLL_DEFAULT_TIMEOUT 20 //in milliseconds, reply window of the polling search
+#define POLL_MIN_TIMEOUT 2 //in milliseconds
+#define INVENTORY_MAX_AGE (7*24*3600) //in seconds, older inventories are scanned again
+#define INVENTORY_INFO_LEN 4000 //max length of the escaped firmware info of a device
 
 #define ZERO 0
 #define MAX_FORWARD_STIFFNESS  32767
@@ -84,6 +88,9 @@
 #define QBMOVE_FILE "./../conf_files/qbmove.conf"
 #define QBBACKUP_FILE "./../conf_files/qbbackup.conf"
 #define QBMOVE_FILE_BR "./../conf_files/qbmoveBR.conf"
+#define QBINVENTORY_FILE "./../conf_files/qbinventory.conf"	///< Devices found by the last polling search of each port
+#define QBPORTS_FILE "./../conf_files/qbports.conf"		///< Ports and device chains of --ports
+#define QBADMIND_SOCKET "/tmp/qbadmind.sock"		///< Unix socket of qbadmind, overridden by $QBADMIND_SOCKET
 #define EMG_SAVED_VALUES "./../emg_values.csv"			///< Default location where the emg sensors values are saved
 #define SD_PARAM_FILE	"./../SD_param.csv"
 #define SD_DATA_FILE	"./../SD_data.csv"
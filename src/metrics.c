@@ -0,0 +1,353 @@
+// ----------------------------------------------------------------------------
+// BSD 3-Clause License
+
+// Copyright (c) 2016, qbrobotics
+// Copyright (c) 2017-2024, Centro "E.Piaggio"
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// POSSIBILITY OF SUCH DAMAGE.
+// ----------------------------------------------------------------------------
+
+/**
+* \file         metrics.c
+*
+* \brief        Per command counters and latency histograms of the qbAPI
+*               calls, exported in the Prometheus text format
+* \author       _Centro "E.Piaggio"_
+* \copyright    (C) 2017-2024 Centro "E.Piaggio". All rights reserved.
+*/
+
+#include "metrics.h"
+#include "rt_sched.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if !(defined(_WIN32) || defined(_WIN64))
+    #include <errno.h>
+    #include <poll.h>
+    #include <pthread.h>
+    #include <arpa/inet.h>
+    #include <netinet/in.h>
+    #include <sys/socket.h>
+#endif
+
+metric metrics[METRIC_NUM_COMMANDS];
+int metrics_enabled = 0;
+
+static const char* metric_names[METRIC_NUM_COMMANDS] = {
+    "activate",
+    "get_activate",
+    "set_inputs",
+    "set_pos_stiff",
+    "get_inputs",
+    "get_measurements",
+    "get_velocities",
+    "get_accelerations",
+    "get_currents",
+    "get_emg",
+    "get_joystick",
+    "get_imu_readings",
+    "get_info",
+    "get_param_list",
+    "get_imu_param_list",
+    "store_params",
+    "set_zeros",
+    "set_baudrate",
+    "set_watchdog",
+    "set_cuff_inputs",
+    "ext_drive",
+    "hand_calibrate",
+    "calib_imu_mag",
+    "bootloader",
+    "get_adc_conf",
+    "get_adc_raw",
+    "get_encoder_conf",
+    "get_encoder_raw",
+    "get_sd_file"
+};
+
+//==============================================================================
+//                                                                    histograms
+//==============================================================================
+
+static int bucket_index(uint64_t value) {
+    int e;
+
+    if (value < 8)
+        return (int)value;
+
+    e = 63 - __builtin_clzll(value);
+    if ((e - 2) * 8 + 7 >= METRICS_BUCKETS)
+        return METRICS_BUCKETS - 1;
+
+    return (e - 2) * 8 + (int)((value >> (e - 3)) & 7);
+}
+
+/** Largest value of a bucket
+ */
+static uint64_t bucket_upper(int index) {
+    int e, sub;
+
+    if (index < 8)
+        return index;
+
+    e = index / 8 + 2;
+    sub = index % 8;
+    return ((uint64_t)(8 + sub) << (e - 3)) + ((uint64_t)1 << (e - 3)) - 1;
+}
+
+long long metrics_begin() {
+    return metrics_enabled ? rt_sched_now_us() : 0;
+}
+
+void metrics_end(int command, long long begin, int ret, int bytes) {
+    metric* m = &metrics[command];
+    long long latency;
+
+    if (!metrics_enabled)
+        return;
+
+    latency = rt_sched_now_us() - begin;
+    if (latency < 0)
+        latency = 0;
+
+    __atomic_fetch_add(&m->requests, 1, __ATOMIC_RELAXED);
+    if (ret < 0) {
+        __atomic_fetch_add(&m->errors, 1, __ATOMIC_RELAXED);
+        if (latency >= METRICS_TIMEOUT)
+            __atomic_fetch_add(&m->timeouts, 1, __ATOMIC_RELAXED);
+    }
+    __atomic_fetch_add(&m->bytes, (uint64_t)bytes, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&m->sum, (uint64_t)latency, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&m->buckets[bucket_index(latency)], 1, __ATOMIC_RELAXED);
+}
+
+//==============================================================================
+//                                                                        export
+//==============================================================================
+
+static void write_counter(FILE* out, const char* name, const char* help, size_t offset) {
+    uint64_t value;
+    int c;
+
+    fprintf(out, "# HELP %s %s\n# TYPE %s counter\n", name, help, name);
+    for (c = 0; c < METRIC_NUM_COMMANDS; c++) {
+        value = __atomic_load_n((uint64_t*)((char*)&metrics[c] + offset), __ATOMIC_RELAXED);
+        fprintf(out, "%s{command=\"%s\"} %llu\n", name, metric_names[c], (unsigned long long)value);
+    }
+}
+
+void metrics_write(FILE* out) {
+    uint64_t count;
+    int c, b;
+
+    write_counter(out, "qbadmin_requests_total", "Calls of the qbAPI.", offsetof(metric, requests));
+    write_counter(out, "qbadmin_errors_total", "Calls that returned an error.", offsetof(metric, errors));
+    write_counter(out, "qbadmin_timeouts_total", "Errors that lasted as long as a reply timeout.",
+            offsetof(metric, timeouts));
+    write_counter(out, "qbadmin_bytes_total", "Bytes of the requests and of their replies.",
+            offsetof(metric, bytes));
+
+    // the same le bounds on every scrape, empty buckets included
+    fprintf(out, "# HELP qbadmin_latency_us Duration of the calls of the qbAPI.\n");
+    fprintf(out, "# TYPE qbadmin_latency_us histogram\n");
+    for (c = 0; c < METRIC_NUM_COMMANDS; c++) {
+        count = 0;
+        for (b = 0; b < METRICS_BUCKETS; b++) {
+            count += __atomic_load_n(&metrics[c].buckets[b], __ATOMIC_RELAXED);
+            if (b % METRICS_EXPORT_STEP == METRICS_EXPORT_STEP - 1)
+                fprintf(out, "qbadmin_latency_us_bucket{command=\"%s\",le=\"%llu\"} %llu\n",
+                        metric_names[c], (unsigned long long)bucket_upper(b), (unsigned long long)count);
+        }
+        fprintf(out, "qbadmin_latency_us_bucket{command=\"%s\",le=\"+Inf\"} %llu\n",
+                metric_names[c], (unsigned long long)count);
+        fprintf(out, "qbadmin_latency_us_sum{command=\"%s\"} %llu\n", metric_names[c],
+                (unsigned long long)__atomic_load_n(&metrics[c].sum, __ATOMIC_RELAXED));
+        fprintf(out, "qbadmin_latency_us_count{command=\"%s\"} %llu\n", metric_names[c],
+                (unsigned long long)count);
+    }
+}
+
+#if !(defined(_WIN32) || defined(_WIN64))
+
+static struct {
+    char file[255];             ///< File target, "" for the endpoint
+    int listen_fd;
+    volatile int stop;
+    pthread_t thread;
+    int running;
+} exporter;
+
+/** Rewrite the file as a whole, readers never see half of it
+ */
+static void metrics_dump() {
+    char tmp[270];
+    FILE* out;
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", exporter.file);
+    out = fopen(tmp, "w");
+    if (out == NULL)
+        return;
+    metrics_write(out);
+    fclose(out);
+    rename(tmp, exporter.file);
+}
+
+/** Answer one HTTP request with the metrics, whatever the path
+ */
+static void metrics_serve(int fd) {
+    char request[1024];
+    char* body = NULL;
+    size_t body_len = 0;
+    char header[128];
+    FILE* out;
+    struct pollfd p;
+
+    // the request itself does not matter, just let it arrive
+    p.fd = fd;
+    p.events = POLLIN;
+    if (poll(&p, 1, 200) > 0)
+        read(fd, request, sizeof(request));
+
+    out = open_memstream(&body, &body_len);
+    if (out == NULL)
+        return;
+    metrics_write(out);
+    fclose(out);
+
+    snprintf(header, sizeof(header), "HTTP/1.0 200 OK\r\n"
+            "Content-Type: text/plain; version=0.0.4\r\nContent-Length: %lu\r\n\r\n",
+            (unsigned long)body_len);
+    if (write(fd, header, strlen(header)) > 0)
+        write(fd, body, body_len);
+    free(body);
+}
+
+static void* metrics_thread(void* arg) {
+    struct pollfd p;
+    int fd, k;
+
+    while (!exporter.stop) {
+        if (exporter.file[0] != '\0') {
+            metrics_dump();
+            for (k = 0; k < METRICS_PERIOD / 100 && !exporter.stop; k++)
+                usleep(100000);
+            continue;
+        }
+
+        p.fd = exporter.listen_fd;
+        p.events = POLLIN;
+        if (poll(&p, 1, 100) <= 0)
+            continue;
+        fd = accept(exporter.listen_fd, NULL, NULL);
+        if (fd < 0)
+            continue;
+        metrics_serve(fd);
+        close(fd);
+    }
+
+    return NULL;
+}
+
+int metrics_start(const char* target) {
+    struct sockaddr_in addr;
+    const char* port = NULL;
+    int one = 1;
+
+    if (target[0] == ':')
+        port = target + 1;
+    else if (!strncmp(target, "localhost:", 10))
+        port = target + 10;
+
+    exporter.file[0] = '\0';
+    exporter.listen_fd = -1;
+    exporter.stop = 0;
+
+    if (port != NULL) {
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(atoi(port));
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        exporter.listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (exporter.listen_fd >= 0)
+            setsockopt(exporter.listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (exporter.listen_fd < 0 || bind(exporter.listen_fd, (struct sockaddr*) &addr, sizeof(addr)) ||
+                listen(exporter.listen_fd, 4)) {
+            perror("Cannot open the metrics endpoint");
+            if (exporter.listen_fd >= 0)
+                close(exporter.listen_fd);
+            return -1;
+        }
+    }
+    else
+        snprintf(exporter.file, sizeof(exporter.file), "%s", target);
+
+    metrics_enabled = 1;
+
+    if (pthread_create(&exporter.thread, NULL, metrics_thread, NULL)) {
+        puts("Cannot start the metrics thread");
+        metrics_enabled = 0;
+        if (exporter.listen_fd >= 0)
+            close(exporter.listen_fd);
+        return -1;
+    }
+    exporter.running = 1;
+
+    return 0;
+}
+
+void metrics_stop() {
+    if (!exporter.running)
+        return;
+
+    exporter.stop = 1;
+    pthread_join(exporter.thread, NULL);
+    exporter.running = 0;
+
+    if (exporter.listen_fd >= 0)
+        close(exporter.listen_fd);
+    else
+        metrics_dump();
+}
+
+#else
+
+int metrics_start(const char* target) {
+    puts("Exporting metrics is only available on Linux and macOS.");
+    return -1;
+}
+
+void metrics_stop() {}
+
+#endif
+
+/* [] END OF FILE */
@@ -0,0 +1,150 @@
+// ----------------------------------------------------------------------------
+// BSD 3-Clause License
+
+// Copyright (c) 2016, qbrobotics
+// Copyright (c) 2017-2024, Centro "E.Piaggio"
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// POSSIBILITY OF SUCH DAMAGE.
+// ----------------------------------------------------------------------------
+
+/**
+* \file         metrics.h
+*
+* \brief        Per command counters and latency histograms of the qbAPI
+*               calls, exported in the Prometheus text format
+* \author       _Centro "E.Piaggio"_
+* \copyright    (C) 2017-2024 Centro "E.Piaggio". All rights reserved.
+*
+* \details      Every call counted through qbmetered.h updates, with relaxed
+*               atomic additions only, the counters of its command:
+*               requests, errors (negative returns), timeouts, bytes on the
+*               wire and a log-linear histogram of the latency. Values
+*               below 8 us have a bucket each, then every power of two is
+*               split in 8 buckets, so any latency is known within 12.5%
+*               with 200 buckets from 1 us to over 2 minutes. They are
+*               exported every METRICS_EXPORT_STEP buckets, 50 bounds from
+*               3 us up, the same for every command on every scrape, so that
+*               histogram_quantile(rate(...)) never sees a bucket appear.
+*
+*               The qbAPI returns -1 both for a corrupted reply and for no
+*               reply at all: failures lasting at least METRICS_TIMEOUT are
+*               counted as timeouts too. Bytes are the size of the request
+*               and of the reply packets, not counting the replies lost.
+*
+*               Exported metrics, one series per command label, zero for
+*               the commands never called:
+*               qbadmin_requests_total, qbadmin_errors_total,
+*               qbadmin_timeouts_total, qbadmin_bytes_total,
+*               qbadmin_latency_us (histogram: _bucket, _sum, _count).
+*               Quantiles are computed by the scraper over a window, e.g.
+*               histogram_quantile(0.99, rate(qbadmin_latency_us_bucket[5m])).
+*/
+
+#ifndef METRICS_H_INCLUDED
+#define METRICS_H_INCLUDED
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define METRICS_BUCKETS         200
+#define METRICS_EXPORT_STEP     4       ///< Buckets merged in an exported bucket
+#define METRICS_TIMEOUT         10000   ///< Failures at least this long are timeouts [us]
+#define METRICS_PERIOD          1000    ///< File dump period [ms]
+
+/** Commands of the qbAPI calls
+ */
+enum metric_command {
+    METRIC_ACTIVATE,
+    METRIC_GET_ACTIVATE,
+    METRIC_SET_INPUTS,
+    METRIC_SET_POS_STIFF,
+    METRIC_GET_INPUTS,
+    METRIC_GET_MEASUREMENTS,
+    METRIC_GET_VELOCITIES,
+    METRIC_GET_ACCELERATIONS,
+    METRIC_GET_CURRENTS,
+    METRIC_GET_EMG,
+    METRIC_GET_JOYSTICK,
+    METRIC_GET_IMU_READINGS,
+    METRIC_GET_INFO,
+    METRIC_GET_PARAM_LIST,
+    METRIC_GET_IMU_PARAM_LIST,
+    METRIC_STORE_PARAMS,
+    METRIC_SET_ZEROS,
+    METRIC_SET_BAUDRATE,
+    METRIC_SET_WATCHDOG,
+    METRIC_SET_CUFF_INPUTS,
+    METRIC_EXT_DRIVE,
+    METRIC_HAND_CALIBRATE,
+    METRIC_CALIB_IMU_MAG,
+    METRIC_BOOTLOADER,
+    METRIC_GET_ADC_CONF,
+    METRIC_GET_ADC_RAW,
+    METRIC_GET_ENCODER_CONF,
+    METRIC_GET_ENCODER_RAW,
+    METRIC_GET_SD_FILE,
+    METRIC_NUM_COMMANDS
+};
+
+typedef struct metric {
+    uint64_t requests;
+    uint64_t errors;
+    uint64_t timeouts;
+    uint64_t bytes;
+    uint64_t sum;                       ///< Of the latencies [us]
+    uint64_t buckets[METRICS_BUCKETS];
+} metric;
+
+extern metric metrics[METRIC_NUM_COMMANDS];
+extern int metrics_enabled;
+
+/** Start time of a call, 0 when the metrics are off
+ */
+long long metrics_begin();
+
+/** Count a call of command that started at begin and returned ret
+ *  (negative on errors), with bytes on the wire
+ */
+void metrics_end(int command, long long begin, int ret, int bytes);
+
+/** Write every metric in the Prometheus text format
+ */
+void metrics_write(FILE* out);
+
+/** Start exporting. target is a file, rewritten every METRICS_PERIOD, or
+ *  ":port" / "localhost:port" for an HTTP endpoint on 127.0.0.1.
+ *  Returns 0 on success.
+ */
+int metrics_start(const char* target);
+
+/** Stop exporting, a file gets the final values
+ */
+void metrics_stop();
+
+#endif
+/* [] END OF FILE */
@@ -36,6 +36,9 @@
 // --- INCLUDE ---
 #include "../../qbAPI/src/qbmove_communications.h"
 #include "definitions.h"
+#include "qbclient.h"
+#include "param_table.h"
+#include "param_batch.h"
 
 #include <assert.h>
 #include <stdio.h>
@@ -60,6 +63,7 @@ void retrieve_section_str(int, char*);
 char get_or_set;
 comm_settings comm_settings_t;
 uint8_t device_id = BROADCAST_ID;
+param_table table;
 
 // holds the address of the array of which the sorted index order needs to be found
 int *base_arr;
@@ -71,30 +75,21 @@ int baudrate_reader();
 
 // --- MAIN ---
 int main(int argc, char **argv) {
-    int i,j,k;
+    int i,j;
     char c_choice;
+    param_batch_args args;
 
-    uint8_t aux_string[10000] = "";
-
-    int value_size;
-    int num_of_values;
     int num_of_params;
 	int num_of_sections;
 	int num_of_av_sections = 1;
-    int menu_number[NUM_OF_MAX_PARAMS];
 	int struct_number[NUM_OF_MAX_PARAMS];
     int index;
 	int section_index;
 	int current_index;
 
     int data_type[NUM_OF_MAX_PARAMS];
-    int data_dim[NUM_OF_MAX_PARAMS];
-    int data_size[NUM_OF_MAX_PARAMS];
-    char data_string[20];
-    char tmp_string[150] = "";
 	
 	char param_string[NUM_OF_MAX_PARAMS][50];
-	char aux_p_str[100] = "";
 	char values_string[NUM_OF_MAX_PARAMS][100];
 	int ordered_idx[NUM_OF_MAX_PARAMS];
 	int param_idx[NUM_OF_MAX_PARAMS];
@@ -102,16 +97,13 @@ int main(int argc, char **argv) {
 	int max_p_idx_section[50];	// max number of param for section
 	int is_sec_av[50];		// is section available
 	
-    int8_t aux_int8[4];
-    uint8_t aux_uint8[4];
-    int16_t aux_int16[4];
-    uint16_t aux_uint16[4];
-    int32_t aux_int32[4];
-    uint32_t aux_uint32[4];
-    float aux_float[4]; 
-    double aux_double[4];
-    uint8_t temp_char[4];
-	uint8_t aux_str[100] = "";			// custom string
+    uint8_t new_values[PARAM_BYTE_SLOT];
+    const char* single_op = NULL;           // "get" or "set" of one parameter by its key
+    const char* single_key = NULL;
+    char single_text[256] = "";
+
+	// The options can be anywhere on the command line
+	param_batch_options(&argc, argv, &args);
 
 	// Get device ID
 	if (argc > 1)
@@ -120,9 +112,22 @@ int main(int argc, char **argv) {
 		
 		printf("Communicating with device %d\n", device_id);
 		
+		// nmmi_param <id> get <key> or nmmi_param <id> set <key> <values>
+		if (argc > 3 && (!strcmp(argv[2], "get") || (!strcmp(argv[2], "set") && argc > 4))) {
+			single_op = argv[2];
+			single_key = argv[3];
+			for (i = 4; i < argc; i++) {
+				strncat(single_text, argv[i], sizeof(single_text) - strlen(single_text) - 2);
+				strcat(single_text, " ");
+			}
+		}
+
 		// Parse submenu type and show only related parameters
 		char submenu[100] = "";
-		if (!device_id) {
+		if (single_op != NULL) {
+			strcpy(submenu, "all");
+		}
+		else if (!device_id) {
 			sscanf(argv[1],"%s",&submenu);
 		}
 		else if (argc > 2){
@@ -173,7 +178,9 @@ int main(int argc, char **argv) {
         }
 		else {		// option not recognized
 			printf("Parameters section not recognized\n\n");
-			printf("[USAGE]: nmmi_param device_id section\n\n");
+			printf("[USAGE]: nmmi_param device_id section [-b batch_file | -d dump_file | -e snapshot | -i snapshot]\n");
+			printf("         nmmi_param device_id get key | set key values\n");
+			printf("         nmmi_param -f profile [--devices list_or_file]\n\n");
 			printf("Use one of the following allowed sections to get or set related parameters:\n");
 			printf("Device\t\t'dev' or 'device'\n");
 			printf("Motor\t\t'mot' or 'motor'\n");
@@ -203,6 +210,45 @@ int main(int argc, char **argv) {
         assert(open_port());
     }
 
+    // One profile for many devices
+    if (args.fleet != NULL) {
+        int ids[255];
+        int num_ids = param_batch_devices(args.devices, &comm_settings_t, ids);
+
+        return param_batch_fleet(args.fleet, ids, num_ids, &comm_settings_t, commGetParamList, 1) ? 1 : 0;
+    }
+
+    // One parameter by its key, e.g. "set mot1.position_pid 0.1 0 0.8"
+    if (single_op != NULL) {
+        if (!param_table_read(&table, &comm_settings_t, device_id, commGetParamList, 1)) {
+            printf("Couldn't read the parameters of the device\n");
+            return 1;
+        }
+        if (!strcmp(single_op, "get"))
+            return param_batch_get(&table, single_key) ? 1 : 0;
+
+        return param_batch_set(&table, &comm_settings_t, device_id, commGetParamList, single_key, single_text) ? 1 : 0;
+    }
+
+    // Scripted get or set, no menu
+    if (args.batch != NULL || args.dump != NULL || args.export_file != NULL || args.import_file != NULL) {
+        // values always from the board, the files compare with them
+        if (!param_table_read(&table, &comm_settings_t, device_id, commGetParamList, 1)) {
+            printf("Couldn't read the parameters of the device\n");
+            return 1;
+        }
+        if (args.dump != NULL)
+            return param_batch_dump(&table, args.dump, show_section) ? 1 : 0;
+        if (args.export_file != NULL) {
+            // the snapshot tells the firmware it was taken from
+            if (device_id != BROADCAST_ID)
+                param_table_firmware(&comm_settings_t, device_id, table.firmware);
+            return param_batch_export(&table, args.export_file, device_id) ? 1 : 0;
+        }
+
+        return param_batch_apply(args.batch != NULL ? args.batch : args.import_file, &table,
+                &comm_settings_t, device_id, commGetParamList, args.import_file != NULL) ? 1 : 0;
+    }
 
 //===============================================================     MAIN MENU
 
@@ -228,172 +274,20 @@ int main(int argc, char **argv) {
         //==============================================================     SET
         printf("\nDevice parameters: \n");
 
-        // When commGetParamList is called with index = 0, it will return in aux_string
-        // a packet containing the parameters' values and description
-        index = 0;
-        value_size = 0;
-        num_of_values = 0;
-        commGetParamList(&comm_settings_t, device_id, index, NULL, value_size, num_of_values, aux_string);
-        
-
-        // The packet returned in aux_string is composed as follows
-        // [':'][':'][ID][LEN][CMD][PARAM_NUM][...]
-
-		//for (int i=0; i<5000; i++){
-		//	printf("%c", aux_string[i]);
-		//}
-		//printf("\n");
-
-        num_of_params = aux_string[5];
-
-        // The data, for a single parameter, is packed as follows
-        // [DATA_TYPE][DATA_DIMENSION][..DATA..][..DESCRIPTION..] 
-        // Data_type is a enum that tells the parameter type (int, float, short int)
-        // Data_dimension is the number of values included in that parameter. For position pid is equal to 3. 
+        // When commGetParamList is called with index = 0 it returns a packet
+        // containing the parameters' values and description
+        num_of_params = param_table_read(&table, &comm_settings_t, device_id, commGetParamList, 1);
+        if (!num_of_params) {
+            printf("Couldn't read the parameters of the device\n");
+            return 0;
+        }
 
         for(i = 0; i < num_of_params; i++) {
-            data_type[i] = aux_string[i * PARAM_BYTE_SLOT + 6];
-            data_dim[i] = aux_string[i * PARAM_BYTE_SLOT + 7];
-            for(j = 0; j < 4; j++) {
-                aux_int8[j] = 0; aux_uint8[j] = 0; temp_char[j] = 0; aux_int16[j] = 0;
-                aux_uint16[j] = 0; aux_int32[j] = 0; aux_uint32[j] = 0; aux_float[j] = 0.0;
-                aux_double[j] = 0.0;
-            }
-
-            // For each parameter is associated a size, which is the number of bytes of that parameter, depending on its type
-            switch(data_type[i]){
-                case TYPE_FLAG:
-                    data_size[i] = 1;
-                    for(k = 0; k < data_dim[i]; k++) {
-                        for(j = 0; j < data_size[i]; j++) {
-                            aux_uint8[k] += aux_string[i*PARAM_BYTE_SLOT + 8 + k * data_size[i] + data_size[i] - j - 1] << (8 * j);  
-                        }
-                        /*sprintf(data_string, " %hhu", aux_uint8[k]);
-                        strcat(tmp_string, data_string);*/
-                    }
-                case TYPE_INT8:
-                    data_size[i] = 1;
-                    for(k = 0; k < data_dim[i]; k++) {
-                        for(j = 0; j < data_size[i]; j++) {
-                            aux_int8[k] += aux_string[i*PARAM_BYTE_SLOT + 8 + k * data_size[i] + data_size[i] - j - 1] << (8 * j);
-                        }
-                        sprintf(data_string, " %hhd", aux_int8[k]);
-                        strcat(tmp_string, data_string);
-                    }
-                break;
-                case TYPE_UINT8:
-                    data_size[i] = 1;
-                    for(k = 0; k < data_dim[i]; k++) {
-                        for(j = 0; j < data_size[i]; j++) {
-                            aux_uint8[k] += aux_string[i*PARAM_BYTE_SLOT + 8 + k * data_size[i] + data_size[i] - j - 1] << (8 * j);  
-                        }
-                        sprintf(data_string, " %hhu", aux_uint8[k]);
-                        strcat(tmp_string, data_string); 
-                    }
-                break;
-                case TYPE_INT16:
-                    data_size[i] = 2;
-                    for(k = 0; k < data_dim[i]; k++) {
-                        for(j = 0; j < data_size[i]; j++) {
-                            aux_int16[k] += aux_string[i*PARAM_BYTE_SLOT + 8 + k * data_size[i] + data_size[i] - j - 1] << (8 * j);
-                        }
-                        sprintf(data_string, " %hd", aux_int16[k]);
-                        strcat(tmp_string, data_string); 
-                    }
-                break;
-                case TYPE_UINT16:
-                    data_size[i] = 2;
-                    for(k = 0; k < data_dim[i]; k++) {
-                        for(j = 0; j < data_size[i]; j++) {
-                            aux_uint16[k] += aux_string[i*PARAM_BYTE_SLOT + 8 + k * data_size[i] + data_size[i] - j - 1] << (8 * j);
-                        }
-                        sprintf(data_string, " %hu", aux_uint16[k]);
-                        strcat(tmp_string, data_string); 
-                    }
-                break;
-                case TYPE_INT32:
-                    data_size[i] = 4;
-                    for(k = 0; k < data_dim[i]; k++) {
-                        for(j = 0; j < data_size[i]; j++) {
-                            aux_int32[k] += aux_string[i*PARAM_BYTE_SLOT + 8 + k * data_size[i] + data_size[i] - j - 1] << (8 * j);
-                        }
-                        sprintf(data_string, " %d", aux_int32[k]);
-                        strcat(tmp_string, data_string); 
-                    }
-                break;
-                case TYPE_UINT32:
-                    data_size[i] = 4;
-                    for(k = 0; k < data_dim[i]; k++) {
-                        for(j = 0; j < data_size[i]; j++) {
-                            aux_uint32[k] += aux_string[i*PARAM_BYTE_SLOT + 8 + k * data_size[i] + data_size[i] - j - 1] << (8 * j);   
-                        }
-                        sprintf(data_string, " %u", aux_uint32[k]);
-                        strcat(tmp_string, data_string);
-                    }
-                break;
-                case TYPE_FLOAT:
-                    data_size[i] = 4;
-                    for(k = 0; k < data_dim[i]; k++) {
-                        for(j = 0; j < data_size[i]; j++) {
-                            temp_char[j] = aux_string[i*PARAM_BYTE_SLOT + 8 + k * data_size[i] + data_size[i] - j - 1];
-                        }
-                        aux_float[k] = (*(float *) &temp_char);
-                        sprintf(data_string, " %f", aux_float[k]);
-
-                        strcat(tmp_string, data_string);
-                    }
-                break;
-                case TYPE_DOUBLE:
-                    data_size[i] = 4;
-                    for(k = 0; k < data_dim[i]; k++) {
-                        for(j = 0; j < data_size[i]; j++) {
-                            temp_char[j] = aux_string[i*PARAM_BYTE_SLOT + 8 + k * data_size[i] + data_size[i] - j - 1];
-                        }
-                        aux_double[k] = (*(double *) &temp_char);
-                        sprintf(data_string, " %f", aux_double[k]);
-                        strcat(tmp_string, data_string);
-                    }
-                break;
-				case TYPE_STRING:								// Custom data type
-                    data_size[i] = 1;
-					strcat(tmp_string, " "); 
-                    for(k = 0; k < data_dim[i]; k++) {
-                        for(j = 0; j < data_size[i]; j++) {
-                            aux_uint8[k] += aux_string[i*PARAM_BYTE_SLOT + 8 + k * data_size[i] + data_size[i] - j - 1] << (8 * j);  
-                        }
-                        sprintf(data_string, "%c", aux_uint8[k]);
-                        strcat(tmp_string, data_string); 
-                    }
-                break;
-				
-            }
-            // The parameter description is printed character by character until it reaches the end of the string
-            for(k = 0; aux_string[i * PARAM_BYTE_SLOT + 8 + data_size[i] * data_dim[i] + k] != '\0'; k++) {
-				aux_p_str[k] = aux_string[i * PARAM_BYTE_SLOT + 8 + data_size[i] * data_dim[i] + k];
-            }
-			aux_p_str[k] = '\0';
-			
-			// Parse tmp_string to extract parameter index and string
-			sscanf(aux_p_str, "%d - %[^\t\n]", &param_idx[i], param_string[i]);
-			
-            
-            // If the parameter is a TYPE_FLAG it has a printable menu at the end of the packet. 
-            // Their order is written at the end of each parameter description
-
-            if(data_type[i] == TYPE_FLAG)
-                menu_number[i] = aux_string[i * PARAM_BYTE_SLOT + 8 + data_size[i] * data_dim[i] + k + 1];
-            else
-                menu_number[i] = -1;
-            // If the parameter has associated a -1 to its menu_number, the parameter has not a menu.
-
-			// Retrieve struct number after an empty bit
-			if(data_type[i] == TYPE_FLAG)
-                struct_number[i] = aux_string[i * PARAM_BYTE_SLOT + 8 + data_size[i] * data_dim[i] + k + 3];
-            else
-                struct_number[i] = aux_string[i * PARAM_BYTE_SLOT + 8 + data_size[i] * data_dim[i] + k + 1];
-
-			strcpy(values_string[i], tmp_string);				
-			strcpy(tmp_string, "");
+            data_type[i] = table.params[i].type;
+            struct_number[i] = table.params[i].section;
+            param_idx[i] = table.params[i].index;
+            strcpy(param_string[i], table.params[i].name);
+            param_table_display(&table.params[i], values_string[i], sizeof(values_string[i]));
         }
 
 		// Sort parameters by struct index
@@ -498,96 +392,10 @@ int main(int argc, char **argv) {
 			//printf("Chosen index: %d\n", index);
 			printf("\n");
 			
-            for(j = 0; j < 4; j++) {
-                    aux_int8[j] = 0; aux_uint8[j] = 0; aux_int16[j] = 0; aux_uint16[j] = 0;
-                    aux_int32[j] = 0; aux_uint32[j] = 0; aux_float[j] = 0.0; aux_double[j] = 0.0;
-            }
-            // Depending on the number of values of the parameter and its type
-            // different and/or multiple readings must be done
-            printf("Insert new parameters values\n");
-            for(i = 0; i < data_dim[index - 1]; i++) {
-                if(data_type[index - 1] != TYPE_FLAG && data_type[index - 1] != TYPE_STRING) {
-                    printf("Insert %d%\370 parameter: \n", i+1);
-                    switch(data_type[index - 1]) {
-                        case TYPE_INT8:
-                            scanf("%hhd", &aux_int8[i]);
-                        break;
-
-                        case TYPE_UINT8:
-                            scanf("%hhu", &aux_uint8[i]);
-                        break;
-
-                        case TYPE_INT16:
-                            scanf("%hd", &aux_int16[i]);
-                        break;
-
-                        case TYPE_UINT16:
-                            scanf("%hu", &aux_uint16[i]);
-                        break;
-
-                        case TYPE_INT32:
-                            scanf("%d", &aux_int32[i]);
-                        break;
-
-                        case TYPE_UINT32:
-                            scanf("%u", &aux_uint32[i]);
-                        break;
-
-                        case TYPE_FLOAT:
-                            scanf("%f", &aux_float[i]);
-                        break;
-
-                        case TYPE_DOUBLE:
-                            scanf("%lf", &aux_double[i]);
-                        break;
-                    }
-                }
-                else {      
-					if(data_type[index - 1] == TYPE_FLAG){
-						// TYPE_FLAG is a uint8 but with a menu
-						for(k = 0; aux_string[num_of_params * PARAM_BYTE_SLOT + 6 + (menu_number[index - 1] - 1) * PARAM_MENU_SLOT + k] != '\0'; k++)
-							printf("%c", aux_string[num_of_params * PARAM_BYTE_SLOT + 6 + (menu_number[index - 1] - 1) * PARAM_MENU_SLOT + k]);
-						scanf("%hhu", aux_uint8);
-					}
-                }
-            }
-			
-			if (data_type[index - 1] == TYPE_STRING) {		// custom data type		
-				scanf("%s", &aux_str);
-			}
-
-            switch(data_type[index - 1]) {
-                    case TYPE_FLAG:
-                        commGetParamList(&comm_settings_t, device_id, index, aux_uint8, data_size[index - 1], data_dim[index - 1], NULL);
-                    break;
-                    case TYPE_INT8:
-                        commGetParamList(&comm_settings_t, device_id, index, aux_int8, data_size[index - 1], data_dim[index - 1], NULL);
-                    break;
-                    case TYPE_UINT8:
-                        commGetParamList(&comm_settings_t, device_id, index, aux_uint8, data_size[index - 1], data_dim[index - 1], NULL);
-                    break;
-                    case TYPE_INT16:
-                        commGetParamList(&comm_settings_t, device_id, index, aux_int16, data_size[index - 1], data_dim[index - 1], NULL);
-                    break;
-                    case TYPE_UINT16:
-                        commGetParamList(&comm_settings_t, device_id, index, aux_uint16, data_size[index - 1], data_dim[index - 1], NULL);
-                    break;
-                    case TYPE_INT32:
-                        commGetParamList(&comm_settings_t, device_id, index, aux_int32, data_size[index - 1], data_dim[index - 1], NULL);
-                    break;
-                    case TYPE_UINT32:
-                        commGetParamList(&comm_settings_t, device_id, index, aux_uint32, data_size[index - 1], data_dim[index - 1], NULL);
-                    break;
-                    case TYPE_FLOAT:
-                        commGetParamList(&comm_settings_t, device_id, index, aux_float, data_size[index - 1], data_dim[index - 1], NULL);
-                    break;
-                    case TYPE_DOUBLE:
-                        commGetParamList(&comm_settings_t, device_id, index, aux_double, data_size[index - 1], data_dim[index - 1], NULL);
-                    break;
-					case TYPE_STRING:			// custom data type
-                        commGetParamList(&comm_settings_t, device_id, index, aux_str, data_size[index - 1], data_dim[index - 1], NULL);
-                    break;
-                }
+            // The codec of the parameter type reads and packs the values
+            if (param_table_prompt(&table, &table.params[index - 1], new_values))
+                return 0;
+            param_table_write(&comm_settings_t, device_id, commGetParamList, &table.params[index - 1], new_values);
 
             usleep(100000);
             commStoreParams(&comm_settings_t, device_id);
@@ -744,6 +552,10 @@ int open_port() {
     char port[255];
     int br = baudrate_reader();
 
+    // qbadmind owns the port when it is running
+    if (qbclient_connect(&comm_settings_t))
+        return 1;
+
     file = fopen(QBMOVE_FILE, "r");
 
     if (file == NULL) {
@@ -47,6 +47,8 @@
 #include "../../qbAPI/src/qbmove_communications.h"
 #include "../../qbAPI/src/cp_communications.h"
 #include "definitions.h"
+#include "qbclient.h"
+#include "param_batch.h"
 
 #include <assert.h>
 #include <stdio.h>
@@ -67,6 +69,7 @@ int calibrate();
 char get_or_set;
 comm_settings comm_settings_t;
 uint8_t device_id = BROADCAST_ID;
+param_table table;
 
 /** Baudrate functions
  */
@@ -74,39 +77,18 @@ int baudrate_reader();
 
 // --- MAIN ---
 int main(int argc, char **argv) {
-    int i,j,k;
+    int i,k;
     char c_choice;
+    param_batch_args args;
 
-    uint8_t aux_string[5000] = "";
-
-    int value_size;
-    int num_of_values;
     int num_of_params;
-    int menu_number[50];
     int index;
-
-    int data_type[50];
-    int data_dim[50];
-    int data_size[50];
-    char data_string[20];
+    param_entry* p;
     char tmp_string[150] = "";
+    uint8_t new_values[PARAM_BYTE_SLOT];
 
-    int8_t aux_int8[4];
-    uint8_t aux_uint8[4];
-    int16_t aux_int16[4];
-    uint16_t aux_uint16[4];
-    int32_t aux_int32[4];
-    uint32_t aux_uint32[4];
-    float aux_float[4]; 
-    double aux_double[4];
-    uint8_t temp_char[4];
-
-
-
-
-
-
-
+	// -b, -d, -e and -i can be anywhere on the command line
+	param_batch_options(&argc, argv, &args);
 
 	// Get device ID
 	if (argc > 1)
@@ -127,6 +109,21 @@ int main(int argc, char **argv) {
         assert(open_port());
     }
 
+    // Scripted get or set, no menu
+    if (args.batch != NULL || args.dump != NULL || args.export_file != NULL || args.import_file != NULL) {
+        if (!param_table_read(&table, &comm_settings_t, device_id, commGetIMUParamList, 0)) {
+            printf("Couldn't read the parameters of the device\n");
+            return 1;
+        }
+        if (args.dump != NULL)
+            return param_batch_dump(&table, args.dump, -1) ? 1 : 0;
+        if (args.export_file != NULL)
+            return param_batch_export(&table, args.export_file, device_id) ? 1 : 0;
+
+        return param_batch_apply(args.batch != NULL ? args.batch : args.import_file, &table,
+                &comm_settings_t, device_id, commGetIMUParamList, args.import_file != NULL) ? 1 : 0;
+    }
+
 
 //===============================================================     MAIN MENU
 
@@ -156,159 +153,29 @@ int main(int argc, char **argv) {
         //==============================================================     SET
         printf("\nDevice parameters: \n");
 
-        // When commGetIMUParamList is called with index = 0, it will return in aux_string
-        // a packet containing the parameters' values and description
-        index = 0;
-        value_size = 0;
-        num_of_values = 0;
-        commGetIMUParamList(&comm_settings_t, device_id, index, NULL, value_size, num_of_values, aux_string);
-        
-
-        // The packet returned in aux_string is composed as follows
-        // [':'][':'][ID][LEN][CMD][PARAM_NUM][...]
-
-
-
-
-
-
-        num_of_params = aux_string[5];
-
-        // The data, for a single parameter, is packed as follows
-        // [DATA_TYPE][DATA_DIMENSION][..DATA..][..DESCRIPTION..] 
-        // Data_type is a enum that tells the parameter type (int, float, short int)
-        // Data_dimension is the number of values included in that parameter. For position pid is equal to 3. 
+        // When commGetIMUParamList is called with index = 0 it returns a packet
+        // containing the parameters' values and description, decoded in
+        // table by the codec of each parameter type
+        num_of_params = param_table_read(&table, &comm_settings_t, device_id, commGetIMUParamList, 0);
 
         for(i = 0; i < num_of_params; i++) {
-            data_type[i] = aux_string[i * PARAM_BYTE_SLOT + 6];
-            data_dim[i] = aux_string[i * PARAM_BYTE_SLOT + 7];
-            for(j = 0; j < 4; j++) {
-                aux_int8[j] = 0; aux_uint8[j] = 0; temp_char[j] = 0; aux_int16[j] = 0;
-                aux_uint16[j] = 0; aux_int32[j] = 0; aux_uint32[j] = 0; aux_float[j] = 0.0;
-                aux_double[j] = 0.0;
-            }
-
-            // For each parameter is associated a size, which is the number of bytes of that parameter, depending on its type
-            switch(data_type[i]){
-                case TYPE_FLAG:
-                    data_size[i] = 1;
-                    for(k = 0; k < data_dim[i]; k++) {
-                        for(j = 0; j < data_size[i]; j++) {
-                            aux_uint8[k] += aux_string[i*PARAM_BYTE_SLOT + 8 + k * data_size[i] + data_size[i] - j - 1] << (8 * j);  
-                        }
-                        /*sprintf(data_string, " %hhu", aux_uint8[k]);
-                        strcat(tmp_string, data_string);*/
-                    }
-                case TYPE_INT8:
-                    data_size[i] = 1;
-                    for(k = 0; k < data_dim[i]; k++) {
-                        for(j = 0; j < data_size[i]; j++) {
-                            aux_int8[k] += aux_string[i*PARAM_BYTE_SLOT + 8 + k * data_size[i] + data_size[i] - j - 1] << (8 * j);
-                        }
-                        sprintf(data_string, " %hhd", aux_int8[k]);
-                        strcat(tmp_string, data_string);
-                    }
-                break;
-                case TYPE_UINT8:
-                    data_size[i] = 1;
-                    for(k = 0; k < data_dim[i]; k++) {
-                        for(j = 0; j < data_size[i]; j++) {
-                            aux_uint8[k] += aux_string[i*PARAM_BYTE_SLOT + 8 + k * data_size[i] + data_size[i] - j - 1] << (8 * j);  
-                        }
-                        if (aux_uint8[k] == 255){ 	// Not IMU Connected
-                        	sprintf(data_string, " %c", '-');
-                        }
-                        else {
-                        	sprintf(data_string, " %hhu", aux_uint8[k]);
-                        }
-                        strcat(tmp_string, data_string); 
-                    }
-                break;
-                case TYPE_INT16:
-                    data_size[i] = 2;
-                    for(k = 0; k < data_dim[i]; k++) {
-                        for(j = 0; j < data_size[i]; j++) {
-                            aux_int16[k] += aux_string[i*PARAM_BYTE_SLOT + 8 + k * data_size[i] + data_size[i] - j - 1] << (8 * j);
-                        }
-                        sprintf(data_string, " %hd", aux_int16[k]);
-                        strcat(tmp_string, data_string); 
-                    }
-                break;
-                case TYPE_UINT16:
-                    data_size[i] = 2;
-                    for(k = 0; k < data_dim[i]; k++) {
-                        for(j = 0; j < data_size[i]; j++) {
-                            aux_uint16[k] += aux_string[i*PARAM_BYTE_SLOT + 8 + k * data_size[i] + data_size[i] - j - 1] << (8 * j);
-                        }
-                        sprintf(data_string, " %hu", aux_uint16[k]);
-                        strcat(tmp_string, data_string); 
-                    }
-                break;
-                case TYPE_INT32:
-                    data_size[i] = 4;
-                    for(k = 0; k < data_dim[i]; k++) {
-                        for(j = 0; j < data_size[i]; j++) {
-                            aux_int32[k] += aux_string[i*PARAM_BYTE_SLOT + 8 + k * data_size[i] + data_size[i] - j - 1] << (8 * j);
-                        }
-                        sprintf(data_string, " %d", aux_int32[k]);
-                        strcat(tmp_string, data_string); 
-                    }
-                break;
-                case TYPE_UINT32:
-                    data_size[i] = 4;
-                    for(k = 0; k < data_dim[i]; k++) {
-                        for(j = 0; j < data_size[i]; j++) {
-                            aux_uint32[k] += aux_string[i*PARAM_BYTE_SLOT + 8 + k * data_size[i] + data_size[i] - j - 1] << (8 * j);   
-                        }
-                        sprintf(data_string, " %u", aux_uint32[k]);
-                        strcat(tmp_string, data_string);
-                    }
-                break;
-                case TYPE_FLOAT:
-                    data_size[i] = 4;
-                    for(k = 0; k < data_dim[i]; k++) {
-                        for(j = 0; j < data_size[i]; j++) {
-                            temp_char[j] = aux_string[i*PARAM_BYTE_SLOT + 8 + k * data_size[i] + data_size[i] - j - 1];
-                        }
-                        aux_float[k] = (*(float *) &temp_char);
-                        sprintf(data_string, " %f", aux_float[k]);
-
-                        strcat(tmp_string, data_string);
-                    }
-                break;
-                case TYPE_DOUBLE:
-                    data_size[i] = 4;
-                    for(k = 0; k < data_dim[i]; k++) {
-                        for(j = 0; j < data_size[i]; j++) {
-                            temp_char[j] = aux_string[i*PARAM_BYTE_SLOT + 8 + k * data_size[i] + data_size[i] - j - 1];
-                        }
-                        aux_double[k] = (*(double *) &temp_char);
-                        sprintf(data_string, " %f", aux_double[k]);
-                        strcat(tmp_string, data_string);
-                    }
-                break;
-
-            }
-            // The parameter description is printed character by character until it reaches the end of the string
-            for(k = 0; aux_string[i * PARAM_BYTE_SLOT + 6 + data_size[i] * data_dim[i] + 2 + k] != '\0'; k++) {
-                printf("%c", aux_string[i * PARAM_BYTE_SLOT + 6 + data_size[i] * data_dim[i] + 2 + k]);
+            p = &table.params[i];
+            // 255 in a uint8 means the IMU is not connected
+            strcpy(tmp_string, "");
+            for(k = 0; k < p->dim && p->type == TYPE_UINT8; k++) {
+                if (param_table_value(p, k) == 255)
+                    strcat(tmp_string, " -");
+                else
+                    sprintf(tmp_string + strlen(tmp_string), " %.0f", param_table_value(p, k));
             }
-            
-            // If the parameter is a TYPE_FLAG it has a printable menu at the end of the packet. 
-            // Their order is written at the end of each parameter description
+            if (p->type != TYPE_UINT8)
+                param_table_display(p, tmp_string, sizeof(tmp_string));
 
-            if(data_type[i] == TYPE_FLAG)
-                menu_number[i] = aux_string[i * PARAM_BYTE_SLOT + 6 + data_size[i] * data_dim[i] + 2 + k + 1];
+            // TYPE_FLAG parameters have a menu instead of the values
+            if(p->type == TYPE_FLAG)
+                printf("%s\n", p->description);
             else
-                menu_number[i] = -1;
-            // If the parameter has associated a -1 to its menu_number, the parameter has not a menu.
-
-            if(data_type[i] == TYPE_FLAG)
-                printf("\n");
-            else
-                printf("%s\n", tmp_string);
-            
-            strcpy(tmp_string, "");
+                printf("%s%s\n", p->description, tmp_string);
         }
 
         if (get_or_set == 's') {
@@ -320,86 +187,9 @@ int main(int argc, char **argv) {
                 return 0;
             }
 
-            for(j = 0; j < 4; j++) {
-                    aux_int8[j] = 0; aux_uint8[j] = 0; aux_int16[j] = 0; aux_uint16[j] = 0;
-                    aux_int32[j] = 0; aux_uint32[j] = 0; aux_float[j] = 0.0; aux_double[j] = 0.0;
-            }
-            // Depending on the number of values of the parameter and its type
-            // different and/or multiple readings must be done
-            printf("Insert new parameters values\n");
-            for(i = 0; i < data_dim[index - 1]; i++) {
-                if(data_type[index - 1] != TYPE_FLAG) {
-                    printf("Insert %d° parameter: \n", i+1);
-                    switch(data_type[index - 1]) {
-                        case TYPE_INT8:
-                            scanf("%hhd", &aux_int8[i]);
-                        break;
-
-                        case TYPE_UINT8:
-                            scanf("%hhu", &aux_uint8[i]);
-                        break;
-
-                        case TYPE_INT16:
-                            scanf("%hd", &aux_int16[i]);
-                        break;
-
-                        case TYPE_UINT16:
-                            scanf("%hu", &aux_uint16[i]);
-                        break;
-
-                        case TYPE_INT32:
-                            scanf("%d", &aux_int32[i]);
-                        break;
-
-                        case TYPE_UINT32:
-                            scanf("%u", &aux_uint32[i]);
-                        break;
-
-                        case TYPE_FLOAT:
-                            scanf("%f", &aux_float[i]);
-                        break;
-
-                        case TYPE_DOUBLE:
-                            scanf("%lf", &aux_double[i]);
-                        break;
-                    }
-                }
-                else {      // TYPE_FLAG is a uint8 but with a menu
-                    for(k = 0; aux_string[num_of_params * PARAM_BYTE_SLOT + 6 + (menu_number[index - 1] - 1) * PARAM_MENU_SLOT + k] != '\0'; k++)
-                        printf("%c", aux_string[num_of_params * PARAM_BYTE_SLOT + 6 + (menu_number[index - 1] - 1) * PARAM_MENU_SLOT + k]);
-                    scanf("%hhu", aux_uint8);
-                }
-
-            }
-            switch(data_type[index - 1]) {
-                    case TYPE_FLAG:
-                        commGetIMUParamList(&comm_settings_t, device_id, index, aux_uint8, data_size[index - 1], data_dim[index - 1], NULL);
-                    break;
-                    case TYPE_INT8:
-                        commGetIMUParamList(&comm_settings_t, device_id, index, aux_int8, data_size[index - 1], data_dim[index - 1], NULL);
-                    break;
-                    case TYPE_UINT8:
-                        commGetIMUParamList(&comm_settings_t, device_id, index, aux_uint8, data_size[index - 1], data_dim[index - 1], NULL);
-                    break;
-                    case TYPE_INT16:
-                        commGetIMUParamList(&comm_settings_t, device_id, index, aux_int16, data_size[index - 1], data_dim[index - 1], NULL);
-                    break;
-                    case TYPE_UINT16:
-                        commGetIMUParamList(&comm_settings_t, device_id, index, aux_uint16, data_size[index - 1], data_dim[index - 1], NULL);
-                    break;
-                    case TYPE_INT32:
-                        commGetIMUParamList(&comm_settings_t, device_id, index, aux_int32, data_size[index - 1], data_dim[index - 1], NULL);
-                    break;
-                    case TYPE_UINT32:
-                        commGetIMUParamList(&comm_settings_t, device_id, index, aux_uint32, data_size[index - 1], data_dim[index - 1], NULL);
-                    break;
-                    case TYPE_FLOAT:
-                        commGetIMUParamList(&comm_settings_t, device_id, index, aux_float, data_size[index - 1], data_dim[index - 1], NULL);
-                    break;
-                    case TYPE_DOUBLE:
-                        commGetIMUParamList(&comm_settings_t, device_id, index, aux_double, data_size[index - 1], data_dim[index - 1], NULL);
-                    break;
-                }
+            if (param_table_prompt(&table, &table.params[index - 1], new_values))
+                return 0;
+            param_table_write(&comm_settings_t, device_id, commGetIMUParamList, &table.params[index - 1], new_values);
 
             usleep(100000);
             commStoreParams(&comm_settings_t, device_id);
@@ -472,6 +262,10 @@ int open_port() {
     char port[255];
     int br = baudrate_reader();
 
+    // qbadmind owns the port when it is running
+    if (qbclient_connect(&comm_settings_t))
+        return 1;
+
     file = fopen(QBMOVE_FILE, "r");
 
     if (file == NULL) {
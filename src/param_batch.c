@@ -0,0 +1,677 @@
+// ----------------------------------------------------------------------------
+// BSD 3-Clause License
+
+// Copyright (c) 2016, qbrobotics
+// Copyright (c) 2017-2024, Centro "E.Piaggio"
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// POSSIBILITY OF SUCH DAMAGE.
+// ----------------------------------------------------------------------------
+
+/**
+* \file         param_batch.c
+*
+* \brief        Scripted get and set of the parameters for the param tools
+* \author       _Centro "E.Piaggio"_
+* \copyright    (C) 2017-2024 Centro "E.Piaggio". All rights reserved.
+*/
+
+#include "param_batch.h"
+#include "definitions.h"
+#include "rt_sched.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define PARAM_BATCH_LINE_LEN    512
+
+typedef struct assignment {
+    param_entry* p;
+    int line;
+    int scoped;                             ///< Set in an [id ...] section
+    uint8_t values[PARAM_BYTE_SLOT];
+} assignment;
+
+static char* trim(char* s) {
+    char* end;
+
+    while (isspace((unsigned char) *s))
+        s++;
+    end = s + strlen(s);
+    while (end > s && isspace((unsigned char) end[-1]))
+        *--end = '\0';
+
+    return s;
+}
+
+//==============================================================================
+//                                                                       options
+//==============================================================================
+
+void param_batch_options(int* argc, char** argv, param_batch_args* args) {
+    int i, j, n;
+
+    memset(args, 0, sizeof(*args));
+
+    for (i = 1; i < *argc; i++) {
+        n = 0;
+        if ((!strcmp(argv[i], "-b") || !strcmp(argv[i], "--batch")) && i + 1 < *argc) {
+            args->batch = argv[i + 1];
+            n = 2;
+        }
+        else if ((!strcmp(argv[i], "-d") || !strcmp(argv[i], "--dump")) && i + 1 < *argc) {
+            args->dump = argv[i + 1];
+            n = 2;
+        }
+        else if ((!strcmp(argv[i], "-e") || !strcmp(argv[i], "--export")) && i + 1 < *argc) {
+            args->export_file = argv[i + 1];
+            n = 2;
+        }
+        else if ((!strcmp(argv[i], "-i") || !strcmp(argv[i], "--import")) && i + 1 < *argc) {
+            args->import_file = argv[i + 1];
+            n = 2;
+        }
+        else if ((!strcmp(argv[i], "-f") || !strcmp(argv[i], "--fleet")) && i + 1 < *argc) {
+            args->fleet = argv[i + 1];
+            n = 2;
+        }
+        else if (!strcmp(argv[i], "--devices") && i + 1 < *argc) {
+            args->devices = argv[i + 1];
+            n = 2;
+        }
+
+        if (n) {
+            for (j = i; j + n < *argc; j++)
+                argv[j] = argv[j + n];
+            *argc -= n;
+            i--;
+        }
+    }
+}
+
+//==============================================================================
+//                                                                         apply
+//==============================================================================
+
+// "float[3]" of a snapshot must match the parameter on the board
+static int check_type(const param_entry* p, const char* spec, char* error) {
+    char name[20];
+    int dim;
+
+    if (sscanf(spec, " %19[a-zA-Z0-9] [ %d ]", name, &dim) != 2 || param_table_type(name) < 0) {
+        sprintf(error, "bad type '%s'", spec);
+        return -1;
+    }
+    if (param_table_type(name) != p->type || dim != p->dim) {
+        sprintf(error, "%s[%d] in the file, %s[%d] on the board", name, dim,
+                param_table_type_name(p->type), p->dim);
+        return -1;
+    }
+
+    return 0;
+}
+
+// "[id 3 4]" starts the overrides of those devices, "[all]" goes back to
+// the lines of every device. Returns -1 if the header is not valid.
+static int section_header(const char* line, int id, int* scoped, int* in_scope) {
+    const char* s = line + 1;
+    char* end;
+    long v;
+
+    if (!strncasecmp(s, "all]", 4) && s[4] == '\0') {
+        *scoped = 0;
+        *in_scope = 1;
+        return 0;
+    }
+    if (strncasecmp(s, "id", 2) || !isspace((unsigned char) s[2]))
+        return -1;
+
+    *scoped = 1;
+    *in_scope = 0;
+    for (s += 2; ; s = end) {
+        while (isspace((unsigned char) *s) || *s == ',')
+            s++;
+        if (*s == ']')
+            return s[1] == '\0' ? 0 : -1;
+        v = strtol(s, &end, 10);
+        if (end == s || v < 0 || v > 255)
+            return -1;
+        if (v == id)
+            *in_scope = 1;
+    }
+}
+
+// Assignments of file for device id, checked against its table. The
+// errors are printed after prefix. Returns their number. todo holds
+// PARAM_TABLE_MAX_PARAMS + 1 entries, one per parameter at most plus the
+// one being parsed.
+static int parse(const char* file, const char* prefix, param_table* t, int id,
+        assignment* todo, int* num_todo) {
+    char line[PARAM_BATCH_LINE_LEN];
+    char error[100];
+    char* key;
+    char* value;
+    char* type;
+    char* hash;
+    FILE* in;
+    assignment* a;
+    int num_errors = 0;
+    int line_number = 0;
+    int scoped = 0;
+    int in_scope = 1;
+    int i;
+
+    *num_todo = 0;
+
+    in = fopen(file, "r");
+    if (in == NULL) {
+        printf("%sError opening file %s\n", prefix, file);
+        return 1;
+    }
+
+    while (fgets(line, sizeof(line), in) != NULL) {
+        line_number++;
+
+        hash = strchr(line, '#');
+        if (hash != NULL)
+            *hash = '\0';
+        key = trim(line);
+        if (*key == '\0')
+            continue;
+
+        if (*key == '[') {
+            if (section_header(key, id, &scoped, &in_scope)) {
+                printf("%s%s:%d: expected [id N ...] or [all]\n", prefix, file, line_number);
+                num_errors++;
+            }
+            continue;
+        }
+        if (!in_scope)
+            continue;
+
+        value = strchr(key, '=');
+        if (value == NULL) {
+            printf("%s%s:%d: expected section.param = values\n", prefix, file, line_number);
+            num_errors++;
+            continue;
+        }
+        *value++ = '\0';
+        value = trim(value);
+
+        // section.param : type[dim], the type is optional
+        type = strchr(key, ':');
+        if (type != NULL)
+            *type++ = '\0';
+        key = trim(key);
+
+        a = &todo[*num_todo];
+        a->p = param_table_find(t, key);
+        if (a->p == NULL) {
+            printf("%s%s:%d: no parameter %s\n", prefix, file, line_number, key);
+            num_errors++;
+            continue;
+        }
+
+        // the overrides of a device replace the lines of every device
+        for (i = 0; i < *num_todo && todo[i].p != a->p; i++)
+            ;
+        if (i < *num_todo) {
+            if (todo[i].scoped || !scoped) {
+                printf("%s%s:%d: %s already set at line %d\n", prefix, file, line_number, key, todo[i].line);
+                num_errors++;
+                continue;
+            }
+            a = &todo[i];
+        }
+
+        if ((type != NULL && check_type(a->p, type, error)) || param_table_parse(a->p, value, a->values, error)) {
+            printf("%s%s:%d: %s: %s\n", prefix, file, line_number, key, error);
+            num_errors++;
+            continue;
+        }
+
+        a->line = line_number;
+        a->scoped = scoped;
+        if (a == &todo[*num_todo])
+            (*num_todo)++;
+    }
+    fclose(in);
+
+    return num_errors;
+}
+
+int param_batch_apply(const char* file, param_table* t, comm_settings* cs, int id, param_list_fn list,
+        int only_changed) {
+    assignment todo[PARAM_TABLE_MAX_PARAMS + 1];
+    int64_t start;
+    int num_todo;
+    int num_errors;
+    int num_failed = 0;
+    int num_written = 0;
+    int i;
+
+    // Check everything before touching the board
+    num_errors = parse(file, "", t, id, todo, &num_todo);
+    if (num_errors) {
+        printf("%d errors, no parameter written\n", num_errors);
+        return -1;
+    }
+    if (!num_todo) {
+        printf("No parameter in %s\n", file);
+        return 0;
+    }
+
+    start = rt_sched_now_us();
+
+    for (i = 0; i < num_todo; i++) {
+        if (only_changed && !param_table_changed(todo[i].p, todo[i].values))
+            continue;
+
+        num_written++;
+        if (param_table_write(cs, id, list, todo[i].p, todo[i].values) < 0) {
+            printf("%-40s FAILED\n", todo[i].p->key);
+            num_failed++;
+        }
+        else {
+            printf("%-40s OK\n", todo[i].p->key);
+        }
+    }
+
+    // Nothing to store, the flash is not touched
+    if (!num_written) {
+        printf("%d parameters, all unchanged, nothing written\n", num_todo);
+        return 0;
+    }
+
+    // Stored once for the whole file
+    usleep(100000);
+    if (commStoreParams(cs, id) < 0) {
+        printf("Store FAILED\n");
+        num_failed++;
+    }
+    usleep(100000);
+
+    printf("%d parameters written, %d failed, %d unchanged, %.1f ms\n", num_written - num_failed,
+            num_failed, num_todo - num_written, (rt_sched_now_us() - start) / 1000.0);
+
+    return num_failed ? -1 : 0;
+}
+
+//==============================================================================
+//                                                              single parameter
+//==============================================================================
+
+int param_batch_get(param_table* t, const char* key) {
+    char values[256];
+    param_entry* p = param_table_find(t, key);
+
+    if (p == NULL) {
+        printf("Unknown parameter %s, the dump (-d -) lists them\n", key);
+        return -1;
+    }
+
+    param_table_format(p, values, sizeof(values));
+    printf("%s = %s\n", p->key, values);
+
+    return 0;
+}
+
+int param_batch_set(param_table* t, comm_settings* cs, int id, param_list_fn list, const char* key,
+        const char* text) {
+    uint8_t values[PARAM_BYTE_SLOT];
+    char old_values[256];
+    char new_values[256];
+    char error[100];
+    param_entry* p = param_table_find(t, key);
+    int64_t start;
+
+    if (p == NULL) {
+        printf("Unknown parameter %s, the dump (-d -) lists them\n", key);
+        return -1;
+    }
+    if (param_table_parse(p, text, values, error)) {
+        printf("%s: %s, nothing written\n", p->key, error);
+        return -1;
+    }
+
+    start = rt_sched_now_us();
+
+    // One write by the wire index of the parameter, then the store
+    if (param_table_write(cs, id, list, p, values) < 0) {
+        printf("%-40s FAILED\n", p->key);
+        return -1;
+    }
+    usleep(100000);
+    if (commStoreParams(cs, id) < 0) {
+        printf("Store FAILED\n");
+        return -1;
+    }
+    usleep(100000);
+
+    param_table_format(p, old_values, sizeof(old_values));
+    param_table_update(p, values);
+    param_table_format(p, new_values, sizeof(new_values));
+    printf("%s = %s (was %s), %.1f ms\n", p->key, new_values, old_values, (rt_sched_now_us() - start) / 1000.0);
+
+    return 0;
+}
+
+//==============================================================================
+//                                                                dump and export
+//==============================================================================
+
+// Table as assignments, by section and position as the tools list them.
+// A snapshot (id not negative) has a header and the type of every parameter.
+static int save(const param_table* t, const char* file, int section, int id) {
+    const param_entry* order[PARAM_TABLE_MAX_PARAMS];
+    const param_entry* p;
+    char values[PARAM_BATCH_LINE_LEN];
+    char date[64];
+    FILE* out = stdout;
+    time_t now;
+    int i, j;
+
+    if (strcmp(file, "-")) {
+        out = fopen(file, "w");
+        if (out == NULL) {
+            printf("Error opening file %s\n", file);
+            return -1;
+        }
+    }
+
+    for (i = 0; i < t->num_params; i++) {
+        p = &t->params[i];
+        for (j = i; j > 0 && (order[j - 1]->section > p->section ||
+                (order[j - 1]->section == p->section && order[j - 1]->number > p->number)); j--)
+            order[j] = order[j - 1];
+        order[j] = p;
+    }
+
+    if (id >= 0) {
+        now = time(NULL);
+        strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", localtime(&now));
+        fprintf(out, "# Parameter snapshot of device %d, %s\n", id, date);
+        if (t->firmware[0] != '\0')
+            fprintf(out, "# %s\n", t->firmware);
+    }
+
+    for (i = 0; i < t->num_params; i++) {
+        p = order[i];
+        if (section >= 0 && (p->section / 10) * 10 != section)
+            continue;
+
+        param_table_format(p, values, sizeof(values));
+        if (id >= 0)
+            fprintf(out, "%s : %s[%d] = %s", p->key, param_table_type_name(p->type), p->dim, values);
+        else
+            fprintf(out, "%s = %s", p->key, values);
+        if (p->name[0] != '\0')
+            fprintf(out, "\t# %s", p->name);
+        fprintf(out, "\n");
+    }
+
+    if (out != stdout && fclose(out)) {
+        printf("Error writing file %s\n", file);
+        return -1;
+    }
+
+    return 0;
+}
+
+int param_batch_dump(const param_table* t, const char* file, int section) {
+    return save(t, file, section, -1);
+}
+
+int param_batch_export(const param_table* t, const char* file, int id) {
+    if (save(t, file, -1, id))
+        return -1;
+
+    if (strcmp(file, "-"))
+        printf("%d parameters saved in %s\n", t->num_params, file);
+
+    return 0;
+}
+
+//==============================================================================
+//                                                                         fleet
+//==============================================================================
+
+typedef struct fleet_device {
+    int id;
+    int answered;
+    param_table table;
+    assignment todo[PARAM_TABLE_MAX_PARAMS + 1];
+    int result[PARAM_TABLE_MAX_PARAMS];     ///< 1 written, -1 failed, 0 unchanged
+    int num_todo;
+    int num_written;
+    int num_failed;
+    int stored;                             ///< 1 stored, -1 store failed, 0 nothing to store
+    int64_t last_write;
+    int64_t bus_time;                       ///< Time of its own requests [us]
+} fleet_device;
+
+int param_batch_devices(const char* spec, comm_settings* cs, int* ids) {
+    char list[255];
+    char line[PARAM_BATCH_LINE_LEN];
+    const char* s;
+    char* end;
+    FILE* in;
+    long v;
+    int num = 0;
+    int i, j, k;
+
+    if (spec == NULL) {
+        // Discovery on the bus
+        num = RS485ListDevices(cs, list);
+        for (i = 0, j = 0; i < num; i++) {
+            if ((uint8_t) list[i] != BROADCAST_ID)
+                ids[j++] = (uint8_t) list[i];
+        }
+        return j;
+    }
+
+    if (strspn(spec, "0123456789, ") == strlen(spec)) {
+        for (s = spec; *s != '\0'; s = end) {
+            while (*s == ',' || *s == ' ')
+                s++;
+            if (*s == '\0')
+                break;
+            v = strtol(s, &end, 10);
+            if (v > BROADCAST_ID && v < 256 && num < 255)
+                ids[num++] = (int) v;
+        }
+    }
+    else {
+        // One ID per line, the "device ID ..." lines of qbinventory.conf too
+        in = fopen(spec, "r");
+        if (in == NULL) {
+            printf("Error opening file %s\n", spec);
+            return 0;
+        }
+        while (fgets(line, sizeof(line), in) != NULL && num < 255) {
+            s = trim(line);
+            if (!strncmp(s, "device ", 7))
+                s += 7;
+            v = strtol(s, &end, 10);
+            if (end != s && v > BROADCAST_ID && v < 256)
+                ids[num++] = (int) v;
+        }
+        fclose(in);
+    }
+
+    // Each device once, in the order given
+    for (i = 0, j = 0; i < num; i++) {
+        for (k = 0; k < j && ids[k] != ids[i]; k++)
+            ;
+        if (k == j)
+            ids[j++] = ids[i];
+    }
+
+    return j;
+}
+
+static void fleet_report(fleet_device* devices, int num, int64_t elapsed) {
+    fleet_device* d;
+    param_entry after;
+    char old_values[PARAM_BATCH_LINE_LEN];
+    char new_values[PARAM_BATCH_LINE_LEN];
+    int i, k;
+
+    printf("\n%6s %8s %10s %7s %7s %10s\n", "device", "changed", "unchanged", "failed", "stored", "bus [ms]");
+    for (i = 0; i < num; i++) {
+        d = &devices[i];
+        if (!d->answered) {
+            printf("%6d %8s %10s %7s %7s %10.1f\n", d->id, "-", "-", "-", "no", d->bus_time / 1000.0);
+            continue;
+        }
+        printf("%6d %8d %10d %7d %7s %10.1f\n", d->id, d->num_written - d->num_failed,
+                d->num_todo - d->num_written, d->num_failed,
+                d->stored > 0 ? "yes" : (d->stored < 0 ? "FAILED" : "-"), d->bus_time / 1000.0);
+    }
+
+    for (i = 0; i < num; i++) {
+        d = &devices[i];
+        if (!d->num_written)
+            continue;
+
+        printf("\nDevice %d\n", d->id);
+        for (k = 0; k < d->num_todo; k++) {
+            if (!d->result[k])
+                continue;
+            after = *d->todo[k].p;
+            param_table_update(&after, d->todo[k].values);
+            param_table_format(d->todo[k].p, old_values, sizeof(old_values));
+            param_table_format(&after, new_values, sizeof(new_values));
+            printf("  %-40s %s -> %s%s\n", after.key, old_values, new_values,
+                    d->result[k] < 0 ? "  FAILED" : "");
+        }
+    }
+
+    printf("\n%d devices in %.1f ms\n", num, elapsed / 1000.0);
+}
+
+int param_batch_fleet(const char* profile, const int* ids, int num, comm_settings* cs,
+        param_list_fn list, int sections) {
+    fleet_device* devices;
+    fleet_device* d;
+    char prefix[32];
+    int64_t start, t0;
+    int num_errors = 0;
+    int num_bad = 0;
+    int num_stored = 0;
+    int i, k;
+
+    if (num <= 0) {
+        printf("No device to provision\n");
+        return -1;
+    }
+
+    devices = (fleet_device*) calloc(num, sizeof(fleet_device));
+    if (devices == NULL)
+        return -1;
+
+    start = rt_sched_now_us();
+
+    // Tables of all the devices and the profile checked against each of them
+    for (i = 0; i < num; i++) {
+        d = &devices[i];
+        d->id = ids[i];
+
+        t0 = rt_sched_now_us();
+        d->answered = param_table_read(&d->table, cs, d->id, list, sections) > 0;
+        d->bus_time += rt_sched_now_us() - t0;
+        if (!d->answered) {
+            printf("Device %d: no parameters\n", d->id);
+            num_bad++;
+            continue;
+        }
+
+        sprintf(prefix, "Device %d: ", d->id);
+        num_errors += parse(profile, prefix, &d->table, d->id, d->todo, &d->num_todo);
+    }
+
+    if (num_errors) {
+        printf("%d errors, no parameter written\n", num_errors);
+        free(devices);
+        return -1;
+    }
+
+    // Only the differences, device after device
+    for (i = 0; i < num; i++) {
+        d = &devices[i];
+        for (k = 0; d->answered && k < d->num_todo; k++) {
+            if (!param_table_changed(d->todo[k].p, d->todo[k].values))
+                continue;
+
+            t0 = rt_sched_now_us();
+            d->result[k] = param_table_write(cs, d->id, list, d->todo[k].p, d->todo[k].values) < 0 ? -1 : 1;
+            d->last_write = rt_sched_now_us();
+            d->bus_time += d->last_write - t0;
+            d->num_written++;
+            if (d->result[k] < 0)
+                d->num_failed++;
+        }
+    }
+
+    // Each board spends its 100 ms pause before the store while the
+    // others are written. The stores themselves go one after the other,
+    // commStoreParams waits for the acknowledge of each board.
+    for (i = 0; i < num; i++) {
+        d = &devices[i];
+
+        // every write failed, nothing to store but the device got nothing
+        if (d->num_failed && d->num_written == d->num_failed)
+            num_bad++;
+        if (d->num_written == d->num_failed)
+            continue;
+
+        t0 = rt_sched_now_us();
+        if (t0 - d->last_write < 100000)
+            usleep(100000 - (t0 - d->last_write));
+
+        t0 = rt_sched_now_us();
+        d->stored = commStoreParams(cs, d->id) < 0 ? -1 : 1;
+        d->bus_time += rt_sched_now_us() - t0;
+        if (d->stored < 0 || d->num_failed)
+            num_bad++;
+        num_stored++;
+    }
+    if (num_stored)
+        usleep(100000);
+
+    fleet_report(devices, num, rt_sched_now_us() - start);
+
+    free(devices);
+
+    return num_bad ? -1 : 0;
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,142 @@
+// ----------------------------------------------------------------------------
+// BSD 3-Clause License
+
+// Copyright (c) 2016, qbrobotics
+// Copyright (c) 2017-2024, Centro "E.Piaggio"
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// POSSIBILITY OF SUCH DAMAGE.
+// ----------------------------------------------------------------------------
+
+/**
+* \file         param_batch.h
+*
+* \brief        Scripted get and set of the parameters for the param tools
+* \author       _Centro "E.Piaggio"_
+* \copyright    (C) 2017-2024 Centro "E.Piaggio". All rights reserved.
+*
+* \details      A batch file holds one assignment per line:
+*
+*                   # comments and empty lines are skipped
+*                   mot1.position_pid = 0.1, 0.001, 0
+*                   mot1.current_limit = 1500
+*                   dev.3 = 1
+*
+*               Keys are described in param_table.h. The dump prints the
+*               table in the same format, so its output can be edited and
+*               applied again.
+*
+*               A snapshot (--export) saves every section with the type of
+*               each parameter, "mot1.current_limit : int16[1] = 1500". The
+*               import checks the types against the board, e.g. after a
+*               firmware update, then writes only the parameters whose value
+*               differs: unchanged boards are not written nor stored at all.
+*
+*               Lines after "[id 3 4]" are only for those devices and
+*               override the lines for every device, "[all]" goes back to
+*               these. With --fleet one profile provisions many devices:
+*               the writes of all the devices go first, then the stores, so
+*               the 100 ms pause each board needs before its store overlaps
+*               the writes of the others. The stores are serialized, each
+*               one waits for the acknowledge of its board.
+*
+*               A single parameter can be read or written by its key as
+*               well, from the list just read from the board.
+*
+*               Every line is checked against the decoded table (key, number
+*               of values, type and range) before anything is written: a
+*               file with errors leaves the board untouched. Then each
+*               parameter is written and commStoreParams is sent once at the
+*               end.
+*/
+
+#ifndef PARAM_BATCH_H_INCLUDED
+#define PARAM_BATCH_H_INCLUDED
+
+#include "param_table.h"
+
+/** Options of the param tools for the scripted use
+ */
+typedef struct param_batch_args {
+    const char* batch;                      ///< -b, --batch <file>: apply the assignments of file
+    const char* dump;                       ///< -d, --dump <file>: save the parameters, "-" for stdout
+    const char* export_file;                ///< -e, --export <file>: save a snapshot of all the parameters
+    const char* import_file;                ///< -i, --import <file>: restore a snapshot, writing only the differences
+    const char* fleet;                      ///< -f, --fleet <profile>: provision several devices
+    const char* devices;                    ///< --devices <list|file>: devices of the fleet, discovered if NULL
+} param_batch_args;
+
+/** Take the options out of argv, wherever they are, and leave the
+ *  positional arguments in place
+ */
+void param_batch_options(int* argc, char** argv, param_batch_args* args);
+
+/** Apply the assignments of file to device id, only those that change the
+ *  value if only_changed. Returns 0 if all were written and stored, -1
+ *  otherwise.
+ */
+int param_batch_apply(const char* file, param_table* t, comm_settings* cs, int id, param_list_fn list,
+        int only_changed);
+
+/** Print the values of the parameter of key, as the dump does. Returns 0
+ *  on success, -1 if there is no such parameter.
+ */
+int param_batch_get(param_table* t, const char* key);
+
+/** Write text (values separated by spaces or commas) to the parameter of
+ *  key and store it, printing the previous values. Returns 0 on success.
+ */
+int param_batch_set(param_table* t, comm_settings* cs, int id, param_list_fn list, const char* key,
+        const char* text);
+
+/** Save the table as assignments in file ("-" for stdout), only section
+ *  (an ST_* value) if it is not negative. Returns 0 on success.
+ */
+int param_batch_dump(const param_table* t, const char* file, int section);
+
+/** Save a snapshot of the whole table of device id in file ("-" for
+ *  stdout). Returns 0 on success.
+ */
+int param_batch_export(const param_table* t, const char* file, int id);
+
+/** IDs of the devices to provision: discovered on the bus if spec is NULL,
+ *  otherwise a list like "1,2,5" or a file with one ID per line (the
+ *  "device ID ..." lines of qbinventory.conf work as well). ids holds 255
+ *  IDs. Returns their number.
+ */
+int param_batch_devices(const char* spec, comm_settings* cs, int* ids);
+
+/** Apply profile to the num devices of ids: read every table, check the
+ *  profile against each of them, write the differences of all the
+ *  devices, then store them one after the other. Prints a report of each
+ *  device. Returns 0 if every device was written and stored.
+ */
+int param_batch_fleet(const char* profile, const int* ids, int num, comm_settings* cs,
+        param_list_fn list, int sections);
+
+#endif
+/* [] END OF FILE */
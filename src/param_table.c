@@ -0,0 +1,606 @@
+// ----------------------------------------------------------------------------
+// BSD 3-Clause License
+
+// Copyright (c) 2016, qbrobotics
+// Copyright (c) 2017-2024, Centro "E.Piaggio"
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// POSSIBILITY OF SUCH DAMAGE.
+// ----------------------------------------------------------------------------
+
+/**
+* \file         param_table.c
+*
+* \brief        Decoded parameter table of the NMMI boards
+* \author       _Centro "E.Piaggio"_
+* \copyright    (C) 2017-2024 Centro "E.Piaggio". All rights reserved.
+*/
+
+#include "param_table.h"
+#include "definitions.h"
+#include "../../qbAPI/src/commands.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PARAM_INFO_LEN          5000
+
+//==============================================================================
+//                                                                         codec
+//==============================================================================
+
+// One entry for each TYPE_*, in the order of the enum. Every operation on
+// the values goes through this table instead of a switch on the type.
+static const struct param_codec {
+    const char* name;
+    int size;                               ///< Bytes of a value on the wire
+    int is_signed;
+    int is_float;
+    long long min;
+    long long max;
+} codecs[] = {
+    { "flag",   1, 0, 0, 0,         UINT8_MAX  },
+    { "int8",   1, 1, 0, INT8_MIN,  INT8_MAX   },
+    { "uint8",  1, 0, 0, 0,         UINT8_MAX  },
+    { "int16",  2, 1, 0, INT16_MIN, INT16_MAX  },
+    { "uint16", 2, 0, 0, 0,         UINT16_MAX },
+    { "int32",  4, 1, 0, INT32_MIN, INT32_MAX  },
+    { "uint32", 4, 0, 0, 0,         UINT32_MAX },
+    { "float",  4, 1, 1, 0,         0          },
+    { "double", 4, 1, 1, 0,         0          },   // 4 bytes on the boards as well
+    { "string", 1, 0, 0, 0,         UINT8_MAX  },
+};
+
+#define NUM_CODECS  ((int)(sizeof(codecs) / sizeof(codecs[0])))
+
+// Unknown types are read as bytes
+static const struct param_codec* codec(int type) {
+    return (type >= 0 && type < NUM_CODECS) ? &codecs[type] : &codecs[TYPE_UINT8];
+}
+
+const char* param_table_type_name(int type) {
+    return (type >= 0 && type < NUM_CODECS) ? codecs[type].name : "unknown";
+}
+
+int param_table_type(const char* name) {
+    int i;
+
+    for (i = 0; i < NUM_CODECS; i++) {
+        if (!strcasecmp(codecs[i].name, name))
+            return i;
+    }
+
+    return -1;
+}
+
+// Value k as on the wire, big endian
+static uint32_t wire_value(const param_entry* p, int k) {
+    uint32_t v = 0;
+    int j;
+
+    for (j = 0; j < p->size; j++)
+        v = (v << 8) | p->data[k * p->size + j];
+
+    return v;
+}
+
+// Value k as param_table_parse fills them, native order
+static uint32_t native_value(const void* values, int size, int k) {
+    uint32_t v;
+    uint16_t v16;
+    uint8_t v8;
+
+    switch (size) {
+        case 1:
+            memcpy(&v8, (const uint8_t*) values + k, 1);
+            return v8;
+        case 2:
+            memcpy(&v16, (const uint8_t*) values + 2 * k, 2);
+            return v16;
+        default:
+            memcpy(&v, (const uint8_t*) values + 4 * k, 4);
+            return v;
+    }
+}
+
+static void set_native_value(void* values, int size, int k, uint32_t v) {
+    uint16_t v16 = (uint16_t) v;
+    uint8_t v8 = (uint8_t) v;
+
+    switch (size) {
+        case 1:
+            memcpy((uint8_t*) values + k, &v8, 1);
+            break;
+        case 2:
+            memcpy((uint8_t*) values + 2 * k, &v16, 2);
+            break;
+        default:
+            memcpy((uint8_t*) values + 4 * k, &v, 4);
+            break;
+    }
+}
+
+// Integer of the size bytes of v, sign extended if the type is signed
+static long long integer(const struct param_codec* c, uint32_t v) {
+    int shift = 32 - 8 * c->size;
+
+    if (c->is_signed)
+        return (int32_t)(v << shift) >> shift;
+
+    return v;
+}
+
+static float real(uint32_t v) {
+    float f;
+
+    memcpy(&f, &v, sizeof(f));
+
+    return f;
+}
+
+double param_table_value(const param_entry* p, int k) {
+    const struct param_codec* c = codec(p->type);
+
+    if (k < 0 || k >= p->dim)
+        return 0;
+
+    return c->is_float ? real(wire_value(p, k)) : integer(c, wire_value(p, k));
+}
+
+// Values separated by spaces, each preceded by one as the tools print them.
+// exact prints the floats with the digits needed to read them back unchanged.
+static void format(const param_entry* p, char* out, size_t size, int exact) {
+    const struct param_codec* c = codec(p->type);
+    size_t len = 0;
+    float f;
+    int k, digits;
+
+    out[0] = '\0';
+
+    if (p->type == TYPE_STRING) {
+        strcpy(out, " ");
+        for (k = 0, len = 1; k < p->dim && p->data[k] != '\0' && len < size - 1; k++)
+            out[len++] = p->data[k];
+        out[len] = '\0';
+        return;
+    }
+
+    for (k = 0; k < p->dim && len < size; k++) {
+        if (!c->is_float) {
+            len += snprintf(out + len, size - len, " %lld", integer(c, wire_value(p, k)));
+            continue;
+        }
+
+        f = real(wire_value(p, k));
+        for (digits = 6; exact && digits < 9; digits++) {
+            snprintf(out + len, size - len, " %.*g", digits, f);
+            if (strtof(out + len, NULL) == f)
+                break;
+        }
+        if (exact)
+            len += snprintf(out + len, size - len, " %.*g", digits, f);
+        else
+            len += snprintf(out + len, size - len, " %f", f);
+    }
+}
+
+void param_table_display(const param_entry* p, char* out, size_t size) {
+    format(p, out, size, 0);
+}
+
+void param_table_format(const param_entry* p, char* out, size_t size) {
+    format(p, out, size, 1);
+    if (out[0] == ' ')
+        memmove(out, out + 1, strlen(out));
+}
+
+int param_table_parse(const param_entry* p, const char* text, void* values, char* error) {
+    const struct param_codec* c = codec(p->type);
+    char buf[256];
+    char* token;
+    char* end;
+    long long v;
+    double d;
+    float f;
+    uint32_t u;
+    int k, n;
+
+    memset(values, 0, PARAM_BYTE_SLOT);
+
+    while (isspace((unsigned char) *text))
+        text++;
+
+    // the whole text, trailing spaces aside
+    if (p->type == TYPE_STRING) {
+        n = strlen(text);
+        while (n > 0 && isspace((unsigned char) text[n - 1]))
+            n--;
+        if (n > p->dim) {
+            sprintf(error, "string longer than %d characters", p->dim);
+            return -1;
+        }
+        memcpy(values, text, n);
+        return 0;
+    }
+
+    strncpy(buf, text, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+
+    k = 0;
+    for (token = strtok(buf, " \t,;\r\n"); token != NULL; token = strtok(NULL, " \t,;\r\n")) {
+        if (k == p->dim) {
+            sprintf(error, "more than %d values", p->dim);
+            return -1;
+        }
+
+        errno = 0;
+        if (c->is_float) {
+            d = strtod(token, &end);
+            if (end == token || *end != '\0' || errno) {
+                sprintf(error, "'%s' is not a number", token);
+                return -1;
+            }
+            f = (float) d;
+            memcpy(&u, &f, sizeof(u));
+        }
+        else {
+            v = strtoll(token, &end, 0);
+            if (end == token || *end != '\0' || errno) {
+                sprintf(error, "'%s' is not an integer", token);
+                return -1;
+            }
+            if (v < c->min || v > c->max) {
+                sprintf(error, "%s out of range", token);
+                return -1;
+            }
+            u = (uint32_t) v;
+        }
+        set_native_value(values, c->size, k++, u);
+    }
+
+    if (k != p->dim) {
+        sprintf(error, "%d values, %d expected", k, p->dim);
+        return -1;
+    }
+
+    return 0;
+}
+
+void param_table_update(param_entry* p, const void* values) {
+    uint32_t v;
+    int k, j;
+
+    for (k = 0; k < p->dim; k++) {
+        v = native_value(values, p->size, k);
+        for (j = p->size - 1; j >= 0; j--, v >>= 8)
+            p->data[k * p->size + j] = (uint8_t) v;
+    }
+}
+
+int param_table_changed(const param_entry* p, const void* values) {
+    int k;
+
+    for (k = 0; k < p->dim; k++) {
+        if (native_value(values, p->size, k) != wire_value(p, k))
+            return 1;
+    }
+
+    return 0;
+}
+
+//==============================================================================
+//                                                                      decoding
+//==============================================================================
+
+// Short names of the sections, as nmmi_param takes them on the command line
+static const struct {
+    int section;
+    const char* name;
+    int first;                              ///< Number of the first instance, -1 if there is only one
+} section_names[] = {
+    { ST_DEVICE,    "dev",  -1 },
+    { ST_MOTOR,     "mot",   1 },
+    { ST_ENCODER,   "enc",   0 },
+    { ST_EMG,       "emg",  -1 },
+    { ST_IMU,       "imu",  -1 },
+    { ST_EXPANSION, "exp",  -1 },
+    { ST_USER,      "usr",   0 },
+    { ST_SH_SPEC,   "sh",   -1 },
+    { ST_MS_SPEC,   "ms",   -1 },
+    { ST_FB_SPEC,   "fb",   -1 },
+    { ST_WR_SPEC,   "wr",   -1 },
+    { ST_JOY_SPEC,  "joy",  -1 },
+};
+
+void param_table_section_key(int section, char* key) {
+    int base = (section / 10) * 10;
+    size_t i;
+
+    for (i = 0; i < sizeof(section_names) / sizeof(section_names[0]); i++) {
+        if (section_names[i].section != base)
+            continue;
+        if (section_names[i].first < 0)
+            strcpy(key, section_names[i].name);
+        else
+            sprintf(key, "%s%d", section_names[i].name, section - base + section_names[i].first);
+        return;
+    }
+    sprintf(key, "s%d", section);
+}
+
+// "Position PID [P, I, D]" -> "position_pid"
+static void slug(const char* name, char* out, size_t len) {
+    size_t n = 0;
+
+    for (; *name != '\0' && *name != '[' && *name != '(' && *name != ':' && n < len - 1; name++) {
+        if (isalnum((unsigned char) *name))
+            out[n++] = tolower((unsigned char) *name);
+        else if (n > 0 && out[n - 1] != '_')
+            out[n++] = '_';
+    }
+    while (n > 0 && out[n - 1] == '_')
+        n--;
+    out[n] = '\0';
+}
+
+static void make_keys(param_table* t) {
+    char section[20] = "";
+    char name[PARAM_TABLE_KEY_LEN - 20];
+    char other[PARAM_TABLE_KEY_LEN - 20];
+    param_entry* p;
+    int i, j, unique;
+
+    for (i = 0; i < t->num_params; i++) {
+        p = &t->params[i];
+
+        // numbered as the tools list them, by struct and then by index
+        p->number = 1;
+        for (j = 0; j < t->num_params; j++) {
+            if (t->params[j].section == p->section && t->params[j].index < p->index)
+                p->number++;
+        }
+
+        slug(p->name, name, sizeof(name));
+        unique = name[0] != '\0' && !isdigit((unsigned char) name[0]);
+        for (j = 0; j < t->num_params && unique; j++) {
+            if (j == i || t->params[j].section != p->section)
+                continue;
+            slug(t->params[j].name, other, sizeof(other));
+            unique = strcmp(name, other) != 0;
+        }
+        if (!unique)
+            sprintf(name, "%d", p->number);
+
+        if (p->section >= 0) {
+            param_table_section_key(p->section, section);
+            snprintf(p->key, sizeof(p->key), "%s.%s", section, name);
+        }
+        else {
+            snprintf(p->key, sizeof(p->key), "%s", name);
+        }
+    }
+}
+
+int param_table_decode(param_table* t, const uint8_t* packet, int len, int sections) {
+    const uint8_t* slot;
+    param_entry* p;
+    int i, k, n, base, index;
+
+    memset(t, 0, sizeof(*t));
+
+    if (len < 6)
+        return 0;
+
+    n = packet[5];
+    if (n > PARAM_TABLE_MAX_PARAMS)
+        n = PARAM_TABLE_MAX_PARAMS;
+    if (6 + n * PARAM_BYTE_SLOT > len)
+        n = (len - 6) / PARAM_BYTE_SLOT;
+
+    for (i = 0; i < n; i++) {
+        slot = packet + 6 + i * PARAM_BYTE_SLOT;
+        p = &t->params[i];
+
+        p->type = slot[0];
+        p->dim = slot[1];
+        p->size = codec(p->type)->size;
+        if (2 + p->size * p->dim >= PARAM_BYTE_SLOT)
+            p->dim = (PARAM_BYTE_SLOT - 3) / p->size;
+        memcpy(p->data, slot + 2, p->size * p->dim);
+
+        // "index - description" up to the terminator, then menu and struct numbers
+        base = 2 + p->size * p->dim;
+        for (k = 0; base + k < PARAM_BYTE_SLOT && slot[base + k] != '\0'; k++)
+            p->description[k] = slot[base + k];
+        p->description[k] = '\0';
+
+        // without sections the tools set parameters by their position
+        p->index = i + 1;
+        if (sscanf(p->description, "%d - %49[^\t\n]", &index, p->name) == 2) {
+            if (sections)
+                p->index = index;
+        }
+        else {
+            strncpy(p->name, p->description, sizeof(p->name) - 1);
+        }
+
+        if (p->type == TYPE_FLAG) {
+            p->menu = (base + k + 1 < PARAM_BYTE_SLOT) ? slot[base + k + 1] : -1;
+            p->section = (base + k + 3 < PARAM_BYTE_SLOT) ? slot[base + k + 3] : 0;
+            if (p->menu > t->num_menus)
+                t->num_menus = p->menu;
+        }
+        else {
+            p->menu = -1;
+            p->section = (base + k + 1 < PARAM_BYTE_SLOT) ? slot[base + k + 1] : 0;
+        }
+        if (!sections)
+            p->section = -1;
+    }
+    t->num_params = n;
+    make_keys(t);
+
+    // Menus of the TYPE_FLAG parameters follow the last slot
+    if (t->num_menus > PARAM_TABLE_MAX_MENUS)
+        t->num_menus = PARAM_TABLE_MAX_MENUS;
+    base = 6 + n * PARAM_BYTE_SLOT;
+    for (i = 0; i < t->num_menus && base + (i + 1) * PARAM_MENU_SLOT <= len; i++)
+        strncpy(t->menus[i], (const char*) packet + base + i * PARAM_MENU_SLOT, PARAM_MENU_SLOT - 1);
+    t->num_menus = i;
+
+    return n;
+}
+
+const char* param_table_menu(const param_table* t, const param_entry* p) {
+    if (p->menu < 1 || p->menu > t->num_menus)
+        return "";
+
+    return t->menus[p->menu - 1];
+}
+
+//==============================================================================
+//                                                                          keys
+//==============================================================================
+
+param_entry* param_table_find(param_table* t, const char* key) {
+    char section[20];
+    const char* dot = strchr(key, '.');
+    const char* name;
+    param_entry* p;
+    char* end;
+    long number;
+    int i;
+
+    name = (dot != NULL) ? dot + 1 : key;
+    number = strtol(name, &end, 10);
+    if (end == name || *end != '\0')
+        number = -1;
+
+    for (i = 0; i < t->num_params; i++) {
+        p = &t->params[i];
+
+        // a section is given exactly when the table has sections
+        if ((p->section >= 0) != (dot != NULL))
+            continue;
+        if (dot != NULL) {
+            param_table_section_key(p->section, section);
+            if (strlen(section) != (size_t)(dot - key) || strncasecmp(section, key, dot - key))
+                continue;
+        }
+
+        if (number > 0 ? p->number == number : !strcasecmp(p->key + (dot != NULL ? dot - key + 1 : 0), name))
+            return p;
+    }
+
+    return NULL;
+}
+
+//==============================================================================
+//                                                                        writes
+//==============================================================================
+
+int param_table_prompt(const param_table* t, const param_entry* p, void* values) {
+    char text[256] = "";
+    char token[100];
+    char error[100];
+    int k;
+
+    // Depending on the number of values of the parameter and its type
+    // different and/or multiple readings must be done
+    printf("Insert new parameters values\n");
+    for (k = 0; k < p->dim && p->type != TYPE_STRING; k++) {
+        // TYPE_FLAG is a uint8 but with a menu
+        if (p->type == TYPE_FLAG)
+            printf("%s", param_table_menu(t, p));
+        else
+            printf("Insert %d° parameter: \n", k + 1);
+
+        if (scanf("%99s", token) != 1)
+            return -1;
+        if (strlen(text) + strlen(token) + 2 < sizeof(text)) {
+            strcat(text, " ");
+            strcat(text, token);
+        }
+    }
+    if (p->type == TYPE_STRING && scanf("%99s", text) != 1)
+        return -1;
+
+    if (param_table_parse(p, text, values, error)) {
+        printf("Invalid value: %s\n", error);
+        return -1;
+    }
+
+    return 0;
+}
+
+int param_table_write(comm_settings* cs, int id, param_list_fn list, const param_entry* p, void* values) {
+    return list(cs, id, p->index, values, p->size, p->dim, NULL);
+}
+
+//==============================================================================
+//                                                                      firmware
+//==============================================================================
+
+int param_table_firmware(comm_settings* cs, int id, char* firmware) {
+    static char info[PARAM_INFO_LEN];
+    const char* line;
+    int i;
+
+    firmware[0] = '\0';
+    memset(info, 0, sizeof(info));
+    commGetInfo(cs, id, INFO_ALL, info);
+    info[sizeof(info) - 1] = '\0';
+
+    // The rest of the info text holds measurements, only this line is stable
+    line = strstr(info, "Firmware version");
+    if (line == NULL)
+        return -1;
+
+    for (i = 0; line[i] != '\0' && line[i] != '\r' && line[i] != '\n' && i < PARAM_TABLE_FW_LEN - 1; i++)
+        firmware[i] = line[i];
+    firmware[i] = '\0';
+
+    return 0;
+}
+
+//==============================================================================
+//                                                                          read
+//==============================================================================
+
+int param_table_read(param_table* t, comm_settings* cs, int id, param_list_fn list, int sections) {
+    static uint8_t packet[PARAM_TABLE_PACKET_LEN];
+
+    memset(packet, 0, sizeof(packet));
+    list(cs, id, 0, NULL, 0, 0, packet);
+
+    return param_table_decode(t, packet, sizeof(packet), sections);
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,179 @@
+// ----------------------------------------------------------------------------
+// BSD 3-Clause License
+
+// Copyright (c) 2016, qbrobotics
+// Copyright (c) 2017-2024, Centro "E.Piaggio"
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// POSSIBILITY OF SUCH DAMAGE.
+// ----------------------------------------------------------------------------
+
+/**
+* \file         param_table.h
+*
+* \brief        Decoded parameter table of the NMMI boards
+* \author       _Centro "E.Piaggio"_
+* \copyright    (C) 2017-2024 Centro "E.Piaggio". All rights reserved.
+*
+* \details      commGetParamList with index 0 returns the whole parameter
+*               packet of the board:
+*               [':'][':'][ID][LEN][CMD][PARAM_NUM] then PARAM_NUM slots of
+*               PARAM_BYTE_SLOT bytes, then the menus of the TYPE_FLAG
+*               parameters, PARAM_MENU_SLOT bytes each. A slot is
+*               [DATA_TYPE][DATA_DIMENSION][..DATA..]["index - description"\0]
+*               followed by the menu number (TYPE_FLAG only, one empty byte
+*               after it) and, on the NMMI boards, by the struct number.
+*               qbparam and nmmi_param_imu read the same layout without the
+*               struct number.
+*
+*               Every parameter has a key "section.param" for the scripts:
+*               the section is the short name nmmi_param accepts (dev, emg,
+*               imu, ...) followed by the instance when a board has several
+*               (mot1, mot2, enc0, usr1), the param is the description in
+*               lower case up to the unit, e.g. mot1.position_pid. The number
+*               printed by the tools works as well: mot1.1. Tables without
+*               sections use the param alone.
+*
+*               The table is always read from the board, never kept between
+*               runs: the values change behind the tools' back (other tools,
+*               other hosts, commSetZeros, a different board with the same
+*               ID).
+*/
+
+#ifndef PARAM_TABLE_H_INCLUDED
+#define PARAM_TABLE_H_INCLUDED
+
+#include "../../qbAPI/src/qbmove_communications.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PARAM_TABLE_MAX_PARAMS  150
+#define PARAM_TABLE_MAX_MENUS   60
+#define PARAM_TABLE_PACKET_LEN  10000       ///< Buffer of commGetParamList(index = 0)
+#define PARAM_TABLE_FW_LEN      100
+#define PARAM_TABLE_KEY_LEN     64
+
+/** commGetParamList or commGetIMUParamList
+ */
+typedef int (*param_list_fn)(comm_settings* cs, int id, unsigned short index, void* values,
+        unsigned short value_size, unsigned short num_of_values, uint8_t* buffer);
+
+typedef struct param_entry {
+    int index;                              ///< Index in the parameter list, as written in the description
+    int type;                               ///< TYPE_FLAG, TYPE_INT8, ...
+    int dim;                                ///< Number of values
+    int size;                               ///< Bytes of each value
+    int menu;                               ///< Menu number of TYPE_FLAG parameters, -1 otherwise
+    int section;                            ///< Struct number, ST_* plus the instance, -1 without sections
+    int number;                             ///< Position in its section, as the tools print it
+    char name[50];
+    char key[PARAM_TABLE_KEY_LEN];          ///< "section.param", or "param" without sections
+    uint8_t data[PARAM_BYTE_SLOT];          ///< Values as on the wire, big endian
+    char description[PARAM_BYTE_SLOT];      ///< Text of the slot, "index - name" as the board sends it
+} param_entry;
+
+typedef struct param_table {
+    int num_params;                         ///< Entries in packet order, params[i] has index i + 1
+    int num_menus;
+    param_entry params[PARAM_TABLE_MAX_PARAMS];
+    char menus[PARAM_TABLE_MAX_MENUS][PARAM_MENU_SLOT];
+    char firmware[PARAM_TABLE_FW_LEN];      ///< Firmware version line of the board, "" if not asked
+} param_table;
+
+/** Decode the packet returned by the list function with index = 0,
+ *  sections tells if the slots end with the struct number.
+ *  Returns the number of parameters, 0 if the packet is empty.
+ */
+int param_table_decode(param_table* t, const uint8_t* packet, int len, int sections);
+
+/** Read and decode the parameter list of the board.
+ *  Returns the number of parameters, 0 on failure.
+ */
+int param_table_read(param_table* t, comm_settings* cs, int id, param_list_fn list, int sections);
+
+/** Firmware version line of the board, as commGetInfo(INFO_ALL) prints
+ *  it. Returns 0 on success, -1 if the board did not answer with a version.
+ */
+int param_table_firmware(comm_settings* cs, int id, char* firmware);
+
+/** Menu text of a TYPE_FLAG parameter, "" if there is none
+ */
+const char* param_table_menu(const param_table* t, const param_entry* p);
+
+/** Short name of a section with its instance, e.g. "mot1"
+ */
+void param_table_section_key(int section, char* key);
+
+/** Parameter of key, NULL if there is none
+ */
+param_entry* param_table_find(param_table* t, const char* key);
+
+/** Parse text, the values separated by spaces or commas, into values as
+ *  the list function takes them (dim values of size bytes, native order).
+ *  values must hold PARAM_BYTE_SLOT bytes. Returns 0 on success, -1 with
+ *  the reason in error otherwise.
+ */
+int param_table_parse(const param_entry* p, const char* text, void* values, char* error);
+
+/** Value k of p, converted by the codec of its type
+ */
+double param_table_value(const param_entry* p, int k);
+
+/** Values of p as the tools print them, each preceded by a space
+ */
+void param_table_display(const param_entry* p, char* out, size_t size);
+
+/** Values of p in the format param_table_parse reads, floats with the
+ *  digits needed to read them back unchanged
+ */
+void param_table_format(const param_entry* p, char* out, size_t size);
+
+/** 1 if values (as param_table_parse fills them) differ from those of p
+ */
+int param_table_changed(const param_entry* p, const void* values);
+
+/** Set the values of p, as param_table_parse fills them
+ */
+void param_table_update(param_entry* p, const void* values);
+
+/** Name of a TYPE_* value ("float", "uint8", ...) and back, -1 if unknown
+ */
+const char* param_table_type_name(int type);
+int param_table_type(const char* name);
+
+/** Ask the new values of p on the terminal, with the menu of flags, and
+ *  parse them as param_table_parse. Returns 0 on success, -1 otherwise.
+ */
+int param_table_prompt(const param_table* t, const param_entry* p, void* values);
+
+/** Write the values of p to the board, not stored until commStoreParams
+ */
+int param_table_write(comm_settings* cs, int id, param_list_fn list, const param_entry* p, void* values);
+
+#endif
+/* [] END OF FILE */
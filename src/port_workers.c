@@ -0,0 +1,396 @@
+// ----------------------------------------------------------------------------
+// BSD 3-Clause License
+
+// Copyright (c) 2016, qbrobotics
+// Copyright (c) 2017-2024, Centro "E.Piaggio"
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// POSSIBILITY OF SUCH DAMAGE.
+// ----------------------------------------------------------------------------
+
+/**
+* \file         port_workers.c
+*
+* \brief        One worker thread per serial port
+* \author       _Centro "E.Piaggio"_
+* \copyright    (C) 2017-2024 Centro "E.Piaggio". All rights reserved.
+*/
+
+#include "port_workers.h"
+#include "qbmetered.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+//==============================================================================
+//                                                                         ports
+//==============================================================================
+
+int port_parse(port_worker* w, const char* spec) {
+    const char* ids = strrchr(spec, ':');
+
+    if (ids == NULL || ids == spec || ids - spec >= (long)sizeof(w->port)) {
+        printf("Wrong port %s, expected port:id,id,...\n", spec);
+        return -1;
+    }
+
+    memcpy(w->port, spec, ids - spec);
+    w->port[ids - spec] = '\0';
+
+    if (bus_parse_devices(&w->chain, ids + 1) < 1)
+        return -1;
+
+    return 0;
+}
+
+int port_load_conf(port_worker* workers, int num_workers, const char* filename) {
+    FILE* file;
+    char line[1024];
+    char port[255], ids[255];
+
+    file = fopen(filename, "r");
+    if (file == NULL) {
+        printf("Error opening file %s\n", filename);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), file)) {
+        if (sscanf(line, "serialport %254s %254s", port, ids) != 2)
+            continue;
+        if (num_workers == PORT_MAX_WORKERS) {
+            printf("Too many ports in %s, max %d\n", filename, PORT_MAX_WORKERS);
+            break;
+        }
+
+        strcpy(workers[num_workers].port, port);
+        if (bus_parse_devices(&workers[num_workers].chain, ids) < 1)
+            continue;
+        num_workers++;
+    }
+
+    fclose(file);
+
+    return num_workers;
+}
+
+//==============================================================================
+//                                                                 start barrier
+//==============================================================================
+
+/** Tick 0 of all schedules a little in the future and release the
+ *  workers, called with job->lock held
+ */
+static void port_release(port_job* job) {
+    long long nsec;
+
+    clock_gettime(CLOCK_MONOTONIC, &job->start);
+    nsec = job->start.tv_nsec + PORT_START_DELAY;
+    job->start.tv_sec += nsec / 1000000000LL;
+    job->start.tv_nsec = nsec % 1000000000LL;
+    pthread_cond_broadcast(&job->cond);
+}
+
+/** Wait for every worker, the last one sets the common start
+ */
+static void port_barrier(port_job* job) {
+    pthread_mutex_lock(&job->lock);
+
+    job->arrived++;
+    if (job->arrived == job->num_workers)
+        port_release(job);
+    else {
+        while (job->arrived < job->num_workers)
+            pthread_cond_wait(&job->cond, &job->lock);
+    }
+
+    pthread_mutex_unlock(&job->lock);
+}
+
+//==============================================================================
+//                                                                    trajectory
+//==============================================================================
+
+static int port_prepare_file(port_worker* w) {
+    port_job* job = w->job;
+    char log_file[255];
+    char header[255] = "id,\t";
+    short int measurements[4];
+    const char* dot;
+    int sensor_num, k;
+
+    if (traj_open(&w->traj, job->filename))
+        return -1;
+
+    if (job->log) {
+        // filename_log_<n>.qbl
+        dot = strrchr(job->filename, '.');
+        k = dot ? (int)(dot - job->filename) : (int)strlen(job->filename);
+        snprintf(log_file, sizeof(log_file), "%.*s_log_%d.qbl", k, job->filename, w->index);
+
+        sensor_num = commGetMeasurements(&w->cs, w->chain.devices[0].id, measurements);
+        for (k = 0; k < sensor_num; k++)
+            sprintf(header + strlen(header), "sensor_%d,\t", (k + 1));
+        strcat(header, "input_1,\tinput_2,\t");
+        strcat(header, "current_1,\tcurrent_2\n");
+
+        if (async_log_open(&w->log, log_file, ASYNC_LOG_DEVICES, header)) {
+            traj_close(&w->traj);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static void port_loop_file(port_worker* w) {
+    port_job* job = w->job;
+    short int values[TRAJ_MAX_CHANNELS] = {0, 0};
+    log_record record = {0};
+    bus_device* dev;
+    int d, c, g;
+
+    rt_sched_start_at(&w->sched, &job->start, w->traj.deltat * 1000000LL);
+
+    while (!job->stop) {
+        // next values, or keep the previous ones if the reader is late
+        if (traj_next(&w->traj, values) == 0)
+            break;
+
+        rt_sched_wait(&w->sched);
+        if (w->sched.num_ticks == 1)
+            w->start_late = rt_sched_elapsed(&w->sched);
+
+        // columns 2g and 2g+1 go to the g-th device of all the ports
+        for (d = 0; d < w->chain.num_devices; d++) {
+            g = w->first_device + d;
+            c = (w->traj.channels >= 2 * (g + 1)) ? 2 * g : 0;
+            w->chain.devices[d].inputs[0] = values[c];
+            w->chain.devices[d].inputs[1] = values[c + 1];
+        }
+
+        w->errors += bus_cycle(&w->chain, &w->cs);
+
+        if (job->log) {
+            record.time = rt_sched_elapsed(&w->sched);
+            for (d = 0; d < w->chain.num_devices; d++) {
+                dev = &w->chain.devices[d];
+                record.id = dev->id;
+                record.sensor_num = dev->sensor_num;
+                memcpy(record.inputs, dev->inputs, sizeof(record.inputs));
+                memcpy(record.measurements, dev->measurements, sizeof(record.measurements));
+                async_log_push(&w->log, &record);
+            }
+        }
+    }
+
+    w->total_time = rt_sched_elapsed(&w->sched);
+
+    traj_close(&w->traj);
+    if (job->log)
+        async_log_close(&w->log);
+
+    bus_zero(&w->chain, &w->cs);
+}
+
+//==============================================================================
+//                                                                        stream
+//==============================================================================
+
+static int port_prepare_stream(port_worker* w) {
+    port_job* job = w->job;
+    sampler* s = &w->stream;
+    char output[255];
+    const char* base = job->output;
+    const char* ext = job->binary ? ".qbs" : ".csv";
+    const char* dot;
+    int k;
+
+    s->binary = job->binary;
+    s->period = job->period;
+    s->max_samples = job->max_samples;
+    s->stop = 0;
+    s->start = &job->start;
+    s->pub = NULL;
+    s->num_channels = 0;
+    if (sampler_add_channels(s, job->channels))
+        return -1;
+
+    // output_<n>.ext, the streams cannot share stdout
+    if (!strcmp(base, "-"))
+        base = "stream";
+    dot = strrchr(base, '.');
+    if (dot != NULL)
+        ext = dot;
+    k = dot ? (int)(dot - base) : (int)strlen(base);
+    snprintf(output, sizeof(output), "%.*s_%d%s", k, base, w->index, ext);
+
+    s->out = fopen(output, s->binary ? "wb" : "w");
+    if (s->out == NULL) {
+        perror("Error opening output file");
+        return -1;
+    }
+
+    if (sampler_prepare(s, &w->cs, w->chain.devices[0].id)) {
+        fclose(s->out);
+        return -1;
+    }
+
+    return 0;
+}
+
+static void port_loop_stream(port_worker* w) {
+    sampler_loop(&w->stream, &w->cs, w->chain.devices[0].id);
+    w->start_late = w->stream.first_late;
+    fclose(w->stream.out);
+}
+
+//==============================================================================
+//                                                                       workers
+//==============================================================================
+
+static void* port_worker_thread(void* arg) {
+    port_worker* w = (port_worker*) arg;
+    port_job* job = w->job;
+
+    if (job->open_port(&w->cs, w->port, w->baudrate)) {
+        if (job->mode == PORT_JOB_FILE)
+            w->ready = (port_prepare_file(w) == 0);
+        else
+            w->ready = (port_prepare_stream(w) == 0);
+
+        if (!w->ready)
+            closeRS485(&w->cs);
+    }
+    else
+        printf("Cannot open %s\n", w->port);
+
+    rt_sched_setup(job->rt_priority, job->rt_cpu >= 0 ? job->rt_cpu + w->index : -1);
+
+    // every worker comes to the barrier, ready or not
+    port_barrier(job);
+    if (!w->ready)
+        return NULL;
+
+    if (job->mode == PORT_JOB_FILE)
+        port_loop_file(w);
+    else
+        port_loop_stream(w);
+
+    closeRS485(&w->cs);
+
+    return NULL;
+}
+
+int port_run(port_worker* workers, int num_workers, port_job* job) {
+    int first_device = 0;
+    int failed = 0;
+    int i;
+
+    pthread_mutex_init(&job->lock, NULL);
+    pthread_cond_init(&job->cond, NULL);
+    job->num_workers = num_workers;
+    job->arrived = 0;
+    job->stop = 0;
+
+    for (i = 0; i < num_workers; i++) {
+        workers[i].index = i;
+        workers[i].first_device = first_device;
+        workers[i].job = job;
+        workers[i].ready = 0;
+        workers[i].errors = 0;
+        first_device += workers[i].chain.num_devices;
+    }
+
+    for (i = 0; i < num_workers; i++) {
+        if (pthread_create(&workers[i].thread, NULL, port_worker_thread, &workers[i])) {
+            printf("Cannot start the worker of %s\n", workers[i].port);
+            // the others must not wait for it at the barrier
+            num_workers = i;
+            pthread_mutex_lock(&job->lock);
+            job->num_workers = i;
+            if (i > 0 && job->arrived == i)
+                port_release(job);
+            pthread_mutex_unlock(&job->lock);
+            failed++;
+            break;
+        }
+    }
+
+    for (i = 0; i < num_workers; i++) {
+        pthread_join(workers[i].thread, NULL);
+        if (!workers[i].ready)
+            failed++;
+    }
+
+    pthread_cond_destroy(&job->cond);
+    pthread_mutex_destroy(&job->lock);
+
+    return failed;
+}
+
+//==============================================================================
+//                                                                    statistics
+//==============================================================================
+
+void port_print(port_worker* workers, int num_workers, FILE* out) {
+    port_worker* w;
+    long long late_min = 0, late_max = 0;
+    int first = 1;
+    int i;
+
+    for (i = 0; i < num_workers; i++) {
+        w = &workers[i];
+        fprintf(out, "Port %d: %s, %d devices\n", w->index, w->port, w->chain.num_devices);
+        if (!w->ready) {
+            fprintf(out, "  not started\n");
+            continue;
+        }
+
+        if (w->job->mode == PORT_JOB_FILE) {
+            fprintf(out, "  total time (usec): %lld\n", w->total_time);
+            fprintf(out, "  Error counter %ld\n", w->errors);
+            fprintf(out, "  Reader underruns %ld\n", w->traj.underruns);
+            rt_sched_print(&w->sched, out);
+            bus_print(&w->chain, out);
+            if (w->job->log)
+                fprintf(out, "  Log records dropped: %ld\n", w->log.dropped);
+        }
+        else
+            sampler_print(&w->stream, out);
+
+        if (first || w->start_late < late_min)
+            late_min = w->start_late;
+        if (first || w->start_late > late_max)
+            late_max = w->start_late;
+        first = 0;
+    }
+
+    if (!first)
+        fprintf(out, "Start skew between ports (usec): %lld\n", late_max - late_min);
+}
+
+/* [] END OF FILE */
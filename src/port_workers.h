@@ -0,0 +1,149 @@
+// ----------------------------------------------------------------------------
+// BSD 3-Clause License
+
+// Copyright (c) 2016, qbrobotics
+// Copyright (c) 2017-2024, Centro "E.Piaggio"
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// POSSIBILITY OF SUCH DAMAGE.
+// ----------------------------------------------------------------------------
+
+/**
+* \file         port_workers.h
+*
+* \brief        One worker thread per serial port
+* \author       _Centro "E.Piaggio"_
+* \copyright    (C) 2017-2024 Centro "E.Piaggio". All rights reserved.
+*
+* \details      Every port has its own thread, comm_settings and chain of
+*               devices, so the buses run in parallel. The workers open
+*               their port and get ready, then meet at a start barrier
+*               where tick 0 is set a few milliseconds in the future on
+*               CLOCK_MONOTONIC. All schedules share that grid, so the
+*               buses start within the wake-up jitter of each other.
+*
+*               Ports are given as "port:id,id,..." on the command line or
+*               as lines of QBPORTS_FILE:
+*               serialport <port> <id,id,...>
+*/
+
+#ifndef PORT_WORKERS_H_INCLUDED
+#define PORT_WORKERS_H_INCLUDED
+
+#include <stdio.h>
+#include <signal.h>
+#include <pthread.h>
+
+#include "../../qbAPI/src/qbmove_communications.h"
+#include "bus_sched.h"
+#include "traj_reader.h"
+#include "async_log.h"
+#include "sampler.h"
+
+#define PORT_MAX_WORKERS    8
+#define PORT_START_DELAY    20000000LL  ///< Tick 0 after the last worker is ready [ns]
+
+enum port_job_mode {
+    PORT_JOB_FILE,              ///< -f on every chain
+    PORT_JOB_STREAM             ///< sampler on the first device of every chain
+};
+
+/** What the workers do, shared by all of them
+ */
+typedef struct port_job {
+    int mode;
+    int (*open_port)(comm_settings*, const char*, int);    ///< Returns 1 on success
+
+    // PORT_JOB_FILE
+    const char* filename;
+    int log;                    ///< Log every chain in filename_log_<n>.qbl
+
+    // PORT_JOB_STREAM
+    const char* channels;
+    long long period;           ///< [us]
+    long max_samples;
+    int binary;
+    const char* output;         ///< Written as output_<n>.ext
+
+    int rt_priority;
+    int rt_cpu;                 ///< Worker n is pinned to rt_cpu + n, -1 for any
+
+    volatile sig_atomic_t stop; ///< Set by the CTRL-C handler
+
+    // start barrier
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int num_workers;
+    int arrived;
+    struct timespec start;      ///< Tick 0 of every worker
+} port_job;
+
+typedef struct port_worker {
+    int index;
+    char port[255];
+    int baudrate;
+    int first_device;           ///< Index of the first device of the chain among all devices
+    bus_sched chain;
+    comm_settings cs;
+
+    port_job* job;
+    pthread_t thread;
+    int ready;                  ///< Port open and job prepared
+
+    // PORT_JOB_FILE
+    traj_reader traj;
+    rt_sched sched;
+    async_log log;
+    long errors;
+    long long total_time;       ///< [us]
+
+    // PORT_JOB_STREAM
+    sampler stream;
+
+    long long start_late;       ///< First tick after the common start [us]
+} port_worker;
+
+/** Parse "port:id,id,..." into w. Returns 0, or -1 if malformed.
+ */
+int port_parse(port_worker* w, const char* spec);
+
+/** Add the ports of a QBPORTS_FILE to workers. Returns the new number of
+ *  workers, or -1 if the file cannot be read.
+ */
+int port_load_conf(port_worker* workers, int num_workers, const char* filename);
+
+/** Run job on every worker and wait for all of them. Returns the number of
+ *  workers that could not start.
+ */
+int port_run(port_worker* workers, int num_workers, port_job* job);
+
+/** Per port results and start skew
+ */
+void port_print(port_worker* workers, int num_workers, FILE* out);
+
+#endif
+/* [] END OF FILE */
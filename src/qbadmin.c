@@ -66,6 +66,19 @@
 #include "../../qbAPI/src/qbmove_communications.h"
 #include "../../qbAPI/src/cp_communications.h"
 #include "definitions.h"
+#include "qbpacket.h"
+#include "rt_sched.h"
+#include "traj_reader.h"
+#include "async_log.h"
+#include "sampler.h"
+#include "bus_sched.h"
+#include "port_workers.h"
+#include "qbclient.h"
+#include "telemetry.h"
+#include "bench.h"
+#include "capture.h"
+#include "sd_sync.h"
+#include "qbmetered.h"
 
 #include <stdio.h>
 #include <stdint.h>
@@ -77,6 +90,7 @@
 #include <math.h>
 #include <signal.h>
 #include <assert.h>
+#include <time.h>
 
 #if defined(_WIN32) || defined(_WIN64)
     #include <windows.h>
@@ -84,10 +98,38 @@
 	#define sleep(x) Sleep(1000 * x)
 #else
     #include <sys/stat.h>
+    #include <termios.h>
 #endif
 
 //===============================================================     structures
 
+// Long options without a short equivalent
+enum long_only_options {
+    OPT_POLL_BAUDRATE = 256,
+    OPT_POLL_IDS,
+    OPT_POLL_TABLE,
+    OPT_POLL_TIMEOUT,
+    OPT_RESCAN,
+    OPT_RT_PRIORITY,
+    OPT_RT_CPU,
+    OPT_CONVERT_TRAJ,
+    OPT_EXPORT_LOG,
+    OPT_PERIOD_US,
+    OPT_OUTPUT,
+    OPT_BINARY,
+    OPT_SAMPLES,
+    OPT_CHANNELS,
+    OPT_DEVICES,
+    OPT_PORT,
+    OPT_PORTS,
+    OPT_PUBLISH,
+    OPT_SUBSCRIBE,
+    OPT_BENCHMARK,
+    OPT_JSON,
+    OPT_CAPTURE,
+    OPT_METRICS
+};
+
 
 static const struct option longOpts[] = {
     { "set_inputs", required_argument, NULL, 's' },
@@ -123,6 +165,29 @@ static const struct option longOpts[] = {
 	{"get_encoder_raw", no_argument, NULL, 'E'},
 	{"get_SD_files", no_argument, NULL, 'S'},
     {"get_SD_filesystem", no_argument, NULL, 'X'},
+    { "poll_baudrate", required_argument, NULL, OPT_POLL_BAUDRATE },
+    { "poll_ids", required_argument, NULL, OPT_POLL_IDS },
+    { "poll_table", required_argument, NULL, OPT_POLL_TABLE },
+    { "poll_timeout", required_argument, NULL, OPT_POLL_TIMEOUT },
+    { "rescan", no_argument, NULL, OPT_RESCAN },
+    { "rt_priority", required_argument, NULL, OPT_RT_PRIORITY },
+    { "cpu", required_argument, NULL, OPT_RT_CPU },
+    { "convert_traj", required_argument, NULL, OPT_CONVERT_TRAJ },
+    { "export_log", required_argument, NULL, OPT_EXPORT_LOG },
+    { "period_us", required_argument, NULL, OPT_PERIOD_US },
+    { "output", required_argument, NULL, OPT_OUTPUT },
+    { "binary", no_argument, NULL, OPT_BINARY },
+    { "samples", required_argument, NULL, OPT_SAMPLES },
+    { "channels", required_argument, NULL, OPT_CHANNELS },
+    { "devices", required_argument, NULL, OPT_DEVICES },
+    { "port", required_argument, NULL, OPT_PORT },
+    { "ports", no_argument, NULL, OPT_PORTS },
+    { "publish", required_argument, NULL, OPT_PUBLISH },
+    { "subscribe", required_argument, NULL, OPT_SUBSCRIBE },
+    { "benchmark", required_argument, NULL, OPT_BENCHMARK },
+    { "json", no_argument, NULL, OPT_JSON },
+    { "capture", required_argument, NULL, OPT_CAPTURE },
+    { "metrics", required_argument, NULL, OPT_METRICS },
     { NULL, no_argument, NULL, 0 }
 };
 
@@ -163,6 +228,27 @@ struct global_args {
 	int flag_get_SD_files;			///< Additional -S option
     int flag_get_SD_filesystem;     ///< Additional -X option
 
+    int poll_baudrate;              ///< --poll_baudrate, 0 scans both baud rates
+    int poll_first_id;              ///< --poll_ids first ID to scan
+    int poll_last_id;               ///< --poll_ids last ID to scan
+    int poll_timeout;               ///< --poll_timeout initial reply window [ms]
+    char poll_table[255];           ///< --poll_table CSV device table, "-" for stdout
+    int flag_rescan;                ///< --rescan ignores the device inventory
+    int rt_priority;                ///< --rt_priority SCHED_FIFO priority of the control loops
+    int rt_cpu;                     ///< --cpu pins the control loops to a CPU
+    int flag_stream;                ///< --period_us or --channels, stream instead of -g/-i/-o/-c loops
+    long long stream_period;        ///< --period_us tick of the stream
+    char stream_channels[255];      ///< --channels list, see sampler.h
+    char stream_output[255];        ///< --output file of the stream, "-" for stdout
+    int flag_stream_binary;         ///< --binary stream records instead of CSV
+    long stream_samples;            ///< --samples stops the stream, 0 for never
+    int flag_publish;               ///< --publish samples of -g, -c, -q, -Q and the stream
+    char publish_name[255];         ///< --publish shared memory segment
+    long benchmark_iterations;      ///< --benchmark requests of each command, 0 for none
+    int flag_json;                  ///< --json summary of --benchmark
+    char capture_file[255];         ///< --capture serial traffic, "" for none
+    char metrics_target[255];       ///< --metrics file or :port, "" for none
+
     short int inputs[NUM_OF_MOTORS];
     short int measurements[4];
     short int velocities[4];
@@ -192,7 +278,6 @@ struct global_args {
     FILE* SD_R01_file;
 	
     FILE* emg_file;
-    FILE* log_file_fd;
 } global_args;  //multiple boards on multiple usb
 
 struct position {
@@ -200,6 +285,24 @@ struct position {
     float act;
 } p1, p2;
 
+/** Device found by the polling search
+ */
+struct poll_device {
+    int id;
+    int baudrate;
+    int sensor_num;
+    short int measurements[4];
+    long latency;                   ///< Probe round trip [us]
+};
+
+/** Device recorded in the device inventory
+ */
+struct inventory_entry {
+    int id;
+    int baudrate;
+    char info[INVENTORY_INFO_LEN];  ///< commGetInfo(INFO_ALL) with escaped newlines
+};
+
 
 //==========================================================    global variables
 
@@ -209,22 +312,43 @@ int ret;                                    //utility variable to store return v
 int aux_int;
 
 comm_settings comm_settings_1;
+sampler stream;                             //-g --period_us stream
+bus_sched chain;                            //-f --devices, empty with a single device
+port_worker workers[PORT_MAX_WORKERS];      //--port/--ports, one thread per serial port
+int num_workers = 0;
+port_job workers_job;
+async_log log_writer;                       //-l writer, filled by the control loops
+telemetry pub;                              //--publish ring of the sampling loops
+volatile sig_atomic_t subscribe_stop = 0;   //--subscribe reader loop
+bench benchmark;                            //--benchmark series
+int port_baudrate = 0;                      //baud rate of the open port, 0 through qbadmind
+capture capture_writer;                     //--capture proxy of the serial port
 
 
 //=====================================================     function declaration
 
 int open_port();
+int open_port_baudrate(comm_settings*, const char*, int);
 int port_selection();
 int polling();
 
+/** Probe IDs first..last at the current baud rate, return the number of devices found
+ */
+int poll_scan(comm_settings*, int, int, int, struct poll_device*);
 
-/** Display program usage, and exit.
+/** Device inventory functions
  */
-void display_usage( void );
+void inventory_escape(const char*, char*, int);
+int inventory_load(const char*, struct inventory_entry*, long*);
+int inventory_save(const char*, struct inventory_entry*, int);
+int inventory_baudrate(const char*, int);
+int poll_verify(const char*, FILE*);
+void poll_print(FILE*, int, struct poll_device*, int);
+
 
-/** Parse csv input file with values to be sent to the motors
+/** Display program usage, and exit.
  */
-float** file_parser(char*, int*, int*);
+void display_usage( void );
 
 /** CTRL-c handler 1
  */
@@ -238,6 +362,38 @@ void int_handler_2(int sig);
  */
 void int_handler_3(int sig);
 
+/** CTRL-c handler 4
+ */
+void int_handler_4(int sig);
+
+/** CTRL-c handler 5
+ */
+void int_handler_5(int sig);
+
+/** CTRL-c handler 6
+ */
+void int_handler_6(int sig);
+
+/** CTRL-c handler 7
+ */
+void int_handler_7(int sig);
+
+/** Run -f or the stream on every port of --port/--ports
+ */
+int run_workers();
+
+/** Flush and close the --capture file at exit
+ */
+void stop_capture();
+
+/** Create the --publish segment for samples of up to max_values
+ */
+int open_publisher(int max_values);
+
+/** Print the samples published in a --publish segment
+ */
+int subscribe_telemetry(const char* name);
+
 /** Baudrate functions
  */
 int baudrate_reader();
@@ -305,6 +461,26 @@ int main (int argc, char **argv)
 	global_args.flag_get_SD_files		= 0;
     global_args.flag_get_SD_filesystem  = 0;
 
+    global_args.poll_baudrate           = 0;
+    global_args.poll_first_id           = 1;
+    global_args.poll_last_id            = 127;
+    global_args.poll_timeout            = POLL_DEFAULT_TIMEOUT;
+    strcpy(global_args.poll_table, "");
+    global_args.flag_rescan             = 0;
+    global_args.rt_priority             = 0;
+    global_args.rt_cpu                  = -1;
+    global_args.flag_stream             = 0;
+    global_args.stream_period           = 0;
+    strcpy(global_args.stream_channels, "");
+    strcpy(global_args.stream_output, "-");
+    global_args.flag_stream_binary      = 0;
+    global_args.stream_samples          = 0;
+    global_args.flag_publish            = 0;
+    global_args.benchmark_iterations    = 0;
+    global_args.flag_json               = 0;
+    strcpy(global_args.capture_file, "");
+    strcpy(global_args.metrics_target, "");
+
     global_args.BaudRate                = baudrate_reader();
 
     //===================================================     processing options
@@ -428,6 +604,140 @@ int main (int argc, char **argv)
             case 'X':
                 global_args.flag_get_SD_filesystem = 1;
                 break;					
+            case OPT_POLL_BAUDRATE:
+                sscanf(optarg,"%d", &global_args.poll_baudrate);
+                if ((global_args.poll_baudrate != 460800) && (global_args.poll_baudrate != 2000000)) {
+                    puts("Polling BaudRate not supported [460800 or 2000000].");
+                    return 0;
+                }
+                break;
+            case OPT_POLL_IDS:
+                if (sscanf(optarg,"%d-%d", &aux[0], &aux[1]) == 1)
+                    aux[1] = aux[0];
+                if (aux[0] < 1 || aux[1] > 127 || aux[0] > aux[1]) {
+                    puts("Polling IDs must be a range in [1 - 127], e.g. 1-32.");
+                    return 0;
+                }
+                global_args.poll_first_id = aux[0];
+                global_args.poll_last_id = aux[1];
+                break;
+            case OPT_POLL_TABLE:
+                sscanf(optarg, "%254s", global_args.poll_table);
+                break;
+            case OPT_POLL_TIMEOUT:
+                sscanf(optarg,"%d", &global_args.poll_timeout);
+                if (global_args.poll_timeout <= 0)
+                    global_args.poll_timeout = POLL_DEFAULT_TIMEOUT;
+                break;
+            case OPT_RESCAN:
+                global_args.flag_rescan = 1;
+                break;
+            case OPT_RT_PRIORITY:
+                sscanf(optarg,"%d", &global_args.rt_priority);
+                break;
+            case OPT_RT_CPU:
+                sscanf(optarg,"%d", &global_args.rt_cpu);
+                break;
+            case OPT_CONVERT_TRAJ:
+            {
+                // file.csv -> file.qbt, no device needed
+                char bin_name[255];
+                char* extension;
+                int rows;
+
+                // room for the extension
+                snprintf(bin_name, sizeof(bin_name) - 4, "%s", optarg);
+                extension = strrchr(bin_name, '.');
+                if (extension != NULL)
+                    *extension = '\0';
+                strcat(bin_name, ".qbt");
+
+                rows = traj_convert(optarg, bin_name);
+                if (rows < 0)
+                    return 0;
+                printf("%d values written in %s\n", rows, bin_name);
+                return 1;
+            }
+            case OPT_PERIOD_US:
+                sscanf(optarg,"%lld", &global_args.stream_period);
+                if (global_args.stream_period < 0)
+                    global_args.stream_period = 0;
+                global_args.flag_stream = 1;
+                break;
+            case OPT_CHANNELS:
+                snprintf(global_args.stream_channels, sizeof(global_args.stream_channels), "%s", optarg);
+                global_args.flag_stream = 1;
+                break;
+            case OPT_OUTPUT:
+                snprintf(global_args.stream_output, sizeof(global_args.stream_output), "%s", optarg);
+                break;
+            case OPT_BINARY:
+                global_args.flag_stream_binary = 1;
+                break;
+            case OPT_SAMPLES:
+                sscanf(optarg,"%ld", &global_args.stream_samples);
+                break;
+            case OPT_DEVICES:
+                if (bus_parse_devices(&chain, optarg) < 1)
+                    return 0;
+                break;
+            case OPT_PORT:
+                if (num_workers == PORT_MAX_WORKERS) {
+                    printf("Too many ports, max %d\n", PORT_MAX_WORKERS);
+                    return 0;
+                }
+                if (port_parse(&workers[num_workers], optarg))
+                    return 0;
+                num_workers++;
+                break;
+            case OPT_PORTS:
+                num_workers = port_load_conf(workers, num_workers, QBPORTS_FILE);
+                if (num_workers < 1)
+                    return 0;
+                break;
+            case OPT_PUBLISH:
+                snprintf(global_args.publish_name, sizeof(global_args.publish_name), "%s", optarg);
+                global_args.flag_publish = 1;
+                break;
+            case OPT_SUBSCRIBE:
+                // reader of another qbadmin, no device needed
+                return subscribe_telemetry(optarg);
+            case OPT_BENCHMARK:
+                sscanf(optarg,"%ld", &global_args.benchmark_iterations);
+                if (global_args.benchmark_iterations < 1) {
+                    puts("The benchmark needs at least 1 iteration");
+                    return 0;
+                }
+                break;
+            case OPT_JSON:
+                global_args.flag_json = 1;
+                break;
+            case OPT_CAPTURE:
+                snprintf(global_args.capture_file, sizeof(global_args.capture_file), "%s", optarg);
+                break;
+            case OPT_METRICS:
+                snprintf(global_args.metrics_target, sizeof(global_args.metrics_target), "%s", optarg);
+                break;
+            case OPT_EXPORT_LOG:
+            {
+                // file_log.qbl -> file_log.csv, no device needed
+                char csv_name[255];
+                char* extension;
+                long records;
+
+                // room for the extension
+                snprintf(csv_name, sizeof(csv_name) - 4, "%s", optarg);
+                extension = strrchr(csv_name, '.');
+                if (extension != NULL)
+                    *extension = '\0';
+                strcat(csv_name, ".csv");
+
+                records = async_log_export(optarg, csv_name);
+                if (records < 0)
+                    return 0;
+                printf("%ld records written in %s\n", records, csv_name);
+                return 1;
+            }
             case 'h':
             case '?':
             default:
@@ -443,6 +753,51 @@ int main (int argc, char **argv)
         return 0;
     }
 
+    //====================================================     getting device id
+
+    // The device ID is needed before opening the port to pick its baud rate
+    // from the device inventory
+
+    if (argc - optind == 1)
+    {
+        sscanf(argv[optind++],"%d",&global_args.device_id);
+        if(global_args.flag_verbose)
+            printf("Device ID:%d\n", global_args.device_id);
+    }
+    else if (chain.num_devices > 0)
+        global_args.device_id = chain.devices[0].id;
+    else if(global_args.flag_verbose)
+        puts("No device ID was chosen. Running in broadcasting mode.");
+
+    //==============================================================     metrics
+
+    // Every qbAPI call from now on is counted, see qbmetered.h
+
+    if (strcmp(global_args.metrics_target, ""))
+    {
+        if (metrics_start(global_args.metrics_target))
+            return 0;
+        // also run by exit() in the CTRL-C handlers, a file gets the last values
+        atexit(metrics_stop);
+
+        if(global_args.flag_verbose)
+            printf("Exporting metrics to %s\n", global_args.metrics_target);
+    }
+
+    //================================================================     multi port
+
+    // Every port has its own thread, nothing else runs
+
+    // the search and the workers open the serial port, qbadmind owns it
+    if ((num_workers > 0 || global_args.flag_polling) && qbclient_running()) {
+        printf("qbadmind is running on %s, stop it to search the devices or to use --port.\n",
+                qbclient_socket_path());
+        return 0;
+    }
+
+    if (num_workers > 0)
+        return run_workers();
+
     //==================================================================     polling
     
     if (global_args.flag_polling)
@@ -458,16 +813,52 @@ int main (int argc, char **argv)
         }
     }
 
-    //====================================================     getting device id
+    //==============================================================     capture
 
-    if (argc - optind == 1)
+    // Everything written and read from now on goes through the proxy
+
+    if (strcmp(global_args.capture_file, ""))
     {
-        sscanf(argv[optind++],"%d",&global_args.device_id);
+        if (capture_start(&capture_writer, &comm_settings_1, global_args.capture_file, port_baudrate))
+            return 0;
+        // also run by exit() in the CTRL-C handlers
+        atexit(stop_capture);
+
         if(global_args.flag_verbose)
-            printf("Device ID:%d\n", global_args.device_id);
+            printf("Capturing the serial traffic in %s\n", global_args.capture_file);
+    }
+
+    //============================================================     benchmark
+
+    // Nothing else runs, the series would disturb each other
+
+    if(global_args.benchmark_iterations)
+    {
+        if (!global_args.device_id) {
+            puts("The benchmark needs a device ID");
+            return 0;
+        }
+
+        if(global_args.flag_verbose)
+            fprintf(stderr, "Benchmarking device %d, %ld requests per command.\n",
+                    global_args.device_id, global_args.benchmark_iterations);
+
+        signal(SIGINT, int_handler_7);
+
+        benchmark.baudrate = port_baudrate;
+        if (bench_run(&benchmark, &comm_settings_1, global_args.device_id, global_args.benchmark_iterations)) {
+            puts("Not enough memory for the benchmark");
+            return 0;
+        }
+
+        if (global_args.flag_json)
+            bench_print_json(&benchmark, stdout);
+        else
+            bench_print(&benchmark, stdout);
+
+        bench_free(&benchmark);
+        return 1;
     }
-    else if(global_args.flag_verbose)
-        puts("No device ID was chosen. Running in broadcasting mode.");
 
     //=================================================================     ping
 
@@ -599,146 +990,9 @@ int main (int argc, char **argv)
         fprintf(stdout, " OK\n");
 
 
-        int mkdirRet = 0;
-#if !(defined(_WIN32) || defined(_WIN64))
-        mkdirRet = mkdir(SD_FS_FOLDER, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
-#else
-        mkdirRet = mkdir(SD_FS_FOLDER);
-#endif         
-       
-        if (mkdirRet == 0){
-    
-            // Parse
-            char path[100] = "";
-            int n_files = 0;
-            int n_bytes = 0;
-            int n_bytes_local = 0;
-            char local_str[100] = "";
-            char user[10] = "";
-            char year[10] = "";
-            char month[10] = "";
-            char day[10] = "";
-            char lastUser[10] = "";
-            char saveUser = 0;
-
-            char sepChar[2] = "";
-#if !(defined(_WIN32) || defined(_WIN64))
-            strcpy(sepChar, "/");
-#else
-            strcpy(sepChar, "\\");
-#endif       
-
-            strncpy(local_str, str_folder_tree, strlen(str_folder_tree));
-            do {
-                sscanf(local_str, "%100[^,],%d\r\n%n", path, &n_files, &n_bytes_local);
-                sscanf(path, "\\%10[^\\]\\%10[^\\]\\%10[^\\]\\%10[^\\]", user, year, month, day);
-                //printf("%s %d %d\n", path, n_files, n_bytes_local);    
-                //printf("%s %s %s %s %d %d\n", user, year, month, day, n_files, n_bytes_local); 
-
-                if (strcmp(user, lastUser)){
-
-                    printf("\nDo you want to save the files of user %s (y/n)? ", user);
-                    saveUser = 0;
-                    fflush(stdin);
-                    scanf("%c", &saveUser);
-                
-                }
-
-                if (saveUser == 'y' or saveUser == 'Y'){
-
-                    // Create each folder and move inside it
-                    char f_mkdir_path[100] = "";
-                    strcpy(f_mkdir_path, SD_FS_FOLDER);
-
-    #if !(defined(_WIN32) || defined(_WIN64))
-                    strcat(f_mkdir_path, user);
-                    mkdir(f_mkdir_path, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);            // create user folder
-                    strcat(f_mkdir_path, sepChar);
-                    strcat(f_mkdir_path, year);
-                    mkdir(f_mkdir_path, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);            // create year folder
-                    strcat(f_mkdir_path, sepChar);
-                    strcat(f_mkdir_path, month);
-                    mkdir(f_mkdir_path, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);            // create month folder
-                    strcat(f_mkdir_path, sepChar);
-                    strcat(f_mkdir_path, day);
-                    mkdir(f_mkdir_path, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);            // create day folder
-    #else
-                    strcat(f_mkdir_path, user);
-                    mkdir(f_mkdir_path);            // create user folder
-                    strcat(f_mkdir_path, sepChar);
-                    strcat(f_mkdir_path, year);
-                    mkdir(f_mkdir_path);            // create year folder
-                    strcat(f_mkdir_path, sepChar);
-                    strcat(f_mkdir_path, month);
-                    mkdir(f_mkdir_path);            // create month folder
-                    strcat(f_mkdir_path, sepChar);
-                    strcat(f_mkdir_path, day);
-                    mkdir(f_mkdir_path);            // create day folder
-    #endif
-
-                    // Download every file in the folder
-                    for (int i = 0; i < n_files; i++){
-
-                        char str_data[20000] = "";
-                        char fw_path[100] = "";
-                        char filename_path[1000] = "";
-                        char filename[20] = "";
-                        strcpy(fw_path,  path);
-                        strcat(fw_path, "\\");  // Add this separator for SD filesystem
-
-                        if (i %2 == 0){
-                            sprintf(filename, "Param_%d.csv", i/2);    
-                        }
-                        else {
-                            sprintf(filename, "UseStats_%d.csv", i/2);
-                        }
-                        strcat(fw_path, filename);
-                       
-                        fprintf(stdout, "Getting the file %s ", fw_path);
-                        fflush(stdout);
-
-                        strcpy(str_data, "");
-                        int ret;
-                        do{
-                            ret = commGetSDFile(&comm_settings_1, global_args.device_id, fw_path, str_data);
-                            usleep(500000);
-                            fprintf(stdout, ".");
-                            fflush(stdout);
-                        } while(!strcmp(str_data, ""));
-
-                        fprintf(stdout, " OK\n");
-
-                        if (!ret){
-
-                            //printf("File content: %s\n", str_data);
-            
-                            strcat(filename_path, f_mkdir_path);
-                            strcat(filename_path, sepChar);
-                            strcat(filename_path, filename);
-                            global_args.SD_data_file = fopen(filename_path, "w");
-                            fprintf(global_args.SD_data_file, "%s", str_data);
-                            fclose(global_args.SD_data_file);
-
-                        }
-                        else
-                            break;
-                    }
-
-                    printf("Done\n");
-                }
-
-                strcpy(lastUser, user);              
-    
-                n_bytes += n_bytes_local;
-                strncpy(local_str, str_folder_tree + n_bytes, strlen(str_folder_tree) - n_bytes);            
-
-            } while(strlen(str_folder_tree) - n_bytes > 0);
-                
+        // Only new or changed files are downloaded, see sd_sync.h
+        if (!sd_sync(&comm_settings_1, global_args.device_id, str_folder_tree, SD_FS_FOLDER))
             printf("SD filesystem has been saved in %s folder\n", SD_FS_FOLDER);
-        }
-        else {
-            printf("Error in creating SD filesystem folder. Maybe you have to remove the old SD_card folder in qbadmin path first");   
-        }                   
 
         if(global_args.flag_verbose)
             puts("Closing the application.");
@@ -784,13 +1038,74 @@ int main (int argc, char **argv)
     }
 
 
+//=======================================================     stream of channels
+
+    if(global_args.flag_stream)
+    {
+        // without --channels, stream the channels of the console options
+        if (!strcmp(global_args.stream_channels, "")) {
+            if (global_args.flag_get_measurements)
+                strcat(global_args.stream_channels, "g,");
+            if (global_args.flag_get_velocities)
+                strcat(global_args.stream_channels, "i,");
+            if (global_args.flag_get_accelerations)
+                strcat(global_args.stream_channels, "o,");
+            if (global_args.flag_get_currents)
+                strcat(global_args.stream_channels, "c,");
+            if (!strcmp(global_args.stream_channels, ""))
+                strcpy(global_args.stream_channels, "g");
+        }
+
+        stream.num_channels = 0;
+        if (sampler_add_channels(&stream, global_args.stream_channels))
+            return 0;
+
+        // stdout may carry the stream, everything else goes to stderr
+        if (strcmp(global_args.stream_output, "-"))
+            stream.out = fopen(global_args.stream_output, global_args.flag_stream_binary ? "wb" : "w");
+        else
+            stream.out = stdout;
+        if (stream.out == NULL) {
+            perror("Error opening output file");
+            return 0;
+        }
+
+        stream.binary = global_args.flag_stream_binary;
+        stream.period = global_args.stream_period;
+        stream.max_samples = global_args.stream_samples;
+        stream.stop = 0;
+        stream.pub = NULL;
+
+        if (global_args.flag_publish) {
+            if (open_publisher(SAMPLER_MAX_VALUES))
+                return 0;
+            stream.pub = &pub;
+        }
+
+        signal(SIGINT, int_handler_4);
+
+        if(global_args.flag_verbose)
+            fprintf(stderr, "Streaming %s every %lld usec.\n", global_args.stream_channels, stream.period);
+
+        rt_sched_setup(global_args.rt_priority, global_args.rt_cpu);
+
+        if (sampler_run(&stream, &comm_settings_1, global_args.device_id) == 0)
+            sampler_print(&stream, stderr);
+
+        if (stream.out != stdout)
+            fclose(stream.out);
+    }
+
 //=========================================================     get measurements
 
-    if(global_args.flag_get_measurements)
+    if(global_args.flag_get_measurements && !global_args.flag_stream)
     {
         if(global_args.flag_verbose)
             puts("Getting measurements.");
 
+        if (global_args.flag_publish && open_publisher(4))
+            return 0;
+
         while(1) {
             sensor_num = commGetMeasurements(&comm_settings_1, global_args.device_id, global_args.measurements);
 
@@ -799,6 +1114,8 @@ int main (int argc, char **argv)
                 break;
             }
             else {
+                telemetry_publish_short(&pub, 'g', global_args.measurements, sensor_num);
+
                 printf("measurements:     ");
                 for (i = 0; i < sensor_num; i++) {
                     printf("%d  ", (int)global_args.measurements[i]);
@@ -813,7 +1130,7 @@ int main (int argc, char **argv)
 
 //===========================================================     get velocities
 
-    if(global_args.flag_get_velocities)
+    if(global_args.flag_get_velocities && !global_args.flag_stream)
     {
         if(global_args.flag_verbose)
             puts("Getting velocities.");
@@ -840,7 +1157,7 @@ int main (int argc, char **argv)
 
 //===========================================================     get accelerations
 
-    if(global_args.flag_get_accelerations)
+    if(global_args.flag_get_accelerations && !global_args.flag_stream)
     {
         if(global_args.flag_verbose)
             puts("Getting accelerations.");
@@ -927,13 +1244,17 @@ int main (int argc, char **argv)
 
 //==========================================================     get_currents
 
-    if(global_args.flag_get_currents)
+    if(global_args.flag_get_currents && !global_args.flag_stream)
     {
         if(global_args.flag_verbose)
             puts("Getting currents.");
 
+        if (global_args.flag_publish && open_publisher(2))
+            return 0;
+
         while(1) {
             commGetCurrents(&comm_settings_1, global_args.device_id, global_args.currents);
+            telemetry_publish_short(&pub, 'c', global_args.currents, 2);
 
             printf("Current 1: %hd\t Current 2: %hd\n", global_args.currents[0], global_args.currents[1]);
             fflush(stdout);
@@ -954,6 +1275,9 @@ int main (int argc, char **argv)
             puts("Getting emg signals.");
         }
 
+        if (global_args.flag_publish && open_publisher(2))
+            return 0;
+
         signal(SIGINT, int_handler_3);
         global_args.emg_file = fopen(EMG_SAVED_VALUES, "w");
 
@@ -968,6 +1292,7 @@ int main (int argc, char **argv)
                 puts("An error occurred or the device has no EMG functionality");
                 break;
             }
+            telemetry_publish_short(&pub, 'q', global_args.emg, 2);
             if(global_args.flag_verbose) {
                 printf("Signal 1: %d\t Signal 2: %d\n", global_args.emg[0], global_args.emg[1]);
             }
@@ -1073,31 +1398,37 @@ int main (int argc, char **argv)
     if(global_args.flag_use_gen_sin)
     {
         //variable declaration
-        float delta_t;                      // milliseconds between values
-        float amplitude_1, amplitude_2;     // sinusoid amplitude
-        float bias_1, bias_2;               // sinusoid bias
-        float freq_1, freq_2;               // sinusoid frequency
-        float period_1, period_2;           // sinusoid period = 1/frequency
-        float phase_shift;                  // angular shift between sinusoids
-        float total_time;                   // total execution time (if 0 takes
+        double delta_t = 0;                 // milliseconds between values
+        double amplitude_1 = 0, amplitude_2 = 0;    // sinusoid amplitude
+        double bias_1 = 0, bias_2 = 0;      // sinusoid bias
+        double freq_1 = 0, freq_2 = 0;      // sinusoid frequency
+        double phase_shift = 0;             // angular shift between sinusoids
+        double total_time = 0;              // total execution time (if 0 takes
                                             //   number of values as parameter)
-        int num_values;                     // number of values (ignored if
+        double working_cycle = 0;           // seconds of motion in every duty cycle
+        double pause_cycle = 0;             // seconds of rest in every duty cycle
+                                            //   (no duty cycling if one is 0)
+        int num_values = 0;                 // number of values (ignored if
                                             //   total time != 0)
 
-        float angle_1 = 0;                  // actual angle
-        float angle_2 = 0;                  // actual angle
-        float inc_1, inc_2;                 // angle increment for every step
+        double t;                           // time of the current value [s]
+        double phase_1, phase_2;            // phase computed from the tick index
+        char line[255];
+        char key[100];
+        double value;
 
-        struct timeval t_act, begin, end;
-        struct timezone foo;
+        rt_sched sched;
+        long long elapsed;
 
         int error_counter = 0;
-        int do_once = 1;
         int sensor_num = 0;
+        log_record record = {0};
 
         if(global_args.flag_log) {
-            strcpy(global_args.log_file, "sin_log.csv");
-            global_args.log_file_fd = fopen(global_args.log_file, "w");
+            strcpy(global_args.log_file, "sin_log.qbl");
+            if (async_log_open(&log_writer, global_args.log_file, ASYNC_LOG_SIN,
+                    "t(ms)\t I[0],\tI[1],\tM[0],\tM[1],\tM[2],\tC[0],\tC[1]\n"))
+                return 0;
         }
 
         // CTRL-C handler
@@ -1112,54 +1443,60 @@ int main (int argc, char **argv)
         filep = fopen(SIN_FILE, "r");
         if (filep == NULL) {
             printf("Failed opening file\n");
+            return 0;
         }
 
-        fscanf(filep, "delta_t %f\n", &delta_t);
-        fscanf(filep, "amplitude_1 %f\n", &amplitude_1);
-        fscanf(filep, "amplitude_2 %f\n", &amplitude_2);
-        fscanf(filep, "bias_1 %f\n", &bias_1);
-        fscanf(filep, "bias_2 %f\n", &bias_2);
-        fscanf(filep, "freq_1 %f\n", &freq_1);
-        fscanf(filep, "freq_2 %f\n", &freq_2);
-        fscanf(filep, "phase_shift %f\n", &phase_shift);
-        fscanf(filep, "total_time %f\n", &total_time);
-        fscanf(filep, "num_values %d\n", &num_values);
+        // every line is "key value", in any order
+        while (fgets(line, sizeof(line), filep)) {
+            if (sscanf(line, "%99s %lf", key, &value) != 2)
+                continue;
+
+            if (!strcmp(key, "delta_t"))            delta_t = value;
+            else if (!strcmp(key, "amplitude_1"))   amplitude_1 = value;
+            else if (!strcmp(key, "amplitude_2"))   amplitude_2 = value;
+            else if (!strcmp(key, "bias_1"))        bias_1 = value;
+            else if (!strcmp(key, "bias_2"))        bias_2 = value;
+            else if (!strcmp(key, "freq_1"))        freq_1 = value;
+            else if (!strcmp(key, "freq_2"))        freq_2 = value;
+            else if (!strcmp(key, "phase_shift"))   phase_shift = value;
+            else if (!strcmp(key, "total_time"))    total_time = value;
+            else if (!strcmp(key, "working_cycle")) working_cycle = value;
+            else if (!strcmp(key, "pause_cycle"))   pause_cycle = value;
+            else if (!strcmp(key, "num_values"))    num_values = (int)value;
+            else printf("Unknown key %s in %s\n", key, SIN_FILE);
+        }
 
         // closing file
         fclose(filep);
 
+        if (delta_t <= 0) {
+            printf("delta_t must be positive in %s\n", SIN_FILE);
+            return 0;
+        }
+
         // if total_time set, calculate num_values
         if (total_time != 0) {
             num_values = (total_time*1000)/delta_t;
             printf("Num_values: %d\n", num_values);
         }
 
-        // calculate periods
-        period_1 = 1/freq_1;
-        period_2 = 1/freq_2;
-
         // deg to rad
         phase_shift = phase_shift * PI / 180.0;
 
-        // calculate increment for every step
-        inc_1 = (2 * PI) / (period_1 / (delta_t / 1000.0));
-        inc_2 = (2 * PI) / (period_2 / (delta_t / 1000.0));
-
         // activate motors
         commActivate(&comm_settings_1, global_args.device_id, 1);
 
-        // retrieve begin time
-        gettimeofday(&begin, &foo);
+        rt_sched_setup(global_args.rt_priority, global_args.rt_cpu);
+        rt_sched_start(&sched, (long long)(delta_t * 1000000.0));
 
         for(i=0; i<num_values; i++) {
             // wait for next value
-            while (1) {
-                gettimeofday(&t_act, &foo);
-                if (timevaldiff(&begin, &t_act) >= i * delta_t * 1000) {
-                    break;
-                }
-            }
-            printf("Time: %ld\n", timevaldiff(&begin, &t_act));
+            rt_sched_wait(&sched);
+            elapsed = rt_sched_elapsed(&sched);
+
+            if(global_args.flag_verbose)
+                printf("Time: %lld\n", elapsed);
+
             // update measurements
             sensor_num = commGetMeasurements(&comm_settings_1, global_args.device_id,
                     global_args.measurements);
@@ -1167,39 +1504,41 @@ int main (int argc, char **argv)
                 error_counter++;
             }
 
-            // update inputs
-            global_args.inputs[0] = (sin(angle_1)*amplitude_1 + bias_1);
-            global_args.inputs[1] = (sin(angle_2 + phase_shift)*amplitude_2 + bias_2);
+            // The phase is computed from the tick index, not accumulated,
+            // so it does not drift on long runs
+            t = i * delta_t / 1000.0;
+            phase_1 = 2 * PI * fmod(freq_1 * t, 1.0);
+            phase_2 = 2 * PI * fmod(freq_2 * t, 1.0);
+
+            // update inputs, rest on the bias during the pause of the duty cycle
+            if (working_cycle > 0 && pause_cycle > 0 && fmod(t, working_cycle + pause_cycle) >= working_cycle) {
+                global_args.inputs[0] = bias_1;
+                global_args.inputs[1] = bias_2;
+            }
+            else {
+                global_args.inputs[0] = (sin(phase_1)*amplitude_1 + bias_1);
+                global_args.inputs[1] = (sin(phase_2 + phase_shift)*amplitude_2 + bias_2);
+            }
 
             // set new inputs
             commSetInputs(&comm_settings_1, global_args.device_id, global_args.inputs);
 
-            // update angle position
-            angle_1 += inc_1;
-            angle_2 += inc_2;
-
             //Get currents to save in log file
             commGetCurrents(&comm_settings_1, global_args.device_id, global_args.currents);
             //log file
             if (global_args.flag_log) {
-                if (do_once){
-                    fprintf(global_args.log_file_fd, "t(ms)\t I[0],\tI[1],\tM[0],\tM[1],\tM[2],\tC[0],\tC[1]\n");
-                    do_once = 0;
-                }
-		fprintf(global_args.log_file_fd, "%ld\t", timevaldiff(&begin, &t_act)/1000);
-                fprintf(global_args.log_file_fd, "%d,\t%d\t",
-                    global_args.inputs[0], global_args.inputs[1]);
-                for (k = 0; k < sensor_num; k++) {
-                    fprintf(global_args.log_file_fd, "%d,\t", global_args.measurements[k]);
-                }
-                fprintf(global_args.log_file_fd, "%d,\t%d\n",
-                    global_args.currents[0], global_args.currents[1]);
+                record.time = elapsed;
+                record.sensor_num = sensor_num;
+                memcpy(record.inputs, global_args.inputs, sizeof(record.inputs));
+                memcpy(record.measurements, global_args.measurements, sizeof(record.measurements));
+                memcpy(record.currents, global_args.currents, sizeof(record.currents));
+                async_log_push(&log_writer, &record);
             }
 
         }
 
         // get time at the end of for cycle
-        gettimeofday(&end, &foo);
+        elapsed = rt_sched_elapsed(&sched);
 
         // reset motor  position
         global_args.inputs[0] = 0;
@@ -1207,8 +1546,14 @@ int main (int argc, char **argv)
         commSetInputs(&comm_settings_1, global_args.device_id,
                 global_args.inputs);
 
-        printf("total time (millisec): %f\n", timevaldiff(&begin, &end)/1000.0);
+        printf("total time (millisec): %f\n", elapsed/1000.0);
         printf("Error counter: %d\n", error_counter);
+        rt_sched_print(&sched, stdout);
+
+        if (global_args.flag_log) {
+            async_log_close(&log_writer);
+            printf("Log records dropped: %ld\n", log_writer.dropped);
+        }
 
     }
 
@@ -1218,63 +1563,94 @@ int main (int argc, char **argv)
     if(global_args.flag_file)
     {
         // variable declaration
-        struct timeval t_ref, t_act, begin, end;
-        struct timezone foo;
-        int deltat = 0; //time interval in millisecs
-        int num_values = 0;
-        float** array;
+        rt_sched sched;
+        long long total_time;
+        static traj_reader traj;
+        short int values[TRAJ_MAX_CHANNELS] = {0, 0};
+        int ret;
         char filename[255];
-        char* extension;
         char* name;
         int error_counter = 0;
         int sensor_num = 0;
+        int d, c;
+        char header[255] = "";
+        log_record record = {0};
 
         // VERBOSE ONLY
         if(global_args.flag_verbose) {
             printf("Parsing file %s\n", global_args.filename);
         }
 
-        // parsing file
-        array = file_parser(global_args.filename, &deltat, &num_values);
+        // start streaming the file
+        if (traj_open(&traj, global_args.filename))
+            return 0;
 
         // VERBOSE ONLY
         if(global_args.flag_verbose)
-            printf("Sending %d values with Dt = %d\n", num_values, deltat);
+            printf("Sending %d values with Dt = %d\n", traj.num_values, traj.deltat);
 
         //if log enabled, open file for logging
         if(global_args.flag_log) {
             strcpy(filename, global_args.filename);
             name = strtok(filename, ".");
-            extension = strtok(NULL, ".");
             strcpy(global_args.log_file, name);
-            strcat(global_args.log_file, "_log.");
-            strcat(global_args.log_file, extension);
-            global_args.log_file_fd = fopen(global_args.log_file, "w");
+            strcat(global_args.log_file, "_log.qbl");
         }
 
-        //retrieve current time
-        gettimeofday(&t_ref, &foo);
-        gettimeofday(&begin, &foo);
+        sensor_num = commGetMeasurements(&comm_settings_1, global_args.device_id, global_args.measurements);
+        // first line of log file
+        if (global_args.flag_log) {
+            if (chain.num_devices > 0)
+                strcat(header, "id,\t");
+            for (k = 0; k < sensor_num; k++)
+                sprintf(header + strlen(header), "sensor_%d,\t", (k + 1));
+            strcat(header, "input_1,\tinput_2,\t");
+            strcat(header, "current_1,\tcurrent_2\n");
+
+            if (async_log_open(&log_writer, global_args.log_file,
+                    chain.num_devices > 0 ? ASYNC_LOG_DEVICES : ASYNC_LOG_FILE, header)) {
+                traj_close(&traj);
+                return 0;
+            }
+        }
 
         signal(SIGINT, int_handler);
 
-        
-        sensor_num = commGetMeasurements(&comm_settings_1, global_args.device_id, global_args.measurements);
-        // write first line of log file
-        if (global_args.flag_log) {
-            for (k = 0; k < sensor_num; k++) {
-                    fprintf(global_args.log_file_fd, "sensor_%d,\t", (k + 1));
+        rt_sched_setup(global_args.rt_priority, global_args.rt_cpu);
+
+        // first value at once, then one every deltat milliseconds
+        rt_sched_start(&sched, traj.deltat * 1000000LL);
+
+        while(1) {
+            // next values, or keep the previous ones if the reader is late
+            ret = traj_next(&traj, values);
+            if (ret == 0)
+                break;
+
+            rt_sched_wait(&sched);
+
+            // every device of the chain in the same tick, columns 2d and
+            // 2d+1 of the file go to device d, or 0 and 1 if it has no columns
+            if (chain.num_devices > 0) {
+                for (d = 0; d < chain.num_devices; d++) {
+                    c = (traj.channels >= 2 * (d + 1)) ? 2 * d : 0;
+                    chain.devices[d].inputs[0] = values[c];
+                    chain.devices[d].inputs[1] = values[c + 1];
                 }
-            fprintf(global_args.log_file_fd, "input_1,\tinput_2,\t");
-            fprintf(global_args.log_file_fd, "current_1,\tcurrent_2\n");
-        }
 
-        for(i=0; i<num_values; i++) {
-            while (1) {
-                gettimeofday(&t_act, &foo);
-                if (timevaldiff(&begin, &t_act) >= i*deltat*1000) {
-                    break;
+                error_counter += bus_cycle(&chain, &comm_settings_1);
+
+                if (global_args.flag_log) {
+                    record.time = rt_sched_elapsed(&sched);
+                    for (d = 0; d < chain.num_devices; d++) {
+                        record.id = chain.devices[d].id;
+                        record.sensor_num = chain.devices[d].sensor_num;
+                        memcpy(record.inputs, chain.devices[d].inputs, sizeof(record.inputs));
+                        memcpy(record.measurements, chain.devices[d].measurements, sizeof(record.measurements));
+                        async_log_push(&log_writer, &record);
+                    }
                 }
+                continue;
             }
 
             sensor_num = commGetMeasurements(&comm_settings_1, global_args.device_id, global_args.measurements);
@@ -1286,8 +1662,8 @@ int main (int argc, char **argv)
 
 
             // update inputs
-            global_args.inputs[0] = array[0][i];
-            global_args.inputs[1] = array[1][i];
+            global_args.inputs[0] = values[0];
+            global_args.inputs[1] = values[1];
 
             // set new inputs
             commSetInputs(&comm_settings_1, global_args.device_id,
@@ -1295,39 +1671,47 @@ int main (int argc, char **argv)
 
             // write measurements in log file
             if (global_args.flag_log) {
-                for (k = 0; k < sensor_num; k++) {
-                    fprintf(global_args.log_file_fd, "%d,\t", global_args.measurements[k]);
-                }
-                fprintf(global_args.log_file_fd, "%f,\t%f,\t",
-                    array[0][i], array[1][i]);
-                fprintf(global_args.log_file_fd, "%d,\t%d\n",
-                    global_args.currents[0], global_args.currents[1]);
+                record.time = rt_sched_elapsed(&sched);
+                record.sensor_num = sensor_num;
+                memcpy(record.inputs, global_args.inputs, sizeof(record.inputs));
+                memcpy(record.measurements, global_args.measurements, sizeof(record.measurements));
+                memcpy(record.currents, global_args.currents, sizeof(record.currents));
+                async_log_push(&log_writer, &record);
             }
         }
 
         //get time at the end to verify correct execution
-        gettimeofday(&end, &foo);
+        total_time = rt_sched_elapsed(&sched);
 
 
-        //free dynamically allocated memory in parser
-        free(array[0]);
-        free(array[1]);
-        free(array);
+        //stop the reader thread
+        traj_close(&traj);
 
-        //if necessary close log file
+        //if necessary flush and close log file
         if (global_args.flag_log) {
-            fclose(global_args.log_file_fd);
+            async_log_close(&log_writer);
         }
 
         //at the end, set motors to 0
         usleep(500000);
         global_args.inputs[0] = 0;
         global_args.inputs[1] = 0;
-        commSetInputs(&comm_settings_1, global_args.device_id,
-                global_args.inputs);
+        if (chain.num_devices > 0)
+            bus_zero(&chain, &comm_settings_1);
+        else
+            commSetInputs(&comm_settings_1, global_args.device_id,
+                    global_args.inputs);
 
-        printf("total time (usec): %d\n", (int)timevaldiff(&begin, &end));
+        printf("total time (usec): %lld\n", total_time);
         printf("Error counter %d\n", error_counter);
+        printf("Reader underruns %ld\n", traj.underruns);
+        rt_sched_print(&sched, stdout);
+        if (chain.num_devices > 0) {
+            printf("Cycle time per device:\n");
+            bus_print(&chain, stdout);
+        }
+        if (global_args.flag_log)
+            printf("Log records dropped: %ld\n", log_writer.dropped);
     }
 
 
@@ -1482,6 +1866,9 @@ int main (int argc, char **argv)
 		
 		// Imu values is a (3 sensors x 3 axes + 4 + 1) x n_imu values
 		imu_values = (float *) calloc(global_args.n_imu, 3*3*sizeof(float)+4*sizeof(float)+sizeof(float));
+
+		if (global_args.flag_publish && open_publisher((3*3+4+1)*global_args.n_imu))
+			return 0;
 		
 		if (!new_board && global_args.n_imu > 1){
 			int idx = 0;
@@ -1499,6 +1886,7 @@ int main (int argc, char **argv)
 		while(1){
 			
 			commGetImuReadings(&comm_settings_1, global_args.device_id, global_args.imu_table, global_args.mag_cal, global_args.n_imu, imu_values);
+			telemetry_publish(&pub, 'Q', imu_values, (3*3+4+1)*global_args.n_imu);
 
 			for (i = 0; i < global_args.n_imu; i++) {
 		
@@ -1754,6 +2142,13 @@ int open_port() {
     FILE *file;
     char port[255];
 
+    // qbadmind owns the port when it is running
+    if (qbclient_connect(&comm_settings_1)) {
+        if(global_args.flag_verbose)
+            printf("Connected to qbadmind on %s\n", qbclient_socket_path());
+        return 1;
+    }
+
     file = fopen(QBMOVE_FILE, "r");
 
     if (file == NULL) {
@@ -1765,25 +2160,107 @@ int open_port() {
 
     fclose(file);
 
+    // The inventory knows the baud rate of each device, qbmoveBR.conf is
+    // only a guess valid for the whole bus
+    if (global_args.device_id) {
+        int baudrate = inventory_baudrate(port, global_args.device_id);
+
+        if (baudrate) {
+            if(global_args.flag_verbose)
+                printf("Device %d found in inventory at BaudRate %d.\n", global_args.device_id, baudrate);
+            return open_port_baudrate(&comm_settings_1, port, baudrate);
+        }
+    }
+
+    if (global_args.BaudRate == BAUD_RATE_T_460800)
+        return open_port_baudrate(&comm_settings_1, port, 460800);
+    else
+        return open_port_baudrate(&comm_settings_1, port, 2000000);
+}
+
+//==============================================================================
+//                                                                    multi port
+//==============================================================================
+/** Run -f or the stream of --period_us/--channels on every port given with
+ *  --port or --ports. Each port gets the baud rate of its first device in
+ *  the inventory, or the one of qbmoveBR.conf.
+ */
+int run_workers() {
+    port_job* job = &workers_job;
+    int i;
+
+    if (global_args.flag_file) {
+        job->mode = PORT_JOB_FILE;
+        job->filename = global_args.filename;
+        job->log = global_args.flag_log;
+    }
+    else if (global_args.flag_stream) {
+        if (!strcmp(global_args.stream_channels, ""))
+            strcpy(global_args.stream_channels, "g");
+        job->mode = PORT_JOB_STREAM;
+        job->channels = global_args.stream_channels;
+        job->period = global_args.stream_period;
+        job->max_samples = global_args.stream_samples;
+        job->binary = global_args.flag_stream_binary;
+        job->output = global_args.stream_output;
+    }
+    else {
+        puts("Use --port and --ports with -f or --period_us/--channels.");
+        return 0;
+    }
+
+    job->open_port = open_port_baudrate;
+    job->rt_priority = global_args.rt_priority;
+    job->rt_cpu = global_args.rt_cpu;
+
+    for (i = 0; i < num_workers; i++) {
+        workers[i].baudrate = inventory_baudrate(workers[i].port, workers[i].chain.devices[0].id);
+        if (workers[i].baudrate == 0)
+            workers[i].baudrate = (global_args.BaudRate == BAUD_RATE_T_460800) ? 460800 : 2000000;
+
+        if(global_args.flag_verbose)
+            printf("Port %d: %s at BaudRate %d, %d devices\n", i, workers[i].port,
+                    workers[i].baudrate, workers[i].chain.num_devices);
+    }
+
+    signal(SIGINT, int_handler_5);
+
+    port_run(workers, num_workers, job);
+    port_print(workers, num_workers, stdout);
+
+    return 1;
+}
+
+/** Open port at the given baud rate (460800 or 2000000)
+ */
+int open_port_baudrate(comm_settings* comm_settings_t, const char* port, int baudrate) {
+
+    // never behind the back of qbadmind, which keeps the port at its own
+    // baud rate
+    if (qbclient_running()) {
+        printf("qbadmind is running on %s, stop it to open %s.\n", qbclient_socket_path(), port);
+        return 0;
+    }
 
     #if !(defined(_WIN32) || defined(_WIN64)) && !(defined(__APPLE__)) //only for linux
 
-        if (global_args.BaudRate == BAUD_RATE_T_460800)
-            openRS485(&comm_settings_1, port , B460800);
+        if (baudrate == 460800)
+            openRS485(comm_settings_t, port , B460800);
         else
-            openRS485(&comm_settings_1, port , B2000000);
+            openRS485(comm_settings_t, port , B2000000);
     #else
-        if (global_args.BaudRate == BAUD_RATE_T_460800)
-           openRS485(&comm_settings_1, port , 460800);
+        if (baudrate == 460800)
+           openRS485(comm_settings_t, port , 460800);
         else
-            openRS485(&comm_settings_1, port , 2000000);
+            openRS485(comm_settings_t, port , 2000000);
     #endif
 
-    if(comm_settings_1.file_handle == INVALID_HANDLE_VALUE)
+    if(comm_settings_t->file_handle == INVALID_HANDLE_VALUE)
     {
         puts("Couldn't connect to the serial port.");
         return 0;
     }
+    port_baudrate = baudrate;
     usleep(100000);
 
     return 1;
@@ -1793,14 +2270,27 @@ int open_port() {
 //==============================================================================
 //                                                                       polling
 //==============================================================================
-
+/** Search the devices connected to the serial port. Both baud rates are
+ *  scanned unless --poll_baudrate is given, over the IDs chosen with
+ *  --poll_ids. With --poll_table the device table is also written as CSV
+ *  (id, baudrate, sensor_num, meas_1..meas_4, latency_us).
+ *
+ *  A full scan is saved in the device inventory. The next full searches on
+ *  the same port only ping the devices of the inventory, and scan the bus
+ *  again if one of them does not answer, if the inventory is older than
+ *  INVENTORY_MAX_AGE or if --rescan is given.
+ */
 int polling() {
     FILE *file;
+    FILE *table = NULL;
     char port[255];
-    bool device_number = false;
-    short int meas[3];
-    int i, id;
-    int sensor_num = 0;
+    struct poll_device devices[128];
+    struct inventory_entry* inventory;
+    int num_inventory = 0;
+    int baudrates[2] = {460800, 2000000};
+    int full_scan;
+    int num_devices;
+    int i, b;
 
     file = fopen(QBMOVE_FILE, "r");
 
@@ -1813,114 +2303,456 @@ int polling() {
 
     fclose(file);
 
-#if !(defined(_WIN32) || defined(_WIN64)) && !(defined(__APPLE__)) //only for linux
-    openRS485(&comm_settings_1, port , B460800);
-#else
-    openRS485(&comm_settings_1, port , 460800);
-#endif
+    if (!strcmp(global_args.poll_table, "-"))
+        table = stdout;
+    else if (strcmp(global_args.poll_table, "")) {
+        table = fopen(global_args.poll_table, "w");
+        if (table == NULL) {
+            printf("Error opening file %s\n", global_args.poll_table);
+            return 0;
+        }
+    }
 
-        // Scan for 460800 Baud Rate devices
-        printf("Devices Connect: BaudRate = 460800\n");
-        printf("ID\tPos1\tPos2\tPosL\n");
-        printf("=============================\n");
+    if (table != NULL)
+        fprintf(table, "id,baudrate,sensor_num,meas_1,meas_2,meas_3,meas_4,latency_us\n");
 
-        for (id = 1; id < 128; ++id){
-            sensor_num = commGetMeasurements(&comm_settings_1, id, meas);
-            if (sensor_num > 0){
+    full_scan = !global_args.poll_baudrate && global_args.poll_first_id == 1 && global_args.poll_last_id == 127;
 
-                printf("%d\t", id);
-                for (i = 0; i < sensor_num; ++i) 
-                    printf("%d\t", (int) meas[i]);
+    if (full_scan && !global_args.flag_rescan) {
+        if (poll_verify(port, table)) {
+            if (table != NULL && table != stdout)
+                fclose(table);
+            return 1;
+        }
+    }
 
-                printf("\n");
+    inventory = (struct inventory_entry*) calloc(2 * 128, sizeof(struct inventory_entry));
+
+    for (b = 0; b < 2; b++) {
+        if (global_args.poll_baudrate && global_args.poll_baudrate != baudrates[b])
+            continue;
+
+        if (!open_port_baudrate(&comm_settings_1, port, baudrates[b])) {
+            free(inventory);
+            return 0;
+        }
+
+        num_devices = poll_scan(&comm_settings_1, baudrates[b], global_args.poll_first_id,
+                global_args.poll_last_id, devices);
+
+        // Firmware info of every device for the inventory
+        if (full_scan) {
+            char info[10000];
 
-                device_number = true;
+            for (i = 0; i < num_devices; i++) {
+                strcpy(info, "");
+                commGetInfo(&comm_settings_1, devices[i].id, INFO_ALL, info);
+                inventory[num_inventory].id = devices[i].id;
+                inventory[num_inventory].baudrate = baudrates[b];
+                inventory_escape(info, inventory[num_inventory].info, INVENTORY_INFO_LEN);
+                num_inventory++;
             }
         }
-        if (device_number)
-            printf("-----------------------------\n");
-        else
-            printf("NO DEVICE FOUND!\n\n");
 
-    closeRS485(&comm_settings_1);
+        closeRS485(&comm_settings_1);
 
-#if !(defined(_WIN32) || defined(_WIN64)) && !(defined(__APPLE__)) //only for linux
-    openRS485(&comm_settings_1, port , B2000000);
-#else
-    openRS485(&comm_settings_1, port , 2000000);
-#endif
+        poll_print(table, baudrates[b], devices, num_devices);
+    }
 
-        device_number = false;
+    if (full_scan) {
+        if (inventory_save(port, inventory, num_inventory) && global_args.flag_verbose)
+            printf("Device inventory saved in %s\n", QBINVENTORY_FILE);
+    }
 
-        // Scan for 2000000 Baud Rate devices
-        printf("Devices Connect: BaudRate = 2000000\n");
-        printf("ID\tPos1\tPos2\tPosL\n");
-        printf("=============================\n");
+    free(inventory);
 
-        for (id = 1; id < 128; ++id){
-            sensor_num = commGetMeasurements(&comm_settings_1, id, meas);
-            if (sensor_num > 0){
+    if (table != NULL && table != stdout)
+        fclose(table);
 
-                printf("%d\t", id);
-                for (i = 0; i < sensor_num; ++i) 
-                    printf("%d\t", (int) meas[i]);
+    return 1;
+}
 
-                printf("\n");
+/** Print the devices found at one baud rate, as a table on the console
+ *  and as CSV rows if table is not NULL
+ */
+void poll_print(FILE* table, int baudrate, struct poll_device* devices, int num_devices) {
+    int i, j;
 
-                device_number = true;
-            }
+    // Human readable table, unless the CSV table goes to stdout
+    if (table != stdout) {
+        printf("Devices Connect: BaudRate = %d\n", baudrate);
+        printf("ID\tPos1\tPos2\tPosL\n");
+        printf("=============================\n");
+
+        for (i = 0; i < num_devices; i++) {
+            printf("%d\t", devices[i].id);
+            for (j = 0; j < devices[i].sensor_num; ++j)
+                printf("%d\t", (int) devices[i].measurements[j]);
+            printf("\n");
         }
-        if (device_number)
+
+        if (num_devices)
             printf("-----------------------------\n");
         else
             printf("NO DEVICE FOUND!\n\n");
-    
-    closeRS485(&comm_settings_1);
+    }
 
-    if(comm_settings_1.file_handle == INVALID_HANDLE_VALUE)
-    {
-        puts("Couldn't connect to the serial port.");
+    if (table != NULL) {
+        for (i = 0; i < num_devices; i++) {
+            fprintf(table, "%d,%d,%d", devices[i].id, devices[i].baudrate, devices[i].sensor_num);
+            for (j = 0; j < 4; j++) {
+                if (j < devices[i].sensor_num)
+                    fprintf(table, ",%d", (int) devices[i].measurements[j]);
+                else
+                    fprintf(table, ",");
+            }
+            fprintf(table, ",%ld\n", devices[i].latency);
+        }
+        fflush(table);
+    }
+}
+
+/** Ping only the devices of the inventory of port. Return 1 and print the
+ *  device table if all of them answered, 0 if the inventory is stale.
+ */
+int poll_verify(const char* port, FILE* table) {
+    struct inventory_entry* inventory;
+    struct poll_device devices[2][128];
+    int num_devices[2] = {0, 0};
+    int baudrates[2] = {460800, 2000000};
+    int num_inventory;
+    long timestamp = 0;
+    int i, b;
+
+    inventory = (struct inventory_entry*) calloc(2 * 128, sizeof(struct inventory_entry));
+
+    num_inventory = inventory_load(port, inventory, &timestamp);
+    if (num_inventory <= 0 || (long)time(NULL) - timestamp > INVENTORY_MAX_AGE) {
+        free(inventory);
         return 0;
     }
-    usleep(100000);
+
+    if(global_args.flag_verbose)
+        printf("Verifying the %d devices of the inventory.\n", num_inventory);
+
+    for (b = 0; b < 2; b++) {
+        int opened = 0;
+
+        for (i = 0; i < num_inventory; i++) {
+            if (inventory[i].baudrate != baudrates[b])
+                continue;
+
+            if (!opened) {
+                if (!open_port_baudrate(&comm_settings_1, port, baudrates[b])) {
+                    free(inventory);
+                    return 0;
+                }
+                opened = 1;
+            }
+
+            if (poll_scan(&comm_settings_1, baudrates[b], inventory[i].id, inventory[i].id,
+                    &devices[b][num_devices[b]]) != 1) {
+                printf("Device %d does not answer, the inventory is stale.\n", inventory[i].id);
+                closeRS485(&comm_settings_1);
+                free(inventory);
+                return 0;
+            }
+            num_devices[b]++;
+        }
+
+        if (opened)
+            closeRS485(&comm_settings_1);
+    }
+
+    free(inventory);
+
+    for (b = 0; b < 2; b++)
+        poll_print(table, baudrates[b], devices[b], num_devices[b]);
 
     return 1;
 }
 
+/** Probe every ID in [first_id, last_id] with a measurements request.
+ *  Probes are sent back to back: each one is given a reply window, but the
+ *  replies are matched by the ID in the packet, so a late answer still
+ *  counts for the device that sent it. The window starts at --poll_timeout
+ *  and shrinks to a few times the slowest latency seen so far once the
+ *  first devices have answered, never below that latency. Garbled bytes
+ *  mean a reply collided with a probe: every ID probed within
+ *  --poll_timeout and not answered yet is probed again, one by one,
+ *  through the qbAPI, since any of them may be the late device.
+ */
+int poll_scan(comm_settings* comm_settings_t, int baudrate, int first_id, int last_id, struct poll_device* found) {
+    int num_found = 0;
+    int sensor_num;
+    int id, i, j;
+    struct timeval t_sent[128], t_act;
+    char seen[128];
+    char disturbed[128];
+
+    memset(seen, 0, sizeof(seen));
+    memset(disturbed, 0, sizeof(disturbed));
+
+#if !(defined(_WIN32) || defined(_WIN64))
+    qbpacket_stream stream;
+    qbpacket pkt;
+    uint8_t probe[QBPACKET_MAX_LEN];
+    uint8_t reply[QBPACKET_MAX_LEN];
+    long window = global_args.poll_timeout * 1000L;
+    long max_latency = 0;
+    long elapsed;
+    int probe_len;
+    int garbage;
+    int last_sent = first_id - 1;
+    int ret;
+
+    qbpacket_stream_init(&stream);
+    tcflush(comm_settings_t->file_handle, TCIOFLUSH);
+
+    // One extra round after the last probe collects late replies
+    for (id = first_id; id <= last_id + 1; id++) {
+        if (id <= last_id) {
+            probe_len = qbpacket_build(probe, id, CMD_GET_MEASUREMENTS, NULL, 0);
+            if (write(comm_settings_t->file_handle, probe, probe_len) != probe_len)
+                break;
+            gettimeofday(&t_sent[id], NULL);
+            last_sent = id;
+        }
+
+        garbage = stream.garbage;
+
+        while (1) {
+            gettimeofday(&t_act, NULL);
+            elapsed = timevaldiff(&t_sent[last_sent], &t_act);
+            if (elapsed >= window)
+                break;
+
+            ret = qbpacket_stream_read(&stream, comm_settings_t->file_handle, window - elapsed, reply, &pkt);
+            if (ret <= 0)
+                break;
+
+            gettimeofday(&t_act, NULL);
+            if (pkt.cmd != CMD_GET_MEASUREMENTS || pkt.id < first_id || pkt.id > last_sent || seen[pkt.id])
+                continue;
+
+            seen[pkt.id] = 1;
+            found[num_found].id = pkt.id;
+            found[num_found].baudrate = baudrate;
+            found[num_found].sensor_num = pkt.data_len / 2;
+            if (found[num_found].sensor_num > 4)
+                found[num_found].sensor_num = 4;
+            for (i = 0; i < found[num_found].sensor_num; i++)
+                found[num_found].measurements[i] = (short int)((pkt.data[2*i] << 8) | pkt.data[2*i + 1]);
+            found[num_found].latency = timevaldiff(&t_sent[pkt.id], &t_act);
+
+            // Adapt the reply window to the devices on this bus
+            if (found[num_found].latency > max_latency)
+                max_latency = found[num_found].latency;
+            window = 3 * max_latency;
+            if (window > global_args.poll_timeout * 1000L)
+                window = global_args.poll_timeout * 1000L;
+            if (window < max_latency)
+                window = max_latency;
+            if (window < POLL_MIN_TIMEOUT * 1000L)
+                window = POLL_MIN_TIMEOUT * 1000L;
+
+            num_found++;
+
+            if (pkt.id == last_sent)
+                break;
+        }
+
+        // the collision can come from any device still due to answer
+        if (stream.garbage != garbage) {
+            gettimeofday(&t_act, NULL);
+            for (i = first_id; i <= last_sent; i++)
+                if (!seen[i] && timevaldiff(&t_sent[i], &t_act) < global_args.poll_timeout * 1000L)
+                    disturbed[i] = 1;
+        }
+    }
+#else
+    for (id = first_id; id <= last_id; id++)
+        disturbed[id] = 1;
+#endif
+
+    // Slow path, one request at a time
+    for (id = first_id; id <= last_id; id++) {
+        if (!disturbed[id] || seen[id])
+            continue;
+
+        gettimeofday(&t_sent[id], NULL);
+        sensor_num = commGetMeasurements(comm_settings_t, id, found[num_found].measurements);
+        gettimeofday(&t_act, NULL);
+
+        if (sensor_num > 0) {
+            seen[id] = 1;
+            found[num_found].id = id;
+            found[num_found].baudrate = baudrate;
+            found[num_found].sensor_num = (sensor_num > 4) ? 4 : sensor_num;
+            found[num_found].latency = timevaldiff(&t_sent[id], &t_act);
+            num_found++;
+        }
+    }
+
+    // Sort by ID
+    for (i = 1; i < num_found; i++) {
+        struct poll_device tmp = found[i];
+        for (j = i; j > 0 && found[j - 1].id > tmp.id; j--)
+            found[j] = found[j - 1];
+        found[j] = tmp;
+    }
+
+    return num_found;
+}
 
 //==============================================================================
-//                                                                   file_parser
+//                                                              device inventory
 //==============================================================================
 
-/** Parse CSV file and return a pointer to a matrix of float dinamically
- *  allocated.  Remember to use free(pointer) in the caller
+/** The inventory file holds, for each serial port, the time of the last full
+ *  polling search and the devices found, one per line:
+ *
+ *      serialport <port> <unix time>
+ *      device <id> <baudrate> <firmware info, newlines escaped as \n>
  */
 
-float** file_parser( char* filename, int* deltat, int* num_values )
-{
-    FILE* filep;
-    float** array = NULL;
+/** Copy src in dst escaping backslashes and line breaks
+ */
+void inventory_escape(const char* src, char* dst, int size) {
+    int i = 0;
+
+    for (; *src && i < size - 2; src++) {
+        if (*src == '\n') {
+            dst[i++] = '\\';
+            dst[i++] = 'n';
+        }
+        else if (*src == '\\') {
+            dst[i++] = '\\';
+            dst[i++] = '\\';
+        }
+        else if (*src != '\r')
+            dst[i++] = *src;
+    }
+    dst[i] = '\0';
+}
+
+/** Load the devices of port, return their number or -1 if port is not in
+ *  the inventory
+ */
+int inventory_load(const char* port, struct inventory_entry* entries, long* timestamp) {
+    FILE* file;
+    char line[INVENTORY_INFO_LEN + 100];
+    char aux_port[255];
+    long aux_time;
+    int in_port = 0;
+    int num = -1;
+    int n_chars;
+
+    file = fopen(QBINVENTORY_FILE, "r");
+    if (file == NULL)
+        return -1;
+
+    while (fgets(line, sizeof(line), file)) {
+        line[strcspn(line, "\r\n")] = '\0';
+
+        // only the age of port, the next section must not overwrite it
+        if (sscanf(line, "serialport %254s %ld", aux_port, &aux_time) == 2) {
+            in_port = !strcmp(aux_port, port);
+            if (in_port) {
+                *timestamp = aux_time;
+                num = 0;
+            }
+        }
+        else if (in_port && num < 2 * 128 &&
+                sscanf(line, "device %d %d %n", &entries[num].id, &entries[num].baudrate, &n_chars) == 2) {
+            strcpy(entries[num].info, line + n_chars);
+            num++;
+        }
+
+        if (!in_port && num >= 0)
+            break;
+    }
+
+    fclose(file);
+
+    return num;
+}
+
+/** Replace the devices of port in the inventory, keep the other ports
+ */
+int inventory_save(const char* port, struct inventory_entry* entries, int num) {
+    FILE* file;
+    char* others = NULL;
+    long others_len = 0;
+    char line[INVENTORY_INFO_LEN + 100];
+    char aux_port[255];
+    long aux_time;
+    int in_port = 0;
     int i;
-    filep = fopen(filename, "r");
-    if (filep == NULL) perror ("Error opening file");
-    else {
-        //read first line
-        fscanf(filep, "%d,%d", deltat, num_values);
 
-        //alloc memory for the arrays
-        array = (float**)malloc(2*sizeof(float*));
-        array[0] = (float*)malloc(*num_values*sizeof(float));
-        array[1] = (float*)malloc(*num_values*sizeof(float));
+    // Keep the sections of the other ports
+    file = fopen(QBINVENTORY_FILE, "r");
+    if (file != NULL) {
+        fseek(file, 0, SEEK_END);
+        others = (char*) malloc(ftell(file) + 1);
+        fseek(file, 0, SEEK_SET);
+
+        while (fgets(line, sizeof(line), file)) {
+            if (sscanf(line, "serialport %254s %ld", aux_port, &aux_time) == 2)
+                in_port = !strcmp(aux_port, port);
+            if (!in_port) {
+                strcpy(others + others_len, line);
+                others_len += strlen(line);
+            }
+        }
+        fclose(file);
+    }
+
+    file = fopen(QBINVENTORY_FILE, "w");
+    if (file == NULL) {
+        printf("Cannot open %s\n", QBINVENTORY_FILE);
+        free(others);
+        return 0;
+    }
+
+    if (others != NULL) {
+        fwrite(others, 1, others_len, file);
+        free(others);
+    }
+
+    fprintf(file, "serialport %s %ld\n", port, (long)time(NULL));
+    for (i = 0; i < num; i++)
+        fprintf(file, "device %d %d %s\n", entries[i].id, entries[i].baudrate, entries[i].info);
+
+    fclose(file);
+
+    return 1;
+}
 
-        //read num_values line of file and store them in array
-        for(i=0; i<*num_values; i++) {
-            fscanf(filep, "%f,%f", &array[0][i], &array[1][i]);
+/** Baud rate of device id on port according to the inventory, 0 if unknown
+ */
+int inventory_baudrate(const char* port, int id) {
+    struct inventory_entry* entries;
+    long timestamp;
+    int baudrate = 0;
+    int num, i;
+
+    entries = (struct inventory_entry*) calloc(2 * 128, sizeof(struct inventory_entry));
+
+    num = inventory_load(port, entries, &timestamp);
+    for (i = 0; i < num; i++) {
+        if (entries[i].id == id) {
+            baudrate = entries[i].baudrate;
+            break;
         }
-    fclose(filep);
     }
-    return array;
+
+    free(entries);
+
+    return baudrate;
 }
 
+
 //==============================================================================
 //                                                          CTRL-C interruptions
 //==============================================================================
@@ -1930,38 +2762,18 @@ float** file_parser( char* filename, int* deltat, int* num_values )
 void int_handler(int sig) {
     printf("\nForced quit!!!\n");
 
-    //if necessary close log file
-    if (global_args.flag_log) {
-        fclose(global_args.log_file_fd);
-
-        // erase last line of log file  /////////////BEGIN
-        const char *tmpfilename = "tmpfile~~~";
-        char line[1000];
-        char command[256];
-        FILE *thefile = fopen(global_args.log_file, "r");
-        FILE *tmpfile = fopen(tmpfilename, "w");
-
-        while (fgets(line, sizeof(line), thefile))
-          if (!feof(thefile))
-            fputs(line, tmpfile);
-
-        fclose(tmpfile);
-        fclose(thefile);
-
-        strcpy(command, "mv ");
-        strcat(command, tmpfilename);
-        strcat(command, " ");
-        strcat(command, global_args.log_file);
-
-        system(command);
-        // erase last line of log file  ///////////////END
-    }
-
     // set motors to 0,0
     global_args.inputs[0] = 0;
     global_args.inputs[1] = 0;
-    commSetInputs(&comm_settings_1, global_args.device_id, global_args.inputs);
+    if (chain.num_devices > 0)
+        bus_zero(&chain, &comm_settings_1);
+    else
+        commSetInputs(&comm_settings_1, global_args.device_id, global_args.inputs);
 
+    // the log is record framed, an interrupted record is ignored by readers
+    if (global_args.flag_log) {
+        async_log_close(&log_writer);
+    }
 
     exit(1);
 }
@@ -2019,6 +2831,131 @@ void int_handler_3(int sig) {
     exit(1);
 }
 
+/** handle CTRL-C interruption 4, the stream ends at the next sample
+*/
+void int_handler_4(int sig) {
+    stream.stop = 1;
+}
+
+/** handle CTRL-C interruption 5, every worker stops at its next tick and
+ *  sets its devices to 0,0
+*/
+void int_handler_5(int sig) {
+    int i;
+
+    workers_job.stop = 1;
+    for (i = 0; i < num_workers; i++)
+        workers[i].stream.stop = 1;
+}
+
+void int_handler_6(int sig) {
+    subscribe_stop = 1;
+}
+
+void int_handler_7(int sig) {
+    benchmark.stop = 1;
+}
+
+//==============================================================================
+//                                                                       capture
+//==============================================================================
+
+void stop_capture() {
+    capture_stop(&capture_writer);
+
+    if(global_args.flag_verbose)
+        fprintf(stderr, "Captured %ld chunks, %lld bytes, in %s\n", capture_writer.records,
+                capture_writer.bytes, global_args.capture_file);
+}
+
+//==============================================================================
+//                                                                     telemetry
+//==============================================================================
+
+int open_publisher(int max_values) {
+    if (telemetry_create(&pub, global_args.publish_name, global_args.device_id, max_values))
+        return -1;
+
+    if(global_args.flag_verbose)
+        printf("Publishing samples in %s\n", pub.name);
+
+    return 0;
+}
+
+/** Follow the head of the ring from the latest sample on. Samples
+ *  overwritten before being read are counted as lost.
+ */
+int subscribe_telemetry(const char* name) {
+    telemetry t;
+    telemetry_slot* slot;
+    uint64_t next, head;
+    long long printed = 0, lost = 0;
+    int idle = 0;
+    int k;
+
+    if (telemetry_open(&t, name))
+        return 0;
+
+    slot = (telemetry_slot*) malloc(t.header->slot_size);
+    next = telemetry_head(&t);
+
+    fprintf(stderr, "%s: device %u, pid %u, %u values per sample\n", t.name,
+            t.header->device_id, t.header->pid, t.header->max_values);
+
+    signal(SIGINT, int_handler_6);
+
+    while (!subscribe_stop) {
+        head = telemetry_head(&t);
+
+        // the writer started over
+        if (head < next)
+            next = head;
+
+        if (head == next) {
+            usleep(1000);
+
+            // a new writer creates a new segment, about once a second see if it did
+            if (++idle % 1000 == 0 && telemetry_replaced(&t)) {
+                telemetry_close(&t);
+                free(slot);
+                if (telemetry_open(&t, name))
+                    return 1;
+                slot = (telemetry_slot*) malloc(t.header->slot_size);
+                next = 0;
+                fprintf(stderr, "%s: new writer, pid %u\n", t.name, t.header->pid);
+            }
+            continue;
+        }
+        idle = 0;
+
+        if (head - next > t.header->num_slots) {
+            lost += head - next - t.header->num_slots;
+            next = head - t.header->num_slots;
+        }
+
+        if (!telemetry_read(&t, next, slot)) {
+            lost++;
+            next++;
+            continue;
+        }
+
+        printf("%llu,%lld,%c", (unsigned long long)next, (long long)slot->time, (char)slot->source);
+        for (k = 0; k < slot->count; k++)
+            printf(",%g", slot->values[k]);
+        printf("\n");
+
+        printed++;
+        next++;
+    }
+
+    fflush(stdout);
+    fprintf(stderr, "Samples: %lld, lost %lld\n", printed, lost);
+
+    free(slot);
+    telemetry_close(&t);
+    return 1;
+}
+
 //==============================================================================
 //                                                                 display usage
 //==============================================================================
@@ -2044,12 +2981,33 @@ void display_usage( void )
     puts(" -W, --set_watchdog               Set up Watchdog ");
     puts("                                  [0 - 500] with step rate of 2 [cs]).");
     puts(" -P, --polling                    Call a polling search.");
+    puts("     --poll_baudrate <value>      Scan only one Baudrate [460800 or 2000000].");
+    puts("     --poll_ids <first-last>      Scan only the IDs in the range (default 1-127).");
+    puts("     --poll_table <file>          Save the devices found as CSV table");
+    puts("                                  (\"-\" writes it to the console).");
+    puts("     --poll_timeout <ms>          Initial reply window of each probe.");
+    puts("     --rescan                     Scan the whole bus even if the device");
+    puts("                                  inventory of the port is up to date.");
     puts(" -B, --baudrate <value>           Set Baudrate communication "); 
     puts("                                  [460800 or 2000000].");
     puts(" -b, --bootloader                 Enter bootloader mode to update firmware.");
     puts(" -v, --verbose                    Verbose mode.");
     puts(" -s, --set_inputs <value,value>   Send reference inputs to the board.");
     puts(" -g, --get_measurements           Get measurements from the board.");
+    puts("     --period_us <usec>           Use with -g, -i, -o, -c to stream them in one");
+    puts("                                  loop with a fixed tick, 0 for as fast as");
+    puts("                                  the bus allows. Rate statistics are");
+    puts("                                  printed at the end on stderr.");
+    puts("     --channels <list>            Channels of the stream with their tick");
+    puts("                                  divisors, e.g. g,i:2,o:4,c:10.");
+    puts("     --output <filename>          Stream destination (default \"-\", stdout).");
+    puts("     --binary                     Stream binary records instead of CSV.");
+    puts("     --samples <n>                Stop the stream after n ticks.");
+    puts("     --publish <name>             Also publish the samples of -g, -c, -q, -Q");
+    puts("                                  and of the stream in the shared memory");
+    puts("                                  segment /name, see telemetry.h (Linux, macOS).");
+    puts("     --subscribe <name>           Print the samples published in /name as");
+    puts("                                  index,time_us,source,values.");
     puts(" -i, --get_velocities             Get velocities from the board.");
     puts(" -o, --get_accelerations          Get accelerations for the board");
     puts(" -c, --get_currents               Get motor currents");
@@ -2070,9 +3028,40 @@ void display_usage( void )
     puts("                                  input1_3,input2_3");
     puts("                                  ...        ...");
     puts("                                  input1_num_rows,input2_num_rows");
-    puts(" -l, --log                        Use in combination with -f to");
+    puts("                                  or a binary file made by --convert_traj");
+    puts("     --convert_traj <filename>    Convert a CSV file for -f to the binary");
+    puts("                                  format, saved as filename.qbt");
+    puts(" -l, --log                        Use in combination with -f or -y to");
     puts("                                  save a log of the positions in");
-    puts("                                  a file named filename_log");
+    puts("                                  a file named filename_log.qbl");
+    puts("     --export_log <filename>      Convert a log saved by -l to CSV,");
+    puts("                                  saved as filename.csv");
+    puts("     --devices <id,id,...>        Use with -f to drive a chain of devices in");
+    puts("                                  the same tick, round-robin on the bus.");
+    puts("                                  Columns 2k and 2k+1 of the file go to the");
+    puts("                                  k-th device, or the first two if the file");
+    puts("                                  has no columns for it.");
+    puts("     --port <port:id,id,...>      Add a serial port and its chain of devices,");
+    puts("                                  may be repeated. Every port runs -f or the");
+    puts("                                  stream in its own thread, all starting on");
+    puts("                                  the same tick. Devices are numbered across");
+    puts("                                  the ports for the columns of -f; streams");
+    puts("                                  read the first device of every port and");
+    puts("                                  are written to output_<n>.");
+    puts("     --ports                      Add the ports of conf_files/qbports.conf,");
+    puts("                                  lines \"serialport <port> <id,id,...>\".");
+    puts("     --benchmark <n>              Send n times every command of the control");
+    puts("                                  loops and print round trip min/p50/p99/max,");
+    puts("                                  sustained rate and errors of each.");
+    puts("     --json                       Print the --benchmark summary as JSON.");
+    puts("     --capture <filename>         Save every chunk of the serial traffic with");
+    puts("                                  its time, for qbsim -r to replay it.");
+    puts("     --metrics <filename|:port>   Count every call of the qbAPI with its latency");
+    puts("                                  histogram, in the Prometheus text format:");
+    puts("                                  the file is rewritten every second, :port");
+    puts("                                  serves them on http://localhost:port.");
+    puts("     --rt_priority <1-99>         Run -f and -y with SCHED_FIFO priority (Linux).");
+    puts("     --cpu <n>                    Pin -f and -y to CPU n (Linux).");
     //puts(" -u, --set_cuff_modality          Activates the Cuff modality if the device is a");
     //puts("                                  Cuff");
     puts("");
@@ -0,0 +1,640 @@
+// ----------------------------------------------------------------------------
+// BSD 3-Clause License
+
+// Copyright (c) 2016, qbrobotics
+// Copyright (c) 2017-2024, Centro "E.Piaggio"
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// POSSIBILITY OF SUCH DAMAGE.
+// ----------------------------------------------------------------------------
+
+/**
+* \file         qbadmind.c
+*
+* \brief        Daemon that owns the serial port and serves the command line
+*               tools over a Unix socket
+* \author       _Centro "E.Piaggio"_
+* \copyright    (C) 2017-2024 Centro "E.Piaggio". All rights reserved.
+*
+* \details      The port is opened once and kept open. qbadmin, qbparam,
+*               nmmi_param and nmmi_param_imu connect to the socket instead
+*               of opening the port (see qbclient.h) and send the same
+*               packets they would write on the bus.
+*
+*               Every client has a queue of requests, served in order. The
+*               bus carries one request at a time: the packet is written,
+*               then the bytes from the bus are forwarded to its client
+*               until the reply is a single complete packet of the device or
+*               the bus stays quiet for DAEMON_REPLY_TIMEOUT. Long replies
+*               (the parameter list, the info, the SD files) come in several
+*               bursts: every byte restarts the timeout, so the next
+*               request is written only once the board has finished.
+*               A client that sends requests faster than the bus serves
+*               them is not read while its queue is full: its writes block
+*               and no request is ever dropped.
+*               Control commands (codes >= 128: inputs, measurements,
+*               currents, ...) are served before parameter and info
+*               requests of other clients, so a parameter read never delays
+*               a control loop by more than one transaction.
+*/
+
+// --- INCLUDE ---
+#include "../../qbAPI/src/qbmove_communications.h"
+#include "definitions.h"
+#include "qbpacket.h"
+#include "qbclient.h"
+#include "rt_sched.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#if !(defined(_WIN32) || defined(_WIN64))
+    #include <errno.h>
+    #include <fcntl.h>
+    #include <signal.h>
+    #include <time.h>
+    #include <termios.h>
+    #include <sys/select.h>
+    #include <sys/socket.h>
+    #include <sys/un.h>
+#endif
+
+#define DAEMON_MAX_CLIENTS      32
+#define DAEMON_QUEUE_LEN        16          ///< Requests queued by a client
+#define DAEMON_REPLY_TIMEOUT    100000      ///< Bus quiet for this long ends a transaction [us]
+#define DAEMON_OUT_LEN          65536       ///< Reply bytes a client has not read yet
+
+#if !(defined(_WIN32) || defined(_WIN64))
+
+struct request {
+    uint8_t data[QBPACKET_MAX_LEN];
+    int len;
+};
+
+struct client {
+    int fd;                                 ///< -1 if the slot is free
+    uint8_t in[2 * QBPACKET_MAX_LEN];       ///< Bytes of a packet still incomplete
+    int in_len;
+    uint8_t out[DAEMON_OUT_LEN];            ///< Bytes of the replies not written yet
+    int out_len;
+    struct request queue[DAEMON_QUEUE_LEN];
+    int head;
+    int count;
+};
+
+/** The transaction on the bus
+ */
+struct transaction {
+    int client;                             ///< -1 if the bus is free, -2 if the client left
+    uint8_t id;
+    uint8_t reply[2 * QBPACKET_MAX_LEN];    ///< Start of the reply, to detect its end
+    int reply_len;
+    long long deadline;                     ///< Moved forward by every byte of the reply
+};
+
+// global variables
+struct client clients[DAEMON_MAX_CLIENTS];
+struct transaction bus;
+comm_settings comm_settings_t;
+int listen_fd = -1;
+int next_client = 0;                        ///< Round robin among the clients
+volatile sig_atomic_t quit = 0;
+int verbose = 0;
+
+long num_control = 0;
+long num_other = 0;
+long num_timeouts = 0;
+
+// function declaration
+int open_port(const char* port, int baudrate);
+int open_socket(const char* path);
+void accept_client();
+void close_client(int i);
+void read_client(int i);
+void queue_requests(int i);
+void flush_client(int i);
+int next_request();
+void start_transaction();
+void read_bus();
+void check_timeout();
+void serve();
+void display_usage();
+void int_handler(int sig);
+
+
+//==============================================================================
+//                                                                     main loop
+//==============================================================================
+
+int main(int argc, char **argv) {
+    char port[255] = "";
+    char socket_path[108];
+    int baudrate = 0;
+    int opt;
+    FILE* file;
+
+    strncpy(socket_path, qbclient_socket_path(), sizeof(socket_path) - 1);
+    socket_path[sizeof(socket_path) - 1] = '\0';
+
+    while ((opt = getopt(argc, argv, "p:b:s:vh")) != -1) {
+        switch (opt) {
+            case 'p':
+                strncpy(port, optarg, sizeof(port) - 1);
+                break;
+            case 'b':
+                sscanf(optarg, "%d", &baudrate);
+                break;
+            case 's':
+                strncpy(socket_path, optarg, sizeof(socket_path) - 1);
+                break;
+            case 'v':
+                verbose = 1;
+                break;
+            default:
+                display_usage();
+                return 0;
+        }
+    }
+
+    // same configuration files as the other tools
+    if (port[0] == '\0') {
+        file = fopen(QBMOVE_FILE, "r");
+        if (file == NULL) {
+            printf("Error opening file %s\n", QBMOVE_FILE);
+            return 0;
+        }
+        fscanf(file, "serialport %254s\n", port);
+        fclose(file);
+    }
+
+    if (baudrate == 0) {
+        file = fopen(QBMOVE_FILE_BR, "r");
+        if (file != NULL) {
+            fscanf(file, "baudrate %d\n", &baudrate);
+            fclose(file);
+        }
+    }
+    if (baudrate != 460800)
+        baudrate = 2000000;
+
+    if (!open_port(port, baudrate))
+        return 0;
+
+    if (!open_socket(socket_path)) {
+        closeRS485(&comm_settings_t);
+        return 0;
+    }
+
+    printf("Serving %s at BaudRate %d on %s\n", port, baudrate, socket_path);
+
+    signal(SIGINT, int_handler);
+    signal(SIGTERM, int_handler);
+    signal(SIGPIPE, SIG_IGN);
+
+    serve();
+
+    printf("Control requests: %ld\n", num_control);
+    printf("Other requests: %ld\n", num_other);
+    printf("Timeouts: %ld\n", num_timeouts);
+
+    close(listen_fd);
+    unlink(socket_path);
+    closeRS485(&comm_settings_t);
+
+    return 0;
+}
+
+
+//==============================================================================
+//                                                                         setup
+//==============================================================================
+
+int open_port(const char* port, int baudrate) {
+    #if !(defined(__APPLE__)) //only for linux
+        openRS485(&comm_settings_t, port, baudrate == 460800 ? B460800 : B2000000);
+    #else
+        openRS485(&comm_settings_t, port, baudrate);
+    #endif
+
+    if (comm_settings_t.file_handle == INVALID_HANDLE_VALUE) {
+        printf("Couldn't connect to the serial port %s.\n", port);
+        return 0;
+    }
+    usleep(100000);
+
+    return 1;
+}
+
+int open_socket(const char* path) {
+    struct sockaddr_un addr;
+    int fd, i;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        printf("Socket path %s too long\n", path);
+        return 0;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    // a socket that refuses connections was left by a daemon that is gone
+    if (!access(path, F_OK)) {
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd >= 0 && !connect(fd, (struct sockaddr*) &addr, sizeof(addr))) {
+            printf("Another qbadmind is serving %s\n", path);
+            close(fd);
+            return 0;
+        }
+        if (fd >= 0)
+            close(fd);
+        unlink(path);
+    }
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0 || bind(listen_fd, (struct sockaddr*) &addr, sizeof(addr)) ||
+            listen(listen_fd, DAEMON_MAX_CLIENTS)) {
+        perror("Cannot open the socket");
+        return 0;
+    }
+
+    for (i = 0; i < DAEMON_MAX_CLIENTS; i++)
+        clients[i].fd = -1;
+    bus.client = -1;
+
+    return 1;
+}
+
+
+//==============================================================================
+//                                                                       clients
+//==============================================================================
+
+void accept_client() {
+    int fd = accept(listen_fd, NULL, NULL);
+    int i;
+
+    if (fd < 0)
+        return;
+
+    for (i = 0; i < DAEMON_MAX_CLIENTS; i++) {
+        if (clients[i].fd < 0) {
+            // replies must never block the daemon
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+            clients[i].fd = fd;
+            clients[i].in_len = 0;
+            clients[i].out_len = 0;
+            clients[i].head = 0;
+            clients[i].count = 0;
+            if (verbose)
+                printf("Client %d connected\n", i);
+            return;
+        }
+    }
+
+    puts("Too many clients");
+    close(fd);
+}
+
+void close_client(int i) {
+    close(clients[i].fd);
+    clients[i].fd = -1;
+
+    // the reply of its transaction is still read from the bus, not forwarded
+    if (bus.client == i)
+        bus.client = -2;
+
+    if (verbose)
+        printf("Client %d disconnected\n", i);
+}
+
+/** Read the bytes of client i, only called while its buffer has room
+ */
+void read_client(int i) {
+    struct client* c = &clients[i];
+    int n;
+
+    n = read(c->fd, c->in + c->in_len, sizeof(c->in) - c->in_len);
+    if (n <= 0) {
+        close_client(i);
+        return;
+    }
+    c->in_len += n;
+
+    queue_requests(i);
+}
+
+/** Split the bytes of client i in packets and queue them. With the queue
+ *  full they stay in the buffer until a request is served.
+ */
+void queue_requests(int i) {
+    struct client* c = &clients[i];
+    struct request* r;
+    qbpacket pkt;
+    int n, used = 0;
+
+    while (used < c->in_len && c->count < DAEMON_QUEUE_LEN) {
+        n = qbpacket_parse(c->in + used, c->in_len - used, &pkt);
+        if (n == 0)
+            break;
+        if (n < 0) {
+            used -= n;
+            continue;
+        }
+
+        r = &c->queue[(c->head + c->count) % DAEMON_QUEUE_LEN];
+        memcpy(r->data, c->in + used, n);
+        r->len = n;
+        c->count++;
+        used += n;
+    }
+
+    memmove(c->in, c->in + used, c->in_len - used);
+    c->in_len -= used;
+}
+
+/** Write the pending reply bytes of client i, as many as its socket takes
+ */
+void flush_client(int i) {
+    struct client* c = &clients[i];
+    int n;
+
+    while (c->out_len > 0) {
+        n = write(c->fd, c->out, c->out_len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return;
+        if (n <= 0) {
+            close_client(i);
+            return;
+        }
+        memmove(c->out, c->out + n, c->out_len - n);
+        c->out_len -= n;
+    }
+}
+
+
+//==============================================================================
+//                                                                           bus
+//==============================================================================
+
+/** Commands the devices never answer, the bus is free right after them
+ */
+static int no_reply(uint8_t cmd) {
+    switch (cmd) {
+        case CMD_SET_INPUTS:
+        case CMD_ACTIVATE:
+        case CMD_SET_POS_STIFF:
+        case CMD_SET_CUFF_INPUTS:
+        case CMD_SET_WATCHDOG:
+        case CMD_SET_BAUDRATE:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static int is_control(const struct request* r) {
+    return r->data[4] >= 128;
+}
+
+/** Next client to serve: control requests first, round robin among clients
+ */
+int next_request() {
+    int i, k;
+
+    for (k = 0; k < DAEMON_MAX_CLIENTS; k++) {
+        i = (next_client + k) % DAEMON_MAX_CLIENTS;
+        if (clients[i].fd >= 0 && clients[i].count > 0 &&
+                is_control(&clients[i].queue[clients[i].head]))
+            return i;
+    }
+
+    for (k = 0; k < DAEMON_MAX_CLIENTS; k++) {
+        i = (next_client + k) % DAEMON_MAX_CLIENTS;
+        if (clients[i].fd >= 0 && clients[i].count > 0)
+            return i;
+    }
+
+    return -1;
+}
+
+/** Write the next request on the bus
+ */
+void start_transaction() {
+    struct client* c;
+    struct request* r;
+    int i, sent, n;
+
+    while (bus.client == -1 && (i = next_request()) >= 0) {
+        c = &clients[i];
+        r = &c->queue[c->head];
+        c->head = (c->head + 1) % DAEMON_QUEUE_LEN;
+        c->count--;
+        next_client = (i + 1) % DAEMON_MAX_CLIENTS;
+        queue_requests(i);
+
+        if (is_control(r))
+            num_control++;
+        else
+            num_other++;
+
+        for (sent = 0; sent < r->len; sent += n) {
+            n = write(comm_settings_t.file_handle, r->data + sent, r->len - sent);
+            if (n <= 0) {
+                perror("Error writing the serial port");
+                quit = 1;
+                return;
+            }
+        }
+
+        if (no_reply(r->data[4]))
+            continue;
+
+        bus.client = i;
+        bus.id = r->data[2];
+        bus.reply_len = 0;
+        bus.deadline = rt_sched_now_us() + DAEMON_REPLY_TIMEOUT;
+    }
+}
+
+/** Forward the bytes of the bus to the client of the transaction
+ */
+void read_bus() {
+    uint8_t buf[1024];
+    qbpacket pkt;
+    int n;
+
+    n = read(comm_settings_t.file_handle, buf, sizeof(buf));
+    if (n <= 0)
+        return;
+
+    // bytes nobody asked for are dropped
+    if (bus.client == -1)
+        return;
+
+    // the transaction lasts until the board is silent, whatever the length
+    bus.deadline = rt_sched_now_us() + DAEMON_REPLY_TIMEOUT;
+
+    if (bus.client >= 0) {
+        struct client* c = &clients[bus.client];
+
+        // a client that stopped reading would stall the bus for everybody
+        if (c->out_len + n > (int)sizeof(c->out)) {
+            printf("Client %d does not read its replies\n", bus.client);
+            close_client(bus.client);
+        }
+        else {
+            memcpy(c->out + c->out_len, buf, n);
+            c->out_len += n;
+            flush_client(bus.client);
+        }
+    }
+
+    if (bus.reply_len + n <= (int)sizeof(bus.reply)) {
+        memcpy(bus.reply + bus.reply_len, buf, n);
+        bus.reply_len += n;
+    }
+    else
+        bus.reply_len = sizeof(bus.reply) + 1;     // too long, wait for the quiet bus
+
+    // a single complete packet of the device ends the transaction at once
+    if (bus.reply_len <= (int)sizeof(bus.reply) &&
+            qbpacket_parse(bus.reply, bus.reply_len, &pkt) == bus.reply_len &&
+            pkt.id == bus.id && bus.id != BROADCAST_ID)
+        bus.client = -1;
+}
+
+/** End the transaction once the bus has been quiet for DAEMON_REPLY_TIMEOUT,
+ *  a timeout if the device did not answer at all
+ */
+void check_timeout() {
+    if (bus.client == -1 || rt_sched_now_us() < bus.deadline)
+        return;
+
+    if (bus.reply_len == 0)
+        num_timeouts++;
+    bus.client = -1;
+}
+
+void serve() {
+    fd_set fds, wfds;
+    struct timeval tv;
+    long long wait;
+    int max_fd, i;
+
+    while (!quit) {
+        FD_ZERO(&fds);
+        FD_ZERO(&wfds);
+        FD_SET(listen_fd, &fds);
+        FD_SET(comm_settings_t.file_handle, &fds);
+        max_fd = listen_fd > comm_settings_t.file_handle ? listen_fd : comm_settings_t.file_handle;
+        for (i = 0; i < DAEMON_MAX_CLIENTS; i++) {
+            if (clients[i].fd >= 0) {
+                if (clients[i].in_len < (int)sizeof(clients[i].in))
+                    FD_SET(clients[i].fd, &fds);
+                if (clients[i].out_len > 0)
+                    FD_SET(clients[i].fd, &wfds);
+                if (clients[i].fd > max_fd)
+                    max_fd = clients[i].fd;
+            }
+        }
+
+        // wake up for the end of the transaction on the bus
+        wait = 1000000;
+        if (bus.client != -1) {
+            wait = bus.deadline - rt_sched_now_us();
+            if (wait < 0)
+                wait = 0;
+        }
+        tv.tv_sec = wait / 1000000;
+        tv.tv_usec = wait % 1000000;
+
+        if (select(max_fd + 1, &fds, &wfds, NULL, &tv) < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("select");
+            break;
+        }
+
+        if (FD_ISSET(comm_settings_t.file_handle, &fds))
+            read_bus();
+        if (FD_ISSET(listen_fd, &fds))
+            accept_client();
+        for (i = 0; i < DAEMON_MAX_CLIENTS; i++) {
+            if (clients[i].fd >= 0 && FD_ISSET(clients[i].fd, &wfds))
+                flush_client(i);
+            if (clients[i].fd >= 0 && FD_ISSET(clients[i].fd, &fds))
+                read_client(i);
+        }
+
+        check_timeout();
+        start_transaction();
+    }
+}
+
+
+//==============================================================================
+//                                                          CTRL-C interruptions
+//==============================================================================
+
+void int_handler(int sig) {
+    quit = 1;
+}
+
+
+//==============================================================================
+//                                                                 display usage
+//==============================================================================
+
+void display_usage() {
+    puts("usage: qbadmind [OPTIONS]");
+    puts("Keeps the serial port open and serves qbadmin, qbparam, nmmi_param and");
+    puts("nmmi_param_imu through a Unix socket.");
+    puts("");
+    puts(" -p <port>        Serial port (default from conf_files/qbmove.conf).");
+    puts(" -b <baudrate>    460800 or 2000000 (default from conf_files/qbmoveBR.conf).");
+    puts(" -s <path>        Socket (default " QBADMIND_SOCKET " or $QBADMIND_SOCKET).");
+    puts(" -v               Verbose mode.");
+    puts(" -h               Shows this information.");
+}
+
+#else
+
+int main(int argc, char **argv) {
+    puts("qbadmind is only available on Linux and macOS.");
+    return 0;
+}
+
+#endif
+
+/* [] END OF FILE */
\ No newline at end of file
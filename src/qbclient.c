@@ -0,0 +1,103 @@
+// ----------------------------------------------------------------------------
+// BSD 3-Clause License
+
+// Copyright (c) 2016, qbrobotics
+// Copyright (c) 2017-2024, Centro "E.Piaggio"
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// POSSIBILITY OF SUCH DAMAGE.
+// ----------------------------------------------------------------------------
+
+/**
+* \file         qbclient.c
+*
+* \brief        Thin client of qbadmind for the command line tools
+* \author       _Centro "E.Piaggio"_
+* \copyright    (C) 2017-2024 Centro "E.Piaggio". All rights reserved.
+*/
+
+#include "qbclient.h"
+#include "definitions.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if !(defined(_WIN32) || defined(_WIN64))
+    #include <sys/socket.h>
+    #include <sys/un.h>
+#endif
+
+const char* qbclient_socket_path() {
+    const char* path = getenv("QBADMIND_SOCKET");
+
+    return (path != NULL && path[0] != '\0') ? path : QBADMIND_SOCKET;
+}
+
+int qbclient_connect(comm_settings* cs) {
+#if !(defined(_WIN32) || defined(_WIN64))
+    struct sockaddr_un addr;
+    const char* path = qbclient_socket_path();
+    int fd;
+
+    if (strlen(path) >= sizeof(addr.sun_path) || access(path, F_OK))
+        return 0;
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return 0;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    // a stale socket of a daemon that is gone is not an error
+    if (connect(fd, (struct sockaddr*) &addr, sizeof(addr))) {
+        close(fd);
+        return 0;
+    }
+
+    cs->file_handle = fd;
+
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+int qbclient_running() {
+    comm_settings cs;
+
+    if (!qbclient_connect(&cs))
+        return 0;
+
+    close(cs.file_handle);
+
+    return 1;
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,70 @@
+// ----------------------------------------------------------------------------
+// BSD 3-Clause License
+
+// Copyright (c) 2016, qbrobotics
+// Copyright (c) 2017-2024, Centro "E.Piaggio"
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// POSSIBILITY OF SUCH DAMAGE.
+// ----------------------------------------------------------------------------
+
+/**
+* \file         qbclient.h
+*
+* \brief        Thin client of qbadmind for the command line tools
+* \author       _Centro "E.Piaggio"_
+* \copyright    (C) 2017-2024 Centro "E.Piaggio". All rights reserved.
+*
+* \details      When qbadmind is running, the tools connect to its Unix
+*               socket instead of opening the serial port. The socket is
+*               used as the file handle of comm_settings, so every qbAPI
+*               call works unchanged: the daemon forwards the packets to the
+*               bus and the replies back.
+*/
+
+#ifndef QBCLIENT_H_INCLUDED
+#define QBCLIENT_H_INCLUDED
+
+#include "../../qbAPI/src/qbmove_communications.h"
+
+/** Path of the socket of qbadmind, QBADMIND_SOCKET or $QBADMIND_SOCKET
+ */
+const char* qbclient_socket_path();
+
+/** Connect cs to qbadmind. Returns 1 on success, 0 if no daemon is
+ *  running (always 0 on Windows).
+ */
+int qbclient_connect(comm_settings* cs);
+
+/** 1 if qbadmind is serving the socket. The tools that must open the
+ *  serial port themselves (device search, other baud rates, several ports)
+ *  refuse to run then: the daemon owns the port.
+ */
+int qbclient_running();
+
+#endif
+/* [] END OF FILE */
@@ -0,0 +1,290 @@
+// ----------------------------------------------------------------------------
+// BSD 3-Clause License
+
+// Copyright (c) 2016, qbrobotics
+// Copyright (c) 2017-2024, Centro "E.Piaggio"
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// POSSIBILITY OF SUCH DAMAGE.
+// ----------------------------------------------------------------------------
+
+/**
+* \file         qbmetered.h
+*
+* \brief        qbAPI calls counted in the metrics
+* \author       _Centro "E.Piaggio"_
+* \copyright    (C) 2017-2024 Centro "E.Piaggio". All rights reserved.
+*
+* \details      Included after qbmove_communications.h, every comm* call of
+*               the file goes through a wrapper with the same signature that
+*               times it and updates the metrics of its command (see
+*               metrics.h). With the metrics off a wrapper costs one test.
+*               Packets are [':'][':'][ID][LEN][CMD][..DATA..][CHECKSUM],
+*               6 bytes plus the data.
+*/
+
+#ifndef QBMETERED_H_INCLUDED
+#define QBMETERED_H_INCLUDED
+
+#include <string.h>
+
+#include "../../qbAPI/src/qbmove_communications.h"
+#include "metrics.h"
+
+#define METERED_PACKET(data)    (6 + (data))
+
+static inline void metered_commActivate(comm_settings* c, int id, char activate) {
+    long long t = metrics_begin();
+    commActivate(c, id, activate);
+    metrics_end(METRIC_ACTIVATE, t, 0, METERED_PACKET(1));
+}
+
+static inline int metered_commGetActivate(comm_settings* c, int id, char* activate) {
+    long long t = metrics_begin();
+    int ret = commGetActivate(c, id, activate);
+    metrics_end(METRIC_GET_ACTIVATE, t, ret, METERED_PACKET(0) + (ret < 0 ? 0 : METERED_PACKET(1)));
+    return ret;
+}
+
+static inline void metered_commSetInputs(comm_settings* c, int id, short int inputs[]) {
+    long long t = metrics_begin();
+    commSetInputs(c, id, inputs);
+    metrics_end(METRIC_SET_INPUTS, t, 0, METERED_PACKET(4));
+}
+
+static inline void metered_commSetPosStiff(comm_settings* c, int id, short int inputs[]) {
+    long long t = metrics_begin();
+    commSetPosStiff(c, id, inputs);
+    metrics_end(METRIC_SET_POS_STIFF, t, 0, METERED_PACKET(4));
+}
+
+static inline int metered_commGetInputs(comm_settings* c, int id, short int inputs[]) {
+    long long t = metrics_begin();
+    int ret = commGetInputs(c, id, inputs);
+    metrics_end(METRIC_GET_INPUTS, t, ret, METERED_PACKET(0) + (ret < 0 ? 0 : METERED_PACKET(4)));
+    return ret;
+}
+
+static inline int metered_commGetMeasurements(comm_settings* c, int id, short int measurements[]) {
+    long long t = metrics_begin();
+    int ret = commGetMeasurements(c, id, measurements);
+    metrics_end(METRIC_GET_MEASUREMENTS, t, ret, METERED_PACKET(0) + (ret < 0 ? 0 : METERED_PACKET(2 * ret)));
+    return ret;
+}
+
+static inline int metered_commGetVelocities(comm_settings* c, int id, short int v[]) {
+    long long t = metrics_begin();
+    int ret = commGetVelocities(c, id, v);
+    metrics_end(METRIC_GET_VELOCITIES, t, ret, METERED_PACKET(0) + (ret < 0 ? 0 : METERED_PACKET(2 * ret)));
+    return ret;
+}
+
+static inline int metered_commGetAccelerations(comm_settings* c, int id, short int a[]) {
+    long long t = metrics_begin();
+    int ret = commGetAccelerations(c, id, a);
+    metrics_end(METRIC_GET_ACCELERATIONS, t, ret, METERED_PACKET(0) + (ret < 0 ? 0 : METERED_PACKET(2 * ret)));
+    return ret;
+}
+
+static inline int metered_commGetCurrents(comm_settings* c, int id, short int currents[]) {
+    long long t = metrics_begin();
+    int ret = commGetCurrents(c, id, currents);
+    metrics_end(METRIC_GET_CURRENTS, t, ret, METERED_PACKET(0) + (ret < 0 ? 0 : METERED_PACKET(4)));
+    return ret;
+}
+
+static inline int metered_commGetEmg(comm_settings* c, int id, short int emg[]) {
+    long long t = metrics_begin();
+    int ret = commGetEmg(c, id, emg);
+    metrics_end(METRIC_GET_EMG, t, ret, METERED_PACKET(0) + (ret < 0 ? 0 : METERED_PACKET(4)));
+    return ret;
+}
+
+static inline int metered_commGetJoystick(comm_settings* c, int id, short int j[]) {
+    long long t = metrics_begin();
+    int ret = commGetJoystick(c, id, j);
+    metrics_end(METRIC_GET_JOYSTICK, t, ret, METERED_PACKET(0) + (ret < 0 ? 0 : METERED_PACKET(4)));
+    return ret;
+}
+
+static inline int metered_commGetImuReadings(comm_settings* c, int id, uint8_t* imu_table, uint8_t* mag_cal, int n_imu, float* imu_values) {
+    long long t = metrics_begin();
+    int ret = commGetImuReadings(c, id, imu_table, mag_cal, n_imu, imu_values);
+    // accelerometer, gyroscope, magnetometer, quaternion and temperature between two ':'
+    metrics_end(METRIC_GET_IMU_READINGS, t, ret, METERED_PACKET(0) + (ret < 0 ? 0 : METERED_PACKET(38 * n_imu)));
+    return ret;
+}
+
+static inline int metered_commGetInfo(comm_settings* c, int id, short int info_type, char* info) {
+    long long t = metrics_begin();
+    int ret = commGetInfo(c, id, info_type, info);
+    metrics_end(METRIC_GET_INFO, t, ret, METERED_PACKET(2) + (ret < 0 ? 0 : (int)strlen(info)));
+    return ret;
+}
+
+static inline int metered_commGetParamList(comm_settings* c, int id, unsigned short index, void* values, unsigned short value_size, unsigned short num_of_values, uint8_t* buffer) {
+    long long t = metrics_begin();
+    int ret = commGetParamList(c, id, index, values, value_size, num_of_values, buffer);
+    metrics_end(METRIC_GET_PARAM_LIST, t, ret, METERED_PACKET(2 + value_size * num_of_values));
+    return ret;
+}
+
+static inline int metered_commGetIMUParamList(comm_settings* c, int id, unsigned short index, void* values, unsigned short value_size, unsigned short num_of_values, uint8_t* buffer) {
+    long long t = metrics_begin();
+    int ret = commGetIMUParamList(c, id, index, values, value_size, num_of_values, buffer);
+    metrics_end(METRIC_GET_IMU_PARAM_LIST, t, ret, METERED_PACKET(2 + value_size * num_of_values));
+    return ret;
+}
+
+static inline int metered_commStoreParams(comm_settings* c, int id) {
+    long long t = metrics_begin();
+    int ret = commStoreParams(c, id);
+    metrics_end(METRIC_STORE_PARAMS, t, ret, METERED_PACKET(0) + (ret < 0 ? 0 : METERED_PACKET(0)));
+    return ret;
+}
+
+static inline int metered_commSetZeros(comm_settings* c, int id, void* values, unsigned short num_of_values) {
+    long long t = metrics_begin();
+    int ret = commSetZeros(c, id, values, num_of_values);
+    metrics_end(METRIC_SET_ZEROS, t, ret, METERED_PACKET(2 * num_of_values) + (ret < 0 ? 0 : METERED_PACKET(0)));
+    return ret;
+}
+
+static inline void metered_commSetBaudRate(comm_settings* c, int id, short int baudrate) {
+    long long t = metrics_begin();
+    commSetBaudRate(c, id, baudrate);
+    metrics_end(METRIC_SET_BAUDRATE, t, 0, METERED_PACKET(1));
+}
+
+static inline void metered_commSetWatchDog(comm_settings* c, int id, short int wdt) {
+    long long t = metrics_begin();
+    commSetWatchDog(c, id, wdt);
+    metrics_end(METRIC_SET_WATCHDOG, t, 0, METERED_PACKET(2));
+}
+
+static inline void metered_commSetCuffInputs(comm_settings* c, int id, int flag) {
+    long long t = metrics_begin();
+    commSetCuffInputs(c, id, flag);
+    metrics_end(METRIC_SET_CUFF_INPUTS, t, 0, METERED_PACKET(1));
+}
+
+static inline int metered_commExtDrive(comm_settings* c, int id, char ext) {
+    long long t = metrics_begin();
+    int ret = commExtDrive(c, id, ext);
+    metrics_end(METRIC_EXT_DRIVE, t, ret, METERED_PACKET(1) + (ret < 0 ? 0 : METERED_PACKET(0)));
+    return ret;
+}
+
+static inline int metered_commHandCalibrate(comm_settings* c, int id, short int speed, short int repetitions) {
+    long long t = metrics_begin();
+    int ret = commHandCalibrate(c, id, speed, repetitions);
+    metrics_end(METRIC_HAND_CALIBRATE, t, ret, METERED_PACKET(4) + (ret < 0 ? 0 : METERED_PACKET(0)));
+    return ret;
+}
+
+static inline int metered_commCalibIMUMagnetometer(comm_settings* c, int id) {
+    long long t = metrics_begin();
+    int ret = commCalibIMUMagnetometer(c, id);
+    metrics_end(METRIC_CALIB_IMU_MAG, t, ret, METERED_PACKET(0) + (ret < 0 ? 0 : METERED_PACKET(0)));
+    return ret;
+}
+
+static inline int metered_commBootloader(comm_settings* c, int id) {
+    long long t = metrics_begin();
+    int ret = commBootloader(c, id);
+    metrics_end(METRIC_BOOTLOADER, t, ret, METERED_PACKET(0) + (ret < 0 ? 0 : METERED_PACKET(0)));
+    return ret;
+}
+
+static inline int metered_commGetADCConf(comm_settings* c, int id, uint8_t* n, uint8_t* map) {
+    long long t = metrics_begin();
+    int ret = commGetADCConf(c, id, n, map);
+    metrics_end(METRIC_GET_ADC_CONF, t, ret, METERED_PACKET(0) + (ret < 0 ? 0 : METERED_PACKET(1 + *n)));
+    return ret;
+}
+
+static inline int metered_commGetADCRawValues(comm_settings* c, int id, uint8_t n, short int* values) {
+    long long t = metrics_begin();
+    int ret = commGetADCRawValues(c, id, n, values);
+    metrics_end(METRIC_GET_ADC_RAW, t, ret, METERED_PACKET(0) + (ret < 0 ? 0 : METERED_PACKET(2 * n)));
+    return ret;
+}
+
+static inline int metered_commGetEncoderConf(comm_settings* c, int id, uint8_t* lines, uint8_t* per_line, uint8_t* map) {
+    long long t = metrics_begin();
+    int ret = commGetEncoderConf(c, id, lines, per_line, map);
+    metrics_end(METRIC_GET_ENCODER_CONF, t, ret, METERED_PACKET(0) + (ret < 0 ? 0 : METERED_PACKET(2 + *lines * *per_line)));
+    return ret;
+}
+
+static inline int metered_commGetEncoderRawValues(comm_settings* c, int id, uint8_t n, uint16_t* values) {
+    long long t = metrics_begin();
+    int ret = commGetEncoderRawValues(c, id, n, values);
+    metrics_end(METRIC_GET_ENCODER_RAW, t, ret, METERED_PACKET(0) + (ret < 0 ? 0 : METERED_PACKET(2 * n)));
+    return ret;
+}
+
+static inline int metered_commGetSDFile(comm_settings* c, int id, char* path, char* buffer) {
+    long long t = metrics_begin();
+    int ret = commGetSDFile(c, id, path, buffer);
+    metrics_end(METRIC_GET_SD_FILE, t, ret, METERED_PACKET((int)strlen(path)) + (ret < 0 ? 0 : (int)strlen(buffer)));
+    return ret;
+}
+
+// From here on the file calls the wrappers
+#define commActivate                metered_commActivate
+#define commGetActivate             metered_commGetActivate
+#define commSetInputs               metered_commSetInputs
+#define commSetPosStiff             metered_commSetPosStiff
+#define commGetInputs               metered_commGetInputs
+#define commGetMeasurements         metered_commGetMeasurements
+#define commGetVelocities           metered_commGetVelocities
+#define commGetAccelerations        metered_commGetAccelerations
+#define commGetCurrents             metered_commGetCurrents
+#define commGetEmg                  metered_commGetEmg
+#define commGetJoystick             metered_commGetJoystick
+#define commGetImuReadings          metered_commGetImuReadings
+#define commGetInfo                 metered_commGetInfo
+#define commGetParamList            metered_commGetParamList
+#define commGetIMUParamList         metered_commGetIMUParamList
+#define commStoreParams             metered_commStoreParams
+#define commSetZeros                metered_commSetZeros
+#define commSetBaudRate             metered_commSetBaudRate
+#define commSetWatchDog             metered_commSetWatchDog
+#define commSetCuffInputs           metered_commSetCuffInputs
+#define commExtDrive                metered_commExtDrive
+#define commHandCalibrate           metered_commHandCalibrate
+#define commCalibIMUMagnetometer    metered_commCalibIMUMagnetometer
+#define commBootloader              metered_commBootloader
+#define commGetADCConf              metered_commGetADCConf
+#define commGetADCRawValues         metered_commGetADCRawValues
+#define commGetEncoderConf          metered_commGetEncoderConf
+#define commGetEncoderRawValues     metered_commGetEncoderRawValues
+#define commGetSDFile               metered_commGetSDFile
+
+#endif
+/* [] END OF FILE */
@@ -0,0 +1,207 @@
+// ----------------------------------------------------------------------------
+// BSD 3-Clause License
+
+// Copyright (c) 2016, qbrobotics
+// Copyright (c) 2017-2024, Centro "E.Piaggio"
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// POSSIBILITY OF SUCH DAMAGE.
+// ----------------------------------------------------------------------------
+
+/**
+* \file         qbpacket.c
+*
+* \brief        Framing of the serial packets exchanged with the boards
+* \author       _Centro "E.Piaggio"_
+* \copyright    (C) 2017-2024 Centro "E.Piaggio". All rights reserved.
+*/
+
+#include "qbpacket.h"
+
+#include <string.h>
+
+#if !(defined(_WIN32) || defined(_WIN64))
+    #include <unistd.h>
+    #include <errno.h>
+    #include <sys/select.h>
+    #include <sys/time.h>
+#endif
+
+//==============================================================================
+//                                                                      checksum
+//==============================================================================
+
+uint8_t qbpacket_checksum(const uint8_t* data, int len) {
+    uint8_t chk = 0;
+    int i;
+
+    for (i = 0; i < len; i++)
+        chk ^= data[i];
+
+    return chk;
+}
+
+//==============================================================================
+//                                                                         build
+//==============================================================================
+
+int qbpacket_build(uint8_t* buf, uint8_t id, uint8_t cmd, const uint8_t* data, int data_len) {
+
+    if (data_len < 0 || data_len > 253)
+        return -1;
+
+    buf[0] = ':';
+    buf[1] = ':';
+    buf[2] = id;
+    buf[3] = (uint8_t)(data_len + 2);
+    buf[4] = cmd;
+    if (data_len)
+        memcpy(buf + 5, data, data_len);
+    buf[5 + data_len] = qbpacket_checksum(buf + 4, data_len + 1);
+
+    return 6 + data_len;
+}
+
+//==============================================================================
+//                                                                         parse
+//==============================================================================
+
+int qbpacket_parse(const uint8_t* buf, int n, qbpacket* pkt) {
+    int i;
+    int len;
+
+    // Skip everything before the "::" start sequence
+    for (i = 0; i + 1 < n; i++) {
+        if (buf[i] == ':' && buf[i + 1] == ':')
+            break;
+    }
+    if (i > 0)
+        return -i;
+
+    if (n < QBPACKET_HEADER_LEN)
+        return 0;
+
+    len = buf[3];
+    if (len < 2)
+        return -1;
+
+    if (n < QBPACKET_HEADER_LEN + len)
+        return 0;
+
+    if (qbpacket_checksum(buf + 4, len - 1) != buf[QBPACKET_HEADER_LEN + len - 1])
+        return -1;
+
+    pkt->id = buf[2];
+    pkt->cmd = buf[4];
+    pkt->data = buf + 5;
+    pkt->data_len = len - 2;
+
+    return QBPACKET_HEADER_LEN + len;
+}
+
+#if !(defined(_WIN32) || defined(_WIN64))
+
+//==============================================================================
+//                                                                        stream
+//==============================================================================
+
+void qbpacket_stream_init(qbpacket_stream* stream) {
+    stream->len = 0;
+    stream->garbage = 0;
+}
+
+int qbpacket_stream_read(qbpacket_stream* stream, int fd, long timeout_us, uint8_t* out, qbpacket* pkt) {
+    struct timeval now, deadline, tv;
+    fd_set rfds;
+    int ret;
+
+    gettimeofday(&deadline, NULL);
+    deadline.tv_sec += timeout_us / 1000000;
+    deadline.tv_usec += timeout_us % 1000000;
+    if (deadline.tv_usec >= 1000000) {
+        deadline.tv_sec++;
+        deadline.tv_usec -= 1000000;
+    }
+
+    while (1) {
+        // Return a packet already in the buffer, if any
+        while (stream->len > 0) {
+            ret = qbpacket_parse(stream->buf, stream->len, pkt);
+            if (ret == 0)
+                break;
+            if (ret > 0) {
+                memcpy(out, stream->buf, ret);
+                pkt->data = out + 5;
+                memmove(stream->buf, stream->buf + ret, stream->len - ret);
+                stream->len -= ret;
+                return 1;
+            }
+            stream->garbage -= ret;
+            memmove(stream->buf, stream->buf - ret, stream->len + ret);
+            stream->len += ret;
+        }
+
+        // A full buffer without a packet is noise
+        if (stream->len == QBPACKET_STREAM_SIZE) {
+            stream->garbage += stream->len;
+            stream->len = 0;
+        }
+
+        gettimeofday(&now, NULL);
+        tv.tv_sec = deadline.tv_sec - now.tv_sec;
+        tv.tv_usec = deadline.tv_usec - now.tv_usec;
+        if (tv.tv_usec < 0) {
+            tv.tv_sec--;
+            tv.tv_usec += 1000000;
+        }
+        if (tv.tv_sec < 0)
+            return 0;
+
+        FD_ZERO(&rfds);
+        FD_SET(fd, &rfds);
+        ret = select(fd + 1, &rfds, NULL, NULL, &tv);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        if (ret == 0)
+            return 0;
+
+        ret = read(fd, stream->buf + stream->len, QBPACKET_STREAM_SIZE - stream->len);
+        if (ret < 0) {
+            if (errno == EINTR || errno == EAGAIN)
+                continue;
+            return -1;
+        }
+        stream->len += ret;
+    }
+}
+
+#endif
+
+/* [] END OF FILE */
@@ -0,0 +1,105 @@
+// ----------------------------------------------------------------------------
+// BSD 3-Clause License
+
+// Copyright (c) 2016, qbrobotics
+// Copyright (c) 2017-2024, Centro "E.Piaggio"
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// POSSIBILITY OF SUCH DAMAGE.
+// ----------------------------------------------------------------------------
+
+/**
+* \file         qbpacket.h
+*
+* \brief        Framing of the serial packets exchanged with the boards
+* \author       _Centro "E.Piaggio"_
+* \copyright    (C) 2017-2024 Centro "E.Piaggio". All rights reserved.
+*
+* \details      Every packet on the bus is composed as follows
+*               [':'][':'][ID][LEN][CMD][..DATA..][CHECKSUM]
+*               where LEN counts the command, the data and the checksum bytes
+*               and CHECKSUM is the XOR of the command and data bytes.
+*               These functions are used by the tools that need to talk to
+*               the bus below the qbAPI level (e.g. the polling search).
+*/
+
+#ifndef QBPACKET_H_INCLUDED
+#define QBPACKET_H_INCLUDED
+
+#include <stdint.h>
+
+#define QBPACKET_HEADER_LEN     4                           ///< ':' ':' ID LEN
+#define QBPACKET_MAX_LEN        (QBPACKET_HEADER_LEN + 255) ///< Longest packet with a single byte LEN
+#define QBPACKET_STREAM_SIZE    1024                        ///< Receive buffer of a packet stream
+
+/** Decoded packet. Data points inside the buffer the packet was parsed from.
+ */
+typedef struct qbpacket {
+    uint8_t id;                 ///< Device ID
+    uint8_t cmd;                ///< Command
+    const uint8_t* data;        ///< Data following the command byte
+    int data_len;               ///< Number of data bytes
+} qbpacket;
+
+/** Bytes received from a file descriptor and not yet returned as packets.
+ */
+typedef struct qbpacket_stream {
+    uint8_t buf[QBPACKET_STREAM_SIZE];
+    int len;
+    int garbage;                ///< Bytes discarded so far (noise, bad checksums)
+} qbpacket_stream;
+
+/** XOR checksum of len bytes
+ */
+uint8_t qbpacket_checksum(const uint8_t* data, int len);
+
+/** Build a packet in buf (at least QBPACKET_MAX_LEN bytes) and return its length
+ */
+int qbpacket_build(uint8_t* buf, uint8_t id, uint8_t cmd, const uint8_t* data, int data_len);
+
+/** Look for a packet at the beginning of buf.
+ *  Returns the number of bytes used by the packet found (pkt is filled),
+ *  0 if more bytes are needed or -n if the first n bytes must be discarded.
+ */
+int qbpacket_parse(const uint8_t* buf, int n, qbpacket* pkt);
+
+#if !(defined(_WIN32) || defined(_WIN64))
+
+/** Reset a packet stream
+ */
+void qbpacket_stream_init(qbpacket_stream* stream);
+
+/** Wait up to timeout_us microseconds for the next valid packet on fd.
+ *  The packet is copied in out (QBPACKET_MAX_LEN bytes) and pkt points inside it.
+ *  Returns 1 if a packet was received, 0 on timeout and -1 on error.
+ */
+int qbpacket_stream_read(qbpacket_stream* stream, int fd, long timeout_us, uint8_t* out, qbpacket* pkt);
+
+#endif
+
+#endif
+/* [] END OF FILE */
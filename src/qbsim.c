@@ -0,0 +1,1081 @@
+// ----------------------------------------------------------------------------
+// BSD 3-Clause License
+
+// Copyright (c) 2016, qbrobotics
+// Copyright (c) 2017-2024, Centro "E.Piaggio"
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// POSSIBILITY OF SUCH DAMAGE.
+// ----------------------------------------------------------------------------
+
+/**
+* \file         qbsim.c
+*
+* \brief        Simulator of a chain of boards on a pseudo terminal
+* \author       _Centro "E.Piaggio"_
+* \copyright    (C) 2017-2024 Centro "E.Piaggio". All rights reserved.
+*
+* \details      qbsim opens a pseudo terminal and answers on it the packets
+*               of qbadmin, qbparam, nmmi_param and nmmi_param_imu as the
+*               boards would, so every tool can run with no hardware:
+*               point conf_files/qbmove.conf to the printed device, or let
+*               qbsim write it with -c.
+*
+*               Each simulated board has two motors following their inputs
+*               with a first order lag once activated, three position
+*               sensors, currents proportional to the position error, two
+*               EMG channels, a chain of IMUs, a short parameter table and
+*               a small SD card.
+*
+*               Replies leave after -l microseconds plus a random jitter up
+*               to -j and the time the bytes take on the wire at -b baud.
+*               The bus is half duplex, replies never overtake each other.
+*               -L drops that percentage of the requests, unanswered as a
+*               packet lost on a noisy bus.
+*
+*               Long replies follow the firmware: info and SD replies are
+*               plain text with no framing and the parameter lists carry
+*               only the low byte of their length, the qbAPI reads them
+*               until the bus is quiet.
+*
+*               With -r the boards are not simulated: a capture made by
+*               qbadmin --capture is played back. The requests are expected
+*               in the recorded order and every recorded reply is sent with
+*               the delay it had from its request, so a session runs again
+*               with the timing of the real devices. Requests that differ
+*               from the recorded ones are counted; the replay goes on with
+*               the recorded replies anyway.
+*/
+
+// --- INCLUDE ---
+#include "../../qbAPI/src/qbmove_communications.h"
+#include "definitions.h"
+#include "qbpacket.h"
+#include "capture.h"
+#include "rt_sched.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <math.h>
+
+#if !(defined(_WIN32) || defined(_WIN64))
+    #include <errno.h>
+    #include <fcntl.h>
+    #include <signal.h>
+    #include <time.h>
+    #include <termios.h>
+    #include <sys/select.h>
+#endif
+
+#define SIM_MAX_DEVICES         16
+#define SIM_MAX_IMUS            6
+#define SIM_MAX_PENDING         32          ///< Replies waiting for their time on the bus
+#define SIM_REPLY_LEN           4096
+#define SIM_NUM_SENSORS         3
+#define SIM_NUM_PARAMS          4
+#define SIM_NUM_IMU_ID_PARAMS   7
+#define SIM_TAU                 50000.0     ///< Time constant of the motors [us]
+#define SIM_ACK_OK              1
+
+#if !(defined(_WIN32) || defined(_WIN64))
+
+/** Parameter of the table of every board
+ */
+struct sim_param {
+    const char* name;
+    uint8_t type;
+    uint8_t dim;
+    uint8_t section;            ///< ST_ index, see definitions.h
+    uint8_t menu;               ///< Menu of a TYPE_FLAG, from 1
+};
+
+static const struct sim_param param_table[SIM_NUM_PARAMS] = {
+    { "1 - Device ID",                  TYPE_UINT8, 1, ST_DEVICE, 0 },
+    { "2 - Position PID [P, I, D]",     TYPE_FLOAT, 3, ST_MOTOR,  0 },
+    { "3 - Startup activation",         TYPE_FLAG,  1, ST_MOTOR,  1 },
+    { "4 - Current limit [mA]",         TYPE_INT16, 1, ST_MOTOR,  0 }
+};
+
+static const char* param_menus[] = {
+    "0 -> Deactivate [NO]\n1 -> Activate [YES]\n"
+};
+
+struct device {
+    int id;
+    int active;
+    short int inputs[2];
+    double position[2];
+    double velocity[2];
+    double acceleration[2];
+    long long last_update;
+    uint8_t params[SIM_NUM_PARAMS][24];     ///< Values as on the bus, big endian
+    long requests;
+};
+
+struct reply {
+    uint8_t data[SIM_REPLY_LEN];
+    int len;
+    long long due;
+};
+
+// global variables
+struct device devices[SIM_MAX_DEVICES];
+int num_devices = 0;
+int num_imus = 1;
+long latency = 300;                         ///< [us]
+long jitter = 0;                            ///< [us]
+double loss = 0;                            ///< Requests dropped [%]
+int baudrate = 2000000;
+int verbose = 0;
+volatile sig_atomic_t quit = 0;
+
+struct reply pending[SIM_MAX_PENDING];
+int pending_head = 0;
+int pending_count = 0;
+long long bus_free = 0;                     ///< End of the last reply on the bus
+
+long num_requests = 0;
+long num_replies = 0;
+long num_lost = 0;
+long num_unknown = 0;
+
+// function declaration
+int open_pty(char* name, int* slave);
+int parse_ids(const char* list);
+void init_device(struct device* dev, int id);
+void update_device(struct device* dev, long long now);
+void handle_request(const qbpacket* pkt, int request_len);
+void answer(struct device* dev, const qbpacket* pkt, struct reply* r);
+void send_due(int fd);
+int replay(int master, const char* filename);
+void display_usage();
+void int_handler(int sig);
+
+static int type_size(uint8_t type) {
+    switch (type) {
+        case TYPE_INT16:
+        case TYPE_UINT16:
+            return 2;
+        case TYPE_INT32:
+        case TYPE_UINT32:
+        case TYPE_FLOAT:
+            return 4;
+        case TYPE_DOUBLE:
+            return 8;
+        default:
+            return 1;
+    }
+}
+
+static void put_int16(uint8_t* buf, short int value) {
+    buf[0] = (uint8_t)((uint16_t)value >> 8);
+    buf[1] = (uint8_t)value;
+}
+
+static void put_float(uint8_t* buf, float value) {
+    uint32_t u;
+
+    memcpy(&u, &value, 4);
+    buf[0] = (uint8_t)(u >> 24);
+    buf[1] = (uint8_t)(u >> 16);
+    buf[2] = (uint8_t)(u >> 8);
+    buf[3] = (uint8_t)u;
+}
+
+
+//==============================================================================
+//                                                                     main loop
+//==============================================================================
+
+int main(int argc, char **argv) {
+    char pty_name[255];
+    char conf_file[255] = "";
+    char replay_file[255] = "";
+    unsigned int seed = 1;
+    qbpacket_stream stream;
+    uint8_t packet[QBPACKET_MAX_LEN];
+    qbpacket pkt;
+    long long wait;
+    int master, slave;
+    int opt, ret;
+    FILE* file;
+
+    while ((opt = getopt(argc, argv, "i:l:j:L:b:n:c:s:r:vh")) != -1) {
+        switch (opt) {
+            case 'i':
+                if (parse_ids(optarg) < 1) {
+                    printf("Bad list of IDs %s\n", optarg);
+                    return 0;
+                }
+                break;
+            case 'l':
+                sscanf(optarg, "%ld", &latency);
+                break;
+            case 'j':
+                sscanf(optarg, "%ld", &jitter);
+                break;
+            case 'L':
+                sscanf(optarg, "%lf", &loss);
+                break;
+            case 'b':
+                sscanf(optarg, "%d", &baudrate);
+                break;
+            case 'n':
+                sscanf(optarg, "%d", &num_imus);
+                if (num_imus < 0 || num_imus > SIM_MAX_IMUS) {
+                    printf("From 0 to %d IMUs\n", SIM_MAX_IMUS);
+                    return 0;
+                }
+                break;
+            case 'c':
+                strncpy(conf_file, optarg, sizeof(conf_file) - 1);
+                break;
+            case 's':
+                sscanf(optarg, "%u", &seed);
+                break;
+            case 'r':
+                strncpy(replay_file, optarg, sizeof(replay_file) - 1);
+                break;
+            case 'v':
+                verbose = 1;
+                break;
+            default:
+                display_usage();
+                return 0;
+        }
+    }
+
+    if (num_devices == 0)
+        parse_ids("1");
+    if (latency < 0)
+        latency = 0;
+    if (jitter < 0)
+        jitter = 0;
+    if (baudrate <= 0)
+        baudrate = 2000000;
+    srand(seed);
+
+    master = open_pty(pty_name, &slave);
+    if (master < 0)
+        return 0;
+
+    if (conf_file[0] != '\0') {
+        file = fopen(conf_file, "w");
+        if (file == NULL) {
+            printf("Error opening file %s\n", conf_file);
+            return 0;
+        }
+        fprintf(file, "serialport %s\n", pty_name);
+        fclose(file);
+    }
+
+    signal(SIGINT, int_handler);
+    signal(SIGTERM, int_handler);
+
+    if (replay_file[0] != '\0') {
+        printf("Replaying %s on %s\n", replay_file, pty_name);
+        fflush(stdout);
+        replay(master, replay_file);
+        close(slave);
+        close(master);
+        return 0;
+    }
+
+    printf("Simulating %d device(s) on %s\n", num_devices, pty_name);
+    fflush(stdout);
+
+    qbpacket_stream_init(&stream);
+
+    while (!quit) {
+        // sleep until the next reply is due or a request comes
+        if (pending_count > 0) {
+            wait = pending[pending_head].due - rt_sched_now_us();
+            if (wait < 0)
+                wait = 0;
+        }
+        else
+            wait = 100000;
+
+        ret = qbpacket_stream_read(&stream, master, wait, packet, &pkt);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("Error reading the pseudo terminal");
+            break;
+        }
+        if (ret > 0)
+            handle_request(&pkt, pkt.data_len + QBPACKET_HEADER_LEN + 2);
+
+        send_due(master);
+    }
+
+    printf("Requests: %ld\n", num_requests);
+    printf("Replies: %ld\n", num_replies);
+    printf("Lost requests: %ld\n", num_lost);
+    printf("Unknown commands: %ld\n", num_unknown);
+    printf("Garbage bytes: %d\n", stream.garbage);
+
+    close(slave);
+    close(master);
+
+    return 0;
+}
+
+
+//==============================================================================
+//                                                                         setup
+//==============================================================================
+
+/** Open a raw pseudo terminal. The slave side stays open so the terminal
+ *  survives the tools opening and closing it.
+ */
+int open_pty(char* name, int* slave) {
+    struct termios tio;
+    int master;
+
+    master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) || unlockpt(master)) {
+        perror("Cannot open a pseudo terminal");
+        return -1;
+    }
+    strcpy(name, ptsname(master));
+
+    *slave = open(name, O_RDWR | O_NOCTTY);
+    if (*slave < 0) {
+        perror("Cannot open the pseudo terminal");
+        close(master);
+        return -1;
+    }
+
+    // no echo and no line discipline, as a serial port
+    tcgetattr(*slave, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(*slave, TCSANOW, &tio);
+    tcgetattr(master, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(master, TCSANOW, &tio);
+
+    return master;
+}
+
+/** Comma separated list of device IDs, returns their number or -1
+ */
+int parse_ids(const char* list) {
+    const char* p = list;
+    char* end;
+    long id;
+
+    num_devices = 0;
+    while (*p) {
+        id = strtol(p, &end, 10);
+        if (end == p || id < 1 || id > 127 || num_devices == SIM_MAX_DEVICES)
+            return -1;
+        init_device(&devices[num_devices++], id);
+        p = end;
+        if (*p == ',')
+            p++;
+        else if (*p)
+            return -1;
+    }
+
+    return num_devices;
+}
+
+void init_device(struct device* dev, int id) {
+    memset(dev, 0, sizeof(struct device));
+    dev->id = id;
+
+    dev->params[0][0] = (uint8_t)id;
+    put_float(dev->params[1], 0.1f);
+    put_float(dev->params[1] + 4, 0.001f);
+    put_float(dev->params[1] + 8, 0.0f);
+    dev->params[2][0] = 0;
+    put_int16(dev->params[3], 1500);
+}
+
+
+//==============================================================================
+//                                                                        boards
+//==============================================================================
+
+/** Motors move towards the inputs with a first order lag
+ */
+void update_device(struct device* dev, long long now) {
+    double dt, alpha, old_position, old_velocity;
+    int k;
+
+    if (dev->last_update == 0) {
+        dev->last_update = now;
+        return;
+    }
+
+    dt = now - dev->last_update;
+    if (dt <= 0)
+        return;
+    dev->last_update = now;
+
+    alpha = dev->active ? 1 - exp(-dt / SIM_TAU) : 0;
+    for (k = 0; k < 2; k++) {
+        old_position = dev->position[k];
+        old_velocity = dev->velocity[k];
+        dev->position[k] += (dev->inputs[k] - dev->position[k]) * alpha;
+        // ticks per second and per second squared
+        dev->velocity[k] = (dev->position[k] - old_position) * 1e6 / dt;
+        dev->acceleration[k] = (dev->velocity[k] - old_velocity) * 1e6 / dt;
+    }
+}
+
+static void put_values(uint8_t* buf, const double* values, int n) {
+    double v;
+    int k;
+
+    for (k = 0; k < n; k++) {
+        v = values[k];
+        if (v > 32767)
+            v = 32767;
+        if (v < -32768)
+            v = -32768;
+        put_int16(buf + 2 * k, (short int)lround(v));
+    }
+}
+
+static void sensors(struct device* dev, double* values, const double* motors) {
+    values[0] = motors[0];
+    values[1] = motors[1];
+    values[2] = (motors[0] + motors[1]) / 2;
+}
+
+/** Reply framed as a packet
+ */
+static void reply_packet(struct reply* r, int id, uint8_t cmd, const uint8_t* data, int data_len) {
+    r->len = qbpacket_build(r->data, (uint8_t)id, cmd, data, data_len);
+}
+
+/** Reply too long for a packet, only the low byte of the length is sent
+ */
+static void reply_long(struct reply* r, int id, uint8_t cmd, const uint8_t* data, int data_len) {
+    if (data_len + 6 > SIM_REPLY_LEN)
+        data_len = SIM_REPLY_LEN - 6;
+
+    r->data[0] = ':';
+    r->data[1] = ':';
+    r->data[2] = (uint8_t)id;
+    r->data[3] = (uint8_t)(data_len + 2);
+    r->data[4] = cmd;
+    memcpy(r->data + 5, data, data_len);
+    r->data[5 + data_len] = qbpacket_checksum(r->data + 4, data_len + 1);
+    r->len = data_len + 6;
+}
+
+/** Plain text reply of the info commands
+ */
+static void reply_text(struct reply* r, const char* text) {
+    r->len = strlen(text);
+    if (r->len > SIM_REPLY_LEN)
+        r->len = SIM_REPLY_LEN;
+    memcpy(r->data, text, r->len);
+}
+
+/** [NUM_PARAMS][slot of 50 bytes for each parameter][menus of 150 bytes]
+ *  A slot is [TYPE][DIM][..DATA..][DESCRIPTION]['\0'] followed, for a
+ *  TYPE_FLAG, by [MENU]['\0'] and then by [SECTION].
+ */
+static int param_list(struct device* dev, uint8_t* buf) {
+    const struct sim_param* p;
+    uint8_t* slot;
+    int i, len, data_len;
+
+    len = 1 + SIM_NUM_PARAMS * PARAM_BYTE_SLOT +
+            (sizeof(param_menus) / sizeof(param_menus[0])) * PARAM_MENU_SLOT;
+    memset(buf, 0, len);
+    buf[0] = SIM_NUM_PARAMS;
+
+    for (i = 0; i < SIM_NUM_PARAMS; i++) {
+        p = &param_table[i];
+        slot = buf + 1 + i * PARAM_BYTE_SLOT;
+        data_len = type_size(p->type) * p->dim;
+
+        slot[0] = p->type;
+        slot[1] = p->dim;
+        memcpy(slot + 2, dev->params[i], data_len);
+        strcpy((char*)slot + 2 + data_len, p->name);
+        slot += 2 + data_len + strlen(p->name) + 1;
+        if (p->type == TYPE_FLAG) {
+            slot[0] = p->menu;
+            slot += 2;
+        }
+        slot[0] = p->section;
+    }
+
+    for (i = 0; i < (int)(sizeof(param_menus) / sizeof(param_menus[0])); i++)
+        strcpy((char*)buf + 1 + SIM_NUM_PARAMS * PARAM_BYTE_SLOT + i * PARAM_MENU_SLOT, param_menus[i]);
+
+    return len;
+}
+
+/** Same layout for the IMUs: number of IMUs, their IDs, magnetometer
+ *  calibrations (two IMUs per slot) and what every IMU reads
+ */
+static int imu_param_list(uint8_t* buf) {
+    int num_mag = (num_imus + 1) / 2;
+    int first_imu = 1 + SIM_NUM_IMU_ID_PARAMS + num_mag + 1;
+    int num_params = first_imu + num_imus;
+    uint8_t* slot;
+    int i, len;
+
+    len = 1 + num_params * PARAM_BYTE_SLOT;
+    memset(buf, 0, len);
+    buf[0] = (uint8_t)num_params;
+
+    // slot k starts at buf + 1 + k * PARAM_BYTE_SLOT, data two bytes later
+    buf[1] = TYPE_UINT8;
+    buf[2] = 1;
+    buf[3] = (uint8_t)num_imus;
+
+    for (i = 0; i < 3 * SIM_NUM_IMU_ID_PARAMS; i++) {
+        slot = buf + 1 + (1 + i / 3) * PARAM_BYTE_SLOT;
+        slot[0] = TYPE_UINT8;
+        slot[1] = 3;
+        slot[2 + i % 3] = i < num_imus ? i : 255;
+    }
+
+    for (i = 0; i < num_mag; i++) {
+        slot = buf + 1 + (1 + SIM_NUM_IMU_ID_PARAMS + i) * PARAM_BYTE_SLOT;
+        slot[0] = TYPE_UINT8;
+        slot[1] = (2 * i + 1 < num_imus) ? 6 : 3;
+        memset(slot + 2, 1, slot[1]);
+    }
+
+    for (i = 0; i < num_imus; i++) {
+        slot = buf + 1 + (first_imu + i) * PARAM_BYTE_SLOT;
+        slot[0] = TYPE_UINT8;
+        slot[1] = 5;
+        memset(slot + 2, 1, 5);
+    }
+
+    return len;
+}
+
+/** [':'][acc xyz][gyro xyz][mag xyz][quaternion wxyz][temperature][':']
+ *  for each IMU, all of them enabled
+ */
+static int imu_readings(struct device* dev, uint8_t* buf) {
+    double t = dev->last_update / 1e6;
+    int i, k, len = 0;
+
+    for (i = 0; i < num_imus; i++) {
+        buf[len++] = ':';
+        put_int16(buf + len, (short int)(100 * sin(t + i)));
+        put_int16(buf + len + 2, (short int)(100 * cos(t + i)));
+        put_int16(buf + len + 4, 4096);
+        len += 6;
+        for (k = 0; k < 3; k++)
+            put_int16(buf + len + 2 * k, (short int)(rand() % 21 - 10));
+        len += 6;
+        put_int16(buf + len, 300);
+        put_int16(buf + len + 2, -120);
+        put_int16(buf + len + 4, 450);
+        len += 6;
+        put_float(buf + len, 1.0f);
+        put_float(buf + len + 4, 0.0f);
+        put_float(buf + len + 8, 0.0f);
+        put_float(buf + len + 12, 0.0f);
+        len += 16;
+        put_int16(buf + len, 25);
+        len += 2;
+        buf[len++] = ':';
+    }
+
+    return len;
+}
+
+static void info_text(struct device* dev, int info_type, char* text) {
+    switch (info_type) {
+        case INFO_ALL:
+            sprintf(text, "Firmware version: qbsim\r\n\r\nDEVICE INFO\r\nID: %d\r\n"
+                    "Sensor resolution: 0 0 0\r\nMotor reference: %d %d\r\n"
+                    "Sensors: %d %d %d\r\nDevice active: %s\r\n",
+                    dev->id, dev->inputs[0], dev->inputs[1], (int)dev->position[0],
+                    (int)dev->position[1], (int)(dev->position[0] + dev->position[1]) / 2,
+                    dev->active ? "TRUE" : "FALSE");
+            break;
+        case INFO_READING:
+            sprintf(text, "Simulated device %d\r\nRequests: %ld\r\n", dev->id, dev->requests);
+            break;
+        case GET_SD_PARAM:
+            sprintf(text, "Device ID,%d\r\nCurrent limit,1500\r\n", dev->id);
+            break;
+        case GET_SD_DATA:
+            strcpy(text, "Date,Cycles\r\n2024-01-15,1200\r\n2024-01-16,950\r\n");
+            break;
+        case GET_SD_EMG_HIST:
+            strcpy(text, "EMG1,EMG2\r\n120,340\r\n118,352\r\n");
+            break;
+        case GET_SD_R01_SUMM:
+            strcpy(text, "R01 summary\r\nSessions,2\r\n");
+            break;
+        case GET_SD_FS_TREE:
+            strcpy(text, "\\USER1\\2024\\01\\15,2\r\n\\USER1\\2024\\01\\16,2\r\n");
+            break;
+        default:
+            strcpy(text, "");
+            break;
+    }
+}
+
+/** Build in r the reply of dev to pkt, r->len stays 0 if there is none
+ */
+void answer(struct device* dev, const qbpacket* pkt, struct reply* r) {
+    uint8_t data[SIM_REPLY_LEN];
+    double values[SIM_NUM_SENSORS];
+    char text[SIM_REPLY_LEN];
+    int index, len, k;
+
+    r->len = 0;
+
+    switch (pkt->cmd) {
+        case CMD_PING:
+            reply_packet(r, dev->id, CMD_PING, NULL, 0);
+            break;
+
+        case CMD_ACTIVATE:
+            if (pkt->data_len >= 1)
+                dev->active = (pkt->data[0] & 0x03) ? 1 : 0;
+            break;
+
+        case CMD_GET_ACTIVATE:
+            data[0] = dev->active ? 0x03 : 0x00;
+            reply_packet(r, dev->id, CMD_GET_ACTIVATE, data, 1);
+            break;
+
+        case CMD_SET_INPUTS:
+        case CMD_SET_POS_STIFF:
+            if (pkt->data_len >= 4) {
+                dev->inputs[0] = (short int)((pkt->data[0] << 8) | pkt->data[1]);
+                dev->inputs[1] = (short int)((pkt->data[2] << 8) | pkt->data[3]);
+            }
+            break;
+
+        case CMD_GET_INPUTS:
+            put_int16(data, dev->inputs[0]);
+            put_int16(data + 2, dev->inputs[1]);
+            reply_packet(r, dev->id, CMD_GET_INPUTS, data, 4);
+            break;
+
+        case CMD_GET_MEASUREMENTS:
+            sensors(dev, values, dev->position);
+            put_values(data, values, SIM_NUM_SENSORS);
+            reply_packet(r, dev->id, CMD_GET_MEASUREMENTS, data, 2 * SIM_NUM_SENSORS);
+            break;
+
+        case CMD_GET_VELOCITIES:
+            sensors(dev, values, dev->velocity);
+            put_values(data, values, SIM_NUM_SENSORS);
+            reply_packet(r, dev->id, CMD_GET_VELOCITIES, data, 2 * SIM_NUM_SENSORS);
+            break;
+
+        case CMD_GET_ACCELERATIONS:
+            sensors(dev, values, dev->acceleration);
+            put_values(data, values, SIM_NUM_SENSORS);
+            reply_packet(r, dev->id, CMD_GET_ACCELERATIONS, data, 2 * SIM_NUM_SENSORS);
+            break;
+
+        case CMD_GET_CURRENTS:
+        case CMD_GET_CURR_AND_MEAS:
+            for (k = 0; k < 2; k++)
+                values[k] = dev->active ? (dev->inputs[k] - dev->position[k]) / 4 : 0;
+            put_values(data, values, 2);
+            len = 4;
+            if (pkt->cmd == CMD_GET_CURR_AND_MEAS) {
+                sensors(dev, values, dev->position);
+                put_values(data + 4, values, SIM_NUM_SENSORS);
+                len += 2 * SIM_NUM_SENSORS;
+            }
+            reply_packet(r, dev->id, pkt->cmd, data, len);
+            break;
+
+        case CMD_GET_EMG:
+            values[0] = 512 + 400 * sin(dev->last_update / 1e6 * M_PI);
+            values[1] = 512 + 400 * cos(dev->last_update / 1e6 * M_PI);
+            put_values(data, values, 2);
+            reply_packet(r, dev->id, CMD_GET_EMG, data, 4);
+            break;
+
+        case CMD_GET_IMU_READINGS:
+            len = imu_readings(dev, data);
+            reply_long(r, dev->id, CMD_GET_IMU_READINGS, data, len);
+            break;
+
+        case CMD_GET_INFO:
+            info_text(dev, pkt->data_len >= 2 ? (pkt->data[0] << 8) | pkt->data[1] :
+                    pkt->data_len == 1 ? pkt->data[0] : INFO_ALL, text);
+            reply_text(r, text);
+            break;
+
+        case CMD_GET_SD_SINGLE_FILE:
+        {
+            char path[256];
+
+            len = pkt->data_len < 255 ? pkt->data_len : 255;
+            memcpy(path, pkt->data, len);
+            path[len] = '\0';
+            sprintf(text, "File,%s\r\nDevice,%d\r\n", path, dev->id);
+            reply_text(r, text);
+            break;
+        }
+
+        case CMD_GET_PARAM_LIST:
+            index = pkt->data_len >= 2 ? (pkt->data[0] << 8) | pkt->data[1] : 0;
+            if (index == 0) {
+                len = param_list(dev, data);
+                reply_long(r, dev->id, CMD_GET_PARAM_LIST, data, len);
+                break;
+            }
+            // set a parameter, values as they are on the bus
+            if (index <= SIM_NUM_PARAMS) {
+                len = type_size(param_table[index - 1].type) * param_table[index - 1].dim;
+                if (pkt->data_len - 2 < len)
+                    len = pkt->data_len - 2;
+                memcpy(dev->params[index - 1], pkt->data + 2, len);
+            }
+            reply_packet(r, dev->id, SIM_ACK_OK, NULL, 0);
+            break;
+
+        case CMD_GET_IMU_PARAM:
+            len = imu_param_list(data);
+            reply_long(r, dev->id, CMD_GET_IMU_PARAM, data, len);
+            break;
+
+        case CMD_STORE_PARAMS:
+        case CMD_STORE_DEFAULT_PARAMS:
+        case CMD_RESTORE_PARAMS:
+        case CMD_SET_ZEROS:
+        case CMD_INIT_MEM:
+        case CMD_CALIBRATE:
+        case CMD_HAND_CALIBRATE:
+            reply_packet(r, dev->id, SIM_ACK_OK, NULL, 0);
+            break;
+
+        case CMD_SET_WATCHDOG:
+        case CMD_SET_CUFF_INPUTS:
+        case CMD_SET_BAUDRATE:
+            break;
+
+        default:
+            num_unknown++;
+            if (verbose)
+                printf("Device %d: unknown command %d\n", dev->id, pkt->cmd);
+            break;
+    }
+}
+
+
+//==============================================================================
+//                                                                           bus
+//==============================================================================
+
+/** Wire time of n bytes, 10 bits each [us]
+ */
+static long long wire_time(int n) {
+    return (long long)n * 10 * 1000000 / baudrate;
+}
+
+void handle_request(const qbpacket* pkt, int request_len) {
+    struct device* dev = NULL;
+    struct reply* r;
+    long long now = rt_sched_now_us();
+    int i;
+
+    num_requests++;
+
+    if (loss > 0 && rand() < loss / 100 * ((double)RAND_MAX + 1)) {
+        num_lost++;
+        if (verbose)
+            printf("Lost request %d to device %d\n", pkt->cmd, pkt->id);
+        return;
+    }
+
+    // ID 0 reaches every device, the first one answers
+    for (i = 0; i < num_devices; i++) {
+        if (pkt->id != 0 && devices[i].id != pkt->id)
+            continue;
+
+        update_device(&devices[i], now);
+        devices[i].requests++;
+
+        if (dev == NULL) {
+            dev = &devices[i];
+            continue;
+        }
+        // the others only take the commands without reply
+        if (pkt->cmd == CMD_ACTIVATE || pkt->cmd == CMD_SET_INPUTS || pkt->cmd == CMD_SET_POS_STIFF) {
+            struct reply none;
+            answer(&devices[i], pkt, &none);
+        }
+    }
+
+    if (dev == NULL)
+        return;
+
+    if (pending_count == SIM_MAX_PENDING) {
+        puts("Too many replies pending");
+        return;
+    }
+
+    r = &pending[(pending_head + pending_count) % SIM_MAX_PENDING];
+    answer(dev, pkt, r);
+    if (verbose)
+        printf("Device %d: command %d, %d bytes of reply\n", dev->id, pkt->cmd, r->len);
+    if (r->len == 0)
+        return;
+
+    r->due = now + wire_time(request_len) + latency + (jitter ? rand() % (jitter + 1) : 0);
+    if (r->due < bus_free)
+        r->due = bus_free;
+    bus_free = r->due + wire_time(r->len);
+    pending_count++;
+}
+
+/** Write the replies whose time has come
+ */
+void send_due(int fd) {
+    struct reply* r;
+    long long now = rt_sched_now_us();
+    int sent, n;
+
+    while (pending_count > 0 && pending[pending_head].due <= now) {
+        r = &pending[pending_head];
+        for (sent = 0; sent < r->len; sent += n) {
+            n = write(fd, r->data + sent, r->len - sent);
+            if (n <= 0) {
+                if (n < 0 && errno == EINTR) {
+                    n = 0;
+                    continue;
+                }
+                perror("Error writing the pseudo terminal");
+                quit = 1;
+                return;
+            }
+        }
+        num_replies++;
+        pending_head = (pending_head + 1) % SIM_MAX_PENDING;
+        pending_count--;
+    }
+}
+
+
+//==============================================================================
+//                                                                        replay
+//==============================================================================
+
+/** Wait until the bytes of the next recorded request are in buf.
+ *  Returns 0, or -1 on CTRL-C or on errors.
+ */
+static int replay_receive(int master, uint8_t* buf, int* len, int needed) {
+    struct timeval tv;
+    fd_set fds;
+    int n;
+
+    while (*len < needed) {
+        if (quit)
+            return -1;
+
+        FD_ZERO(&fds);
+        FD_SET(master, &fds);
+        tv.tv_sec = 0;
+        tv.tv_usec = 100000;
+        n = select(master + 1, &fds, NULL, NULL, &tv);
+        if (n < 0 && errno != EINTR)
+            return -1;
+        if (n <= 0)
+            continue;
+
+        n = read(master, buf + *len, SIM_REPLY_LEN - *len);
+        if (n <= 0)
+            return -1;
+        *len += n;
+    }
+
+    return 0;
+}
+
+static void replay_sleep_until(long long due) {
+    long long wait = due - rt_sched_now_us();
+
+    if (wait > 0)
+        usleep(wait);
+}
+
+/** A turn is the request chunks up to the next reply chunk and the reply
+ *  chunks up to the next request
+ */
+int replay(int master, const char* filename) {
+    capture cap;
+    capture_record* records = NULL;
+    int num_records = 0, size = 0;
+    uint8_t request[SIM_REPLY_LEN];
+    uint8_t in[SIM_REPLY_LEN];
+    int request_len, in_len = 0;
+    long turns = 0, mismatches = 0;
+    long long request_time, received;
+    int capture_baudrate = 0;
+    int i, k, ret;
+
+    if (capture_open(&cap, filename, &capture_baudrate))
+        return -1;
+
+    for (;;) {
+        if (num_records == size) {
+            size = size ? 2 * size : 1024;
+            records = (capture_record*) realloc(records, size * sizeof(capture_record));
+            if (records == NULL) {
+                puts("Not enough memory for the capture");
+                capture_close(&cap);
+                return -1;
+            }
+        }
+        ret = capture_next(&cap, &records[num_records]);
+        if (ret <= 0)
+            break;
+        num_records++;
+    }
+    capture_close(&cap);
+
+    if (ret < 0)
+        puts("The capture is corrupted, replaying the records before the error");
+    printf("%d records captured at BaudRate %d\n", num_records, capture_baudrate);
+    fflush(stdout);
+
+    i = 0;
+    while (i < num_records && !quit) {
+        // the recorded request, chunks joined
+        request_len = 0;
+        request_time = 0;
+        while (i < num_records && records[i].direction == CAPTURE_TO_DEVICE) {
+            if (request_len + records[i].len <= SIM_REPLY_LEN) {
+                memcpy(request + request_len, records[i].data, records[i].len);
+                request_len += records[i].len;
+            }
+            request_time = records[i].time;
+            i++;
+        }
+
+        if (request_len > 0) {
+            if (replay_receive(master, in, &in_len, request_len))
+                break;
+            received = rt_sched_now_us();
+            if (memcmp(in, request, request_len)) {
+                mismatches++;
+                if (verbose)
+                    printf("Request %ld differs from the capture\n", turns);
+            }
+            memmove(in, in + request_len, in_len - request_len);
+            in_len -= request_len;
+            turns++;
+        }
+        else {
+            // replies recorded before any request leave right away
+            received = rt_sched_now_us();
+            request_time = records[i].time;
+        }
+
+        // the replies, with the delay they had from the request
+        for (k = i; k < num_records && records[k].direction == CAPTURE_TO_HOST && !quit; k++) {
+            replay_sleep_until(received + records[k].time - request_time);
+            if (write(master, records[k].data, records[k].len) != records[k].len) {
+                perror("Error writing the pseudo terminal");
+                quit = 1;
+                break;
+            }
+            num_replies++;
+        }
+        i = k;
+    }
+
+    // the tool may still be reading the last reply
+    if (i == num_records) {
+        puts("End of the capture, CTRL-C to quit");
+        fflush(stdout);
+        while (!quit)
+            usleep(100000);
+    }
+
+    printf("Requests replayed: %ld of the capture\n", turns);
+    printf("Requests different from the capture: %ld\n", mismatches);
+    printf("Replies: %ld\n", num_replies);
+
+    free(records);
+    return 0;
+}
+
+//==============================================================================
+//                                                          CTRL-C interruptions
+//==============================================================================
+
+void int_handler(int sig) {
+    quit = 1;
+}
+
+
+//==============================================================================
+//                                                                 display usage
+//==============================================================================
+
+void display_usage() {
+    puts("usage: qbsim [OPTIONS]");
+    puts("Simulates a chain of boards on a pseudo terminal, for the tools to run");
+    puts("with no hardware.");
+    puts("");
+    puts(" -i <id,id,...>   IDs of the simulated devices (default 1).");
+    puts(" -l <usec>        Reply latency (default 300).");
+    puts(" -j <usec>        Random jitter added to the latency (default 0).");
+    puts(" -L <percent>     Requests lost without reply (default 0).");
+    puts(" -b <baudrate>    Baud rate of the wire time of the bytes (default 2000000).");
+    puts(" -n <imus>        IMUs on every device (default 1).");
+    puts(" -c <file>        Write \"serialport <pty>\" in file, e.g.");
+    puts("                  ../conf_files/qbmove.conf.");
+    puts(" -s <seed>        Seed of the jitter and of the losses (default 1).");
+    puts(" -r <capture>     Replay a capture of qbadmin --capture instead of");
+    puts("                  simulating the devices.");
+    puts(" -v               Verbose mode.");
+    puts(" -h               Shows this information.");
+}
+
+#else
+
+int main(int argc, char **argv) {
+    puts("qbsim is only available on Linux and macOS.");
+    return 0;
+}
+
+#endif
+
+/* [] END OF FILE */
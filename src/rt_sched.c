@@ -0,0 +1,214 @@
+// ----------------------------------------------------------------------------
+// BSD 3-Clause License
+
+// Copyright (c) 2016, qbrobotics
+// Copyright (c) 2017-2024, Centro "E.Piaggio"
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// POSSIBILITY OF SUCH DAMAGE.
+// ----------------------------------------------------------------------------
+
+/**
+* \file         rt_sched.c
+*
+* \brief        Periodic scheduler for the control loops
+* \author       _Centro "E.Piaggio"_
+* \copyright    (C) 2017-2024 Centro "E.Piaggio". All rights reserved.
+*/
+
+#include "rt_sched.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+    #include <sched.h>
+#endif
+
+#define NSEC_PER_SEC 1000000000LL
+
+static void timespec_add_ns(struct timespec* t, long long ns) {
+    long long nsec = t->tv_nsec + ns % NSEC_PER_SEC;
+
+    t->tv_sec += ns / NSEC_PER_SEC + nsec / NSEC_PER_SEC;
+    t->tv_nsec = nsec % NSEC_PER_SEC;
+}
+
+static long long timespec_diff_ns(const struct timespec* a, const struct timespec* b) {
+    return (b->tv_sec - a->tv_sec) * NSEC_PER_SEC + (b->tv_nsec - a->tv_nsec);
+}
+
+//==============================================================================
+//                                                                         setup
+//==============================================================================
+
+int rt_sched_setup(int priority, int cpu) {
+    int ret = 0;
+
+#if defined(__linux__)
+    if (priority > 0) {
+        struct sched_param param;
+
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = priority;
+        if (sched_setscheduler(0, SCHED_FIFO, &param)) {
+            printf("Cannot set SCHED_FIFO priority %d: %s\n", priority, strerror(errno));
+            ret = -1;
+        }
+    }
+
+    if (cpu >= 0) {
+        cpu_set_t set;
+
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        if (sched_setaffinity(0, sizeof(set), &set)) {
+            printf("Cannot pin the process to CPU %d: %s\n", cpu, strerror(errno));
+            ret = -1;
+        }
+    }
+#else
+    if (priority > 0 || cpu >= 0) {
+        puts("Real-time priority and CPU pinning are only supported on Linux.");
+        ret = -1;
+    }
+#endif
+
+    return ret;
+}
+
+//==============================================================================
+//                                                                      schedule
+//==============================================================================
+
+void rt_sched_start(rt_sched* sched, long long period) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    rt_sched_start_at(sched, &now, period);
+}
+
+void rt_sched_start_at(rt_sched* sched, const struct timespec* start, long long period) {
+    sched->start = *start;
+    sched->period = period;
+    sched->tick = 0;
+
+    sched->num_ticks = 0;
+    sched->overruns = 0;
+    sched->skipped = 0;
+    sched->late_min = 0;
+    sched->late_max = 0;
+    sched->late_sum = 0;
+}
+
+long rt_sched_wait(rt_sched* sched) {
+    struct timespec deadline = sched->start;
+    struct timespec now;
+    long long late;
+
+    timespec_add_ns(&deadline, sched->tick * sched->period);
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (timespec_diff_ns(&deadline, &now) > 0) {
+        // The previous tick took longer than a period, run this one now.
+        // The first tick has no previous one, it is merely started late.
+        if (sched->num_ticks > 0)
+            sched->overruns++;
+    }
+    else {
+#if defined(__linux__)
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR);
+#else
+        long long wait = timespec_diff_ns(&now, &deadline);
+        usleep((useconds_t)(wait / 1000));
+#endif
+        clock_gettime(CLOCK_MONOTONIC, &now);
+    }
+
+    late = timespec_diff_ns(&deadline, &now);
+    if (sched->num_ticks == 0 || late < sched->late_min)
+        sched->late_min = late;
+    if (sched->num_ticks == 0 || late > sched->late_max)
+        sched->late_max = late;
+    sched->late_sum += late;
+    sched->num_ticks++;
+
+    return sched->tick++;
+}
+
+long rt_sched_wait_skip(rt_sched* sched) {
+    struct timespec deadline = sched->start;
+    struct timespec now;
+    long long behind;
+
+    if (sched->period > 0) {
+        timespec_add_ns(&deadline, sched->tick * sched->period);
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
+        behind = timespec_diff_ns(&deadline, &now) / sched->period;
+        if (behind > 0) {
+            sched->tick += behind;
+            sched->skipped += behind;
+        }
+    }
+
+    return rt_sched_wait(sched);
+}
+
+long long rt_sched_now_us() {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+}
+
+long long rt_sched_elapsed(rt_sched* sched) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return timespec_diff_ns(&sched->start, &now) / 1000;
+}
+
+//==============================================================================
+//                                                                    statistics
+//==============================================================================
+
+void rt_sched_print(rt_sched* sched, FILE* out) {
+    if (sched->num_ticks == 0)
+        return;
+
+    fprintf(out, "Tick jitter (usec): min %.1f  avg %.1f  max %.1f\n",
+            sched->late_min / 1000.0,
+            sched->late_sum / sched->num_ticks / 1000.0,
+            sched->late_max / 1000.0);
+    fprintf(out, "Overruns: %ld of %ld ticks\n", sched->overruns, sched->num_ticks);
+}
+
+/* [] END OF FILE */
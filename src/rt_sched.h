@@ -0,0 +1,104 @@
+// ----------------------------------------------------------------------------
+// BSD 3-Clause License
+
+// Copyright (c) 2016, qbrobotics
+// Copyright (c) 2017-2024, Centro "E.Piaggio"
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// POSSIBILITY OF SUCH DAMAGE.
+// ----------------------------------------------------------------------------
+
+/**
+* \file         rt_sched.h
+*
+* \brief        Periodic scheduler for the control loops
+* \author       _Centro "E.Piaggio"_
+* \copyright    (C) 2017-2024 Centro "E.Piaggio". All rights reserved.
+*
+* \details      Ticks are placed at absolute deadlines start + i * period on
+*               CLOCK_MONOTONIC, so the loop neither drifts nor busy-waits.
+*               Every tick records how late the loop woke up; the statistics
+*               are printed at the end of the run.
+*/
+
+#ifndef RT_SCHED_H_INCLUDED
+#define RT_SCHED_H_INCLUDED
+
+#include <stdio.h>
+#include <time.h>
+
+typedef struct rt_sched {
+    struct timespec start;      ///< Deadline of tick 0
+    long long period;           ///< Tick period [ns]
+    long tick;                  ///< Index of the next tick
+
+    long num_ticks;             ///< Ticks waited so far
+    long overruns;              ///< Ticks whose deadline the previous tick had passed
+    long skipped;               ///< Ticks dropped by rt_sched_wait_skip
+    long long late_min;         ///< Min wake-up lateness [ns]
+    long long late_max;         ///< Max wake-up lateness [ns]
+    double late_sum;            ///< Sum of wake-up lateness [ns]
+} rt_sched;
+
+/** Use SCHED_FIFO with the given priority (0 keeps the default policy) and
+ *  pin the process to cpu (-1 for any). Returns 0 on success.
+ */
+int rt_sched_setup(int priority, int cpu);
+
+/** Start a schedule with the given period [ns], tick 0 is now
+ */
+void rt_sched_start(rt_sched* sched, long long period);
+
+/** Start a schedule whose tick 0 is at an absolute CLOCK_MONOTONIC time,
+ *  used to start several loops on the same grid
+ */
+void rt_sched_start_at(rt_sched* sched, const struct timespec* start, long long period);
+
+/** Sleep until the deadline of the next tick and return its index
+ */
+long rt_sched_wait(rt_sched* sched);
+
+/** Like rt_sched_wait, but ticks whose whole period has already passed are
+ *  skipped instead of being run late. Returns the index of the tick, so
+ *  skipped ticks show up as gaps.
+ */
+long rt_sched_wait_skip(rt_sched* sched);
+
+/** Now on CLOCK_MONOTONIC [us], the clock of every time stamp of the tools
+ */
+long long rt_sched_now_us();
+
+/** Microseconds elapsed since the start of the schedule
+ */
+long long rt_sched_elapsed(rt_sched* sched);
+
+/** Print jitter and overrun statistics
+ */
+void rt_sched_print(rt_sched* sched, FILE* out);
+
+#endif
+/* [] END OF FILE */
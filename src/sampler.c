@@ -0,0 +1,339 @@
+// ----------------------------------------------------------------------------
+// BSD 3-Clause License
+
+// Copyright (c) 2016, qbrobotics
+// Copyright (c) 2017-2024, Centro "E.Piaggio"
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// POSSIBILITY OF SUCH DAMAGE.
+// ----------------------------------------------------------------------------
+
+/**
+* \file         sampler.c
+*
+* \brief        Scheduled sampler of measurements, velocities, accelerations
+*               and currents
+* \author       _Centro "E.Piaggio"_
+* \copyright    (C) 2017-2024 Centro "E.Piaggio". All rights reserved.
+*/
+
+#include "sampler.h"
+#include "byte_order.h"
+#include "qbmetered.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32) || defined(_WIN64)
+    #include <io.h>
+    #include <fcntl.h>
+#endif
+
+//==============================================================================
+//                                                                      channels
+//==============================================================================
+
+static int get_currents(comm_settings* cs, int id, short int* values) {
+    // commGetCurrents returns 0 on success, the motors are always two
+    if (commGetCurrents(cs, id, values) < 0)
+        return -1;
+    return 2;
+}
+
+static const struct {
+    char letter;
+    const char* name;               ///< Prefix of the CSV columns
+    int (*get)(comm_settings*, int, short int*);    ///< Returns the number of values or < 0
+} channel_table[] = {
+    { 'g', "meas", commGetMeasurements },
+    { 'i', "vel",  commGetVelocities },
+    { 'o', "acc",  commGetAccelerations },
+    { 'c', "curr", get_currents }
+};
+
+#define NUM_CHANNEL_TYPES ((int)(sizeof(channel_table) / sizeof(channel_table[0])))
+
+int sampler_add_channels(sampler* s, const char* list) {
+    const char* p = list;
+    sampler_channel* ch;
+    int type, divisor, n;
+
+    while (*p) {
+        for (type = 0; type < NUM_CHANNEL_TYPES; type++)
+            if (channel_table[type].letter == *p)
+                break;
+        if (type == NUM_CHANNEL_TYPES || s->num_channels == SAMPLER_MAX_CHANNELS) {
+            fprintf(stderr, "Wrong channel list %s\n", list);
+            return -1;
+        }
+        p++;
+
+        divisor = 1;
+        if (*p == ':') {
+            if (sscanf(p + 1, "%d%n", &divisor, &n) != 1 || divisor < 1 || divisor > 65535) {
+                fprintf(stderr, "Wrong channel list %s\n", list);
+                return -1;
+            }
+            p += 1 + n;
+        }
+        if (*p == ',')
+            p++;
+        else if (*p) {
+            fprintf(stderr, "Wrong channel list %s\n", list);
+            return -1;
+        }
+
+        ch = &s->channels[s->num_channels++];
+        memset(ch, 0, sizeof(*ch));
+        ch->type = type;
+        ch->divisor = divisor;
+    }
+
+    return 0;
+}
+
+//==============================================================================
+//                                                                        output
+//==============================================================================
+
+static void sampler_header(sampler* s, int id) {
+    uint8_t header[SAMPLER_HEADER_LEN + 4 * SAMPLER_MAX_CHANNELS];
+    sampler_channel* ch;
+    uint16_t u16;
+    uint32_t u32;
+    int c, k;
+
+    if (!s->binary) {
+        fprintf(s->out, "sample,time_us");
+        for (c = 0; c < s->num_channels; c++) {
+            ch = &s->channels[c];
+            for (k = 0; k < ch->num_values; k++)
+                fprintf(s->out, ",%s_%d", channel_table[ch->type].name, k + 1);
+        }
+        fprintf(s->out, "\n");
+        return;
+    }
+
+    memcpy(header, SAMPLER_MAGIC, 4);
+    u16 = QB_LE16((uint16_t)SAMPLER_VERSION);
+    memcpy(header + 4, &u16, 2);
+    u16 = QB_LE16((uint16_t)s->num_channels);
+    memcpy(header + 6, &u16, 2);
+    u32 = QB_LE32((uint32_t)s->period);
+    memcpy(header + 8, &u32, 4);
+    u32 = QB_LE32((uint32_t)id);
+    memcpy(header + 12, &u32, 4);
+    for (c = 0; c < s->num_channels; c++) {
+        ch = &s->channels[c];
+        header[SAMPLER_HEADER_LEN + 4 * c] = channel_table[ch->type].letter;
+        header[SAMPLER_HEADER_LEN + 4 * c + 1] = (uint8_t)ch->num_values;
+        u16 = QB_LE16((uint16_t)ch->divisor);
+        memcpy(header + SAMPLER_HEADER_LEN + 4 * c + 2, &u16, 2);
+    }
+    fwrite(header, 1, SAMPLER_HEADER_LEN + 4 * s->num_channels, s->out);
+}
+
+static void sampler_record(sampler* s, long index, long long time, uint32_t fresh) {
+    uint8_t record[16 + 2 * SAMPLER_MAX_VALUES * SAMPLER_MAX_CHANNELS];
+    sampler_channel* ch;
+    uint64_t u64;
+    uint32_t u32;
+    uint16_t u16;
+    int len = 16;
+    int c, k;
+
+    if (!s->binary) {
+        fprintf(s->out, "%ld,%lld", index, time);
+        for (c = 0; c < s->num_channels; c++) {
+            ch = &s->channels[c];
+            for (k = 0; k < ch->num_values; k++) {
+                if (fresh & (1 << c))
+                    fprintf(s->out, ",%d", ch->values[k]);
+                else
+                    fputc(',', s->out);
+            }
+        }
+        fprintf(s->out, "\n");
+        return;
+    }
+
+    u64 = QB_LE64((uint64_t)time);
+    memcpy(record, &u64, 8);
+    u32 = QB_LE32((uint32_t)index);
+    memcpy(record + 8, &u32, 4);
+    u32 = QB_LE32(fresh);
+    memcpy(record + 12, &u32, 4);
+    for (c = 0; c < s->num_channels; c++) {
+        ch = &s->channels[c];
+        for (k = 0; k < ch->num_values; k++) {
+            u16 = QB_LE16((uint16_t)ch->values[k]);
+            memcpy(record + len, &u16, 2);
+            len += 2;
+        }
+    }
+    fwrite(record, 1, len, s->out);
+}
+
+//==============================================================================
+//                                                                           run
+//==============================================================================
+
+int sampler_prepare(sampler* s, comm_settings* cs, int id) {
+    sampler_channel* ch;
+    int c, n;
+
+    s->samples = 0;
+    s->errors = 0;
+    s->skipped = 0;
+    s->elapsed = 0;
+
+    // The number of values of every channel is fixed for the whole stream
+    for (c = 0; c < s->num_channels; c++) {
+        ch = &s->channels[c];
+        n = channel_table[ch->type].get(cs, id, ch->values);
+        if (n <= 0 || n > SAMPLER_MAX_VALUES) {
+            fprintf(stderr, "An error occurred or the device does not support channel %c\n",
+                    channel_table[ch->type].letter);
+            return -1;
+        }
+        ch->num_values = n;
+    }
+
+#if defined(_WIN32) || defined(_WIN64)
+    if (s->binary && s->out == stdout)
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    setvbuf(s->out, NULL, _IOFBF, SAMPLER_BUFFER_SIZE);
+    sampler_header(s, id);
+
+    return 0;
+}
+
+void sampler_loop(sampler* s, comm_settings* cs, int id) {
+    rt_sched* sched = &s->sched;
+    sampler_channel* ch;
+    short int values[SAMPLER_MAX_VALUES];
+    uint32_t fresh, due;
+    long index;
+    long long time;
+    int c, n;
+
+    if (s->start != NULL)
+        rt_sched_start_at(sched, s->start, s->period * 1000);
+    else
+        rt_sched_start(sched, s->period * 1000);
+
+    while (!s->stop) {
+        // with period 0 only tick 0 waits, for a start in the future
+        if (s->period > 0 || sched->tick == 0)
+            index = rt_sched_wait_skip(sched);
+        else
+            index = sched->tick++;
+
+        if (s->max_samples > 0 && index >= s->max_samples)
+            break;
+
+        time = rt_sched_elapsed(sched);
+        if (sched->num_ticks == 1)
+            s->first_late = time - index * s->period;
+
+        // Requests of the channels due in this tick, back to back
+        fresh = 0;
+        due = 0;
+        for (c = 0; c < s->num_channels; c++) {
+            ch = &s->channels[c];
+            if (index % ch->divisor)
+                continue;
+            due |= 1 << c;
+
+            n = channel_table[ch->type].get(cs, id, values);
+            if (n != ch->num_values) {
+                ch->errors++;
+                continue;
+            }
+            memcpy(ch->values, values, n * sizeof(short int));
+            ch->reads++;
+            fresh |= 1 << c;
+
+            if (s->pub != NULL)
+                telemetry_publish_short(s->pub, channel_table[ch->type].letter, values, n);
+        }
+
+        // No record for ticks with nothing due, an error if every request failed
+        if (due == 0)
+            continue;
+        if (fresh == 0) {
+            s->errors++;
+            continue;
+        }
+
+        sampler_record(s, index, time, fresh);
+        s->samples++;
+    }
+
+    s->elapsed = rt_sched_elapsed(sched);
+    s->skipped = sched->skipped;
+    fflush(s->out);
+}
+
+int sampler_run(sampler* s, comm_settings* cs, int id) {
+    if (sampler_prepare(s, cs, id))
+        return -1;
+
+    sampler_loop(s, cs, id);
+
+    return 0;
+}
+
+//==============================================================================
+//                                                                    statistics
+//==============================================================================
+
+void sampler_print(sampler* s, FILE* out) {
+    long ticks = s->samples + s->errors;
+    sampler_channel* ch;
+    int c;
+
+    fprintf(out, "Samples: %ld of %ld ticks (errors %ld), skipped ticks %ld\n",
+            s->samples, ticks, s->errors, s->skipped);
+    for (c = 0; c < s->num_channels; c++) {
+        ch = &s->channels[c];
+        fprintf(out, "  %c (%s) every %d ticks: %ld reads, %ld errors\n",
+                channel_table[ch->type].letter, channel_table[ch->type].name,
+                ch->divisor, ch->reads, ch->errors);
+    }
+    if (s->elapsed > 0)
+        fprintf(out, "Achieved rate: %.1f Hz over %.3f s\n",
+                s->samples * 1000000.0 / s->elapsed, s->elapsed / 1000000.0);
+    if (s->period > 0) {
+        fprintf(out, "Requested rate: %.1f Hz\n", 1000000.0 / s->period);
+        rt_sched_print(&s->sched, out);
+    }
+}
+
+/* [] END OF FILE */
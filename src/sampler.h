@@ -0,0 +1,152 @@
+// ----------------------------------------------------------------------------
+// BSD 3-Clause License
+
+// Copyright (c) 2016, qbrobotics
+// Copyright (c) 2017-2024, Centro "E.Piaggio"
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// POSSIBILITY OF SUCH DAMAGE.
+// ----------------------------------------------------------------------------
+
+/**
+* \file         sampler.h
+*
+* \brief        Scheduled sampler of measurements, velocities, accelerations
+*               and currents
+* \author       _Centro "E.Piaggio"_
+* \copyright    (C) 2017-2024 Centro "E.Piaggio". All rights reserved.
+*
+* \details      One loop interleaves the requests of every channel on the
+*               bus. Ticks are placed on a fixed grid of CLOCK_MONOTONIC
+*               deadlines, or back to back when the period is 0, and a
+*               channel with divisor d is read every d ticks. A tick whose
+*               slot has already passed is skipped, not taken late, so tick
+*               indices stay aligned to the grid and every missed sample
+*               shows up as a gap in the index.
+*
+*               Channels are given as a comma separated list of letters,
+*               the same as the console options, each with an optional
+*               divisor: "g,i:2,o:4,c:10".
+*               g  measurements     commGetMeasurements
+*               i  velocities       commGetVelocities
+*               o  accelerations    commGetAccelerations
+*               c  currents         commGetCurrents
+*
+*               CSV output is one row per tick, channels not read in that
+*               tick are left empty:
+*               sample,time_us,meas_1,...,vel_1,...,acc_1,...,curr_1,curr_2
+*
+*               Binary output (little endian) is a header followed by
+*               fixed-size records:
+*               [ 0] char     magic[4] = "QBGS"
+*               [ 4] uint16   version = 2
+*               [ 6] uint16   number of channels
+*               [ 8] uint32   period [us], 0 for as fast as possible
+*               [12] uint32   device id
+*               [16] channel descriptors, 4 bytes each:
+*                    char letter, uint8 values, uint16 divisor
+*               then every record is
+*               [ 0] int64    time of the tick since the start [us]
+*               [ 8] uint32   tick index
+*               [12] uint32   bit k set if channel k was read in this tick
+*               [16] int16    values of every channel, in order; channels
+*                             not read repeat their last values
+*/
+
+#ifndef SAMPLER_H_INCLUDED
+#define SAMPLER_H_INCLUDED
+
+#include <stdio.h>
+#include <signal.h>
+
+#include "../../qbAPI/src/qbmove_communications.h"
+#include "rt_sched.h"
+#include "telemetry.h"
+
+#define SAMPLER_MAGIC           "QBGS"
+#define SAMPLER_VERSION         2
+#define SAMPLER_HEADER_LEN      16
+#define SAMPLER_MAX_CHANNELS    4
+#define SAMPLER_MAX_VALUES      4           ///< Values of a channel
+#define SAMPLER_BUFFER_SIZE     (1 << 16)   ///< stdio buffer of the output
+
+typedef struct sampler_channel {
+    int type;                       ///< Index in the table of sampler.c
+    int divisor;                    ///< Read every divisor ticks
+    int num_values;                 ///< Known after the first request
+    short int values[SAMPLER_MAX_VALUES];
+
+    long reads;                     ///< Successful requests
+    long errors;                    ///< Failed requests
+} sampler_channel;
+
+typedef struct sampler {
+    FILE* out;
+    int binary;                     ///< Binary records instead of CSV
+    long long period;               ///< Tick period [us], 0 = as fast as the bus allows
+    long max_samples;               ///< Stop after this many ticks, 0 = never
+    volatile sig_atomic_t stop;     ///< Set by the CTRL-C handler
+    const struct timespec* start;   ///< CLOCK_MONOTONIC time of tick 0, NULL for now
+    telemetry* pub;                 ///< Shared memory ring of the samples, NULL for none
+
+    int num_channels;
+    sampler_channel channels[SAMPLER_MAX_CHANNELS];
+
+    long samples;                   ///< Records written
+    long errors;                    ///< Ticks whose requests all failed
+    long skipped;                   ///< Ticks whose deadline had passed
+    long long elapsed;              ///< Duration of the run [us]
+    long long first_late;           ///< Wake-up of the first tick after the start [us]
+    rt_sched sched;
+} sampler;
+
+/** Add the channels of list ("g,i:2,c") to s. Returns 0, or -1 on a
+ *  malformed list.
+ */
+int sampler_add_channels(sampler* s, const char* list);
+
+/** Stream the channels of device id to s->out until s->stop is set or
+ *  s->max_samples ticks have passed. Returns 0, or -1 if a channel does
+ *  not answer at all. Same as sampler_prepare followed by sampler_loop.
+ */
+int sampler_run(sampler* s, comm_settings* cs, int id);
+
+/** Read every channel once to know its size and write the header of the
+ *  output. Returns 0, or -1 if a channel does not answer.
+ */
+int sampler_prepare(sampler* s, comm_settings* cs, int id);
+
+/** Ticks of the stream, after sampler_prepare
+ */
+void sampler_loop(sampler* s, comm_settings* cs, int id);
+
+/** Print achieved rate, missed samples, per channel errors and jitter
+ */
+void sampler_print(sampler* s, FILE* out);
+
+#endif
+/* [] END OF FILE */
@@ -0,0 +1,476 @@
+// ----------------------------------------------------------------------------
+// BSD 3-Clause License
+
+// Copyright (c) 2016, qbrobotics
+// Copyright (c) 2017-2024, Centro "E.Piaggio"
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// POSSIBILITY OF SUCH DAMAGE.
+// ----------------------------------------------------------------------------
+
+/**
+* \file         sd_sync.c
+*
+* \brief        Incremental download of the SD card filesystem (-X)
+* \author       _Centro "E.Piaggio"_
+* \copyright    (C) 2017-2024 Centro "E.Piaggio". All rights reserved.
+*/
+
+#include "sd_sync.h"
+#include "qbmetered.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(_WIN32) || defined(_WIN64)
+    #include <io.h>
+    #define SD_SYNC_SEP     "\\"
+#else
+    #include <sys/stat.h>
+    #define SD_SYNC_SEP     "/"
+#endif
+
+#define SD_SYNC_PATH_LEN        300
+
+/** Folder or file of the card, as the manifest records it
+ */
+typedef struct sd_entry {
+    char path[100];                         ///< Path on the card, "\USER\YYYY\MM\DD[\file]"
+    int is_folder;
+    int n_files;                            ///< Folders: files at the last sync
+    int closed;                             ///< Folders: synced while a newer folder of the user existed
+    long size;                              ///< Files: bytes and hash of the local copy
+    uint32_t hash;
+} sd_entry;
+
+typedef struct sd_manifest {
+    sd_entry* entries;
+    int num;
+    int max;
+    FILE* log;                              ///< Each completed file is appended here at once
+} sd_manifest;
+
+//==============================================================================
+//                                                                      manifest
+//==============================================================================
+
+static uint32_t fnv1a(const char* data, long len) {
+    uint32_t hash = 2166136261u;
+    long i;
+
+    for (i = 0; i < len; i++) {
+        hash ^= (uint8_t) data[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static sd_entry* find(sd_manifest* m, const char* path, int is_folder) {
+    int i;
+
+    for (i = 0; i < m->num; i++) {
+        if (m->entries[i].is_folder == is_folder && !strcmp(m->entries[i].path, path))
+            return &m->entries[i];
+    }
+
+    return NULL;
+}
+
+// Entry of path, added if missing. NULL if out of memory.
+static sd_entry* record(sd_manifest* m, const char* path, int is_folder) {
+    sd_entry* e = find(m, path, is_folder);
+    sd_entry* grown;
+
+    if (e != NULL)
+        return e;
+
+    if (m->num == m->max) {
+        grown = (sd_entry*) realloc(m->entries, (m->max ? 2 * m->max : 64) * sizeof(sd_entry));
+        if (grown == NULL)
+            return NULL;
+        m->entries = grown;
+        m->max = m->max ? 2 * m->max : 64;
+    }
+
+    e = &m->entries[m->num++];
+    memset(e, 0, sizeof(*e));
+    strncpy(e->path, path, sizeof(e->path) - 1);
+    e->is_folder = is_folder;
+
+    return e;
+}
+
+static void write_entry(FILE* file, const sd_entry* e) {
+    if (e->is_folder)
+        fprintf(file, "D,%s,%d,%d\n", e->path, e->n_files, e->closed);
+    else
+        fprintf(file, "F,%s,%ld,%08lx\n", e->path, e->size, (unsigned long) e->hash);
+}
+
+// "D,path,n_files,closed" and "F,path,size,hash" lines, the last line of a path wins
+static void load(sd_manifest* m, const char* file) {
+    char line[200];
+    char path[100];
+    unsigned long hash;
+    long size;
+    int n_files;
+    int closed;
+    sd_entry* e;
+    FILE* f = fopen(file, "r");
+
+    if (f == NULL)
+        return;
+
+    while (fgets(line, sizeof(line), f) != NULL) {
+        closed = 0;
+        if (sscanf(line, "D,%99[^,],%d,%d", path, &n_files, &closed) >= 2) {
+            if ((e = record(m, path, 1)) != NULL) {
+                e->n_files = n_files;
+                e->closed = closed;
+            }
+        }
+        else if (sscanf(line, "F,%99[^,],%ld,%lx", path, &size, &hash) == 3) {
+            if ((e = record(m, path, 0)) != NULL) {
+                e->size = size;
+                e->hash = (uint32_t) hash;
+            }
+        }
+    }
+
+    fclose(f);
+}
+
+static void append(sd_manifest* m, const sd_entry* e) {
+    if (m->log == NULL || e == NULL)
+        return;
+
+    write_entry(m->log, e);
+    fflush(m->log);
+}
+
+// One line per entry, replacing the log of the sync
+static void save(const sd_manifest* m, const char* file) {
+    char tmp[SD_SYNC_PATH_LEN + 5];
+    FILE* f;
+    int i;
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", file);
+    f = fopen(tmp, "w");
+    if (f == NULL)
+        return;
+
+    for (i = 0; i < m->num; i++)
+        write_entry(f, &m->entries[i]);
+
+    if (fclose(f)) {
+        remove(tmp);
+        return;
+    }
+#if defined(_WIN32) || defined(_WIN64)
+    remove(file);
+#endif
+    if (rename(tmp, file))
+        remove(tmp);
+}
+
+//==============================================================================
+//                                                                   local files
+//==============================================================================
+
+static int make_dir(const char* path) {
+    int ret;
+
+#if !(defined(_WIN32) || defined(_WIN64))
+    ret = mkdir(path, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
+#else
+    ret = mkdir(path);
+#endif
+
+    // a previous copy is expected
+    return (ret == 0 || errno == EEXIST) ? 0 : -1;
+}
+
+// Create path and the folders above it
+static int make_dirs(char* path) {
+    char* c;
+    char sep;
+
+    for (c = path + 1; *c != '\0'; c++) {
+        if (*c != '/' && *c != '\\')
+            continue;
+        sep = *c;
+        *c = '\0';
+        make_dir(path);
+        *c = sep;
+    }
+
+    return make_dir(path);
+}
+
+// folder followed by the card path, with the separators of the host
+static void local_path(const char* folder, const char* path, char* out, size_t len) {
+    char* c;
+
+    snprintf(out, len, "%s%s", folder, path[0] == '\\' ? path + 1 : path);
+#if !(defined(_WIN32) || defined(_WIN64))
+    for (c = out; *c != '\0'; c++) {
+        if (*c == '\\')
+            *c = '/';
+    }
+#else
+    (void) c;
+#endif
+}
+
+// 1 if the local copy still has the size and hash of the manifest
+static int unchanged(const sd_entry* e, const char* local) {
+    FILE* f = fopen(local, "rb");
+    char* data;
+    long size;
+    int same;
+
+    if (f == NULL)
+        return 0;
+
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    rewind(f);
+
+    data = (char*) malloc(size + 1);
+    same = data != NULL && size == e->size && (long) fread(data, 1, size, f) == size
+            && fnv1a(data, size) == e->hash;
+
+    free(data);
+    fclose(f);
+
+    return same;
+}
+
+// Whole file from the card into local, through local.part
+static int download(comm_settings* cs, int id, char* path, const char* local, char* data, long* size) {
+    char part[SD_SYNC_PATH_LEN + 50];
+    FILE* f;
+    int tries;
+    int ret = -1;
+    int ok;
+
+    // The board answers empty while it opens the file
+    data[0] = '\0';
+    for (tries = 0; tries < SD_SYNC_RETRIES && data[0] == '\0'; tries++) {
+        ret = commGetSDFile(cs, id, path, data);
+        usleep(SD_SYNC_RETRY_PAUSE);
+        fprintf(stdout, ".");
+        fflush(stdout);
+    }
+    if (ret || data[0] == '\0')
+        return -1;
+
+    *size = strlen(data);
+    snprintf(part, sizeof(part), "%s.part", local);
+    f = fopen(part, "wb");
+    if (f == NULL)
+        return -1;
+    ok = (long) fwrite(data, 1, *size, f) == *size;
+    ok = !fclose(f) && ok;
+
+#if defined(_WIN32) || defined(_WIN64)
+    remove(local);
+#endif
+    if (!ok || rename(part, local)) {
+        remove(part);
+        return -1;
+    }
+
+    return 0;
+}
+
+//==============================================================================
+//                                                                          sync
+//==============================================================================
+
+// 1 if no folder of user in tree is newer than path (\USER\YYYY\MM\DD sort as text)
+static int newest(const char* tree, const char* user, const char* path) {
+    char other[100];
+    char other_user[20];
+    const char* row;
+    const char* next;
+
+    for (row = tree; *row != '\0'; row = next) {
+        next = strchr(row, '\n');
+        next = (next != NULL) ? next + 1 : row + strlen(row);
+
+        if (sscanf(row, "%99[^,],", other) != 1 || sscanf(other, "\\%19[^\\]", other_user) != 1)
+            continue;
+        if (!strcmp(other_user, user) && strcmp(other, path) > 0)
+            return 0;
+    }
+
+    return 1;
+}
+
+int sd_sync(comm_settings* cs, int id, const char* tree, const char* folder) {
+    sd_manifest m = { NULL, 0, 0, NULL };
+    char manifest[SD_SYNC_PATH_LEN];
+    char dir[SD_SYNC_PATH_LEN];
+    char local[SD_SYNC_PATH_LEN + 40];
+    char path[100];
+    char file_path[150];
+    char filename[30];
+    char user[20] = "";
+    char last_user[20] = "";
+    char save_user = 0;
+    const char* row;
+    const char* next;
+    char* data;
+    sd_entry* e;
+    long size;
+    long bytes = 0;
+    uint32_t hash;
+    int n_files, old_files, closed, i;
+    int num_new = 0;
+    int num_updated = 0;
+    int num_unchanged = 0;
+    int ret = 0;
+
+    if (make_dir(folder)) {
+        printf("Error in creating SD filesystem folder %s\n", folder);
+        return -1;
+    }
+
+    data = (char*) malloc(SD_SYNC_FILE_LEN);
+    if (data == NULL)
+        return -1;
+
+    snprintf(manifest, sizeof(manifest), "%s%s", folder, SD_SYNC_MANIFEST);
+    load(&m, manifest);
+    m.log = fopen(manifest, "a");
+
+    // Rows like [USER\YYYY\MM\DD, number_of_files]
+    for (row = tree; *row != '\0' && !ret; row = next) {
+        next = strchr(row, '\n');
+        next = (next != NULL) ? next + 1 : row + strlen(row);
+
+        if (sscanf(row, "%99[^,],%d", path, &n_files) != 2)
+            continue;
+        sscanf(path, "\\%19[^\\]", user);
+
+        if (strcmp(user, last_user)) {
+            printf("\nDo you want to save the files of user %s (y/n)? ", user);
+            save_user = 0;
+            fflush(stdin);
+            scanf(" %c", &save_user);
+        }
+        strcpy(last_user, user);
+
+        if (save_user != 'y' && save_user != 'Y')
+            continue;
+
+        // Files of a folder never completed are trusted, it is a resume.
+        // Until the folder is closed its last pair may be still written.
+        e = find(&m, path, 1);
+        old_files = (e != NULL) ? e->n_files : n_files;
+        closed = e != NULL && e->closed && old_files == n_files;
+
+        local_path(folder, path, dir, sizeof(dir));
+        if (make_dirs(dir)) {
+            printf("Error in creating folder %s\n", dir);
+            ret = -1;
+            break;
+        }
+
+        for (i = 0; i < n_files; i++) {
+            if (i % 2 == 0)
+                sprintf(filename, "Param_%d.csv", i / 2);
+            else
+                sprintf(filename, "UseStats_%d.csv", i / 2);
+            snprintf(file_path, sizeof(file_path), "%s\\%s", path, filename);   // separator of the SD filesystem
+            snprintf(local, sizeof(local), "%s%s%s", dir, SD_SYNC_SEP, filename);
+
+            // The last pair of an open folder, or the last one before the
+            // folder got more files, may have been partial
+            e = find(&m, file_path, 0);
+            if (e != NULL && !(i >= n_files - 2 && !closed) && !(i >= old_files - 2 && old_files != n_files)
+                    && unchanged(e, local)) {
+                num_unchanged++;
+                continue;
+            }
+
+            fprintf(stdout, "Getting the file %s ", file_path);
+            fflush(stdout);
+            if (download(cs, id, file_path, local, data, &size)) {
+                fprintf(stdout, " FAILED\n");
+                ret = -1;
+                break;
+            }
+            fprintf(stdout, " OK\n");
+
+            hash = fnv1a(data, size);
+            if (e == NULL)
+                num_new++;
+            else if (e->size != size || e->hash != hash)
+                num_updated++;
+            else
+                num_unchanged++;
+            bytes += size;
+
+            if ((e = record(&m, file_path, 0)) != NULL) {
+                e->size = size;
+                e->hash = hash;
+            }
+            append(&m, e);
+        }
+
+        if (!ret) {
+            if ((e = record(&m, path, 1)) != NULL) {
+                e->n_files = n_files;
+                e->closed = !newest(tree, user, path);
+            }
+            append(&m, e);
+        }
+    }
+
+    if (m.log != NULL)
+        fclose(m.log);
+    save(&m, manifest);
+
+    printf("\n%d new, %d updated, %d unchanged files, %ld bytes downloaded\n", num_new, num_updated,
+            num_unchanged, bytes);
+    if (ret)
+        printf("Sync interrupted, run -X again to resume from the missing files\n");
+
+    free(m.entries);
+    free(data);
+
+    return ret;
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,86 @@
+// ----------------------------------------------------------------------------
+// BSD 3-Clause License
+
+// Copyright (c) 2016, qbrobotics
+// Copyright (c) 2017-2024, Centro "E.Piaggio"
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// POSSIBILITY OF SUCH DAMAGE.
+// ----------------------------------------------------------------------------
+
+/**
+* \file         sd_sync.h
+*
+* \brief        Incremental download of the SD card filesystem (-X)
+* \author       _Centro "E.Piaggio"_
+* \copyright    (C) 2017-2024 Centro "E.Piaggio". All rights reserved.
+*
+* \details      GET_SD_FS_TREE lists the folders of the card with the number
+*               of files of each, "\USER\YYYY\MM\DD,n". A folder holds the
+*               pairs Param_k.csv and UseStats_k.csv, which commGetSDFile
+*               returns whole.
+*
+*               The local copy keeps a manifest, SD_SYNC_MANIFEST in the
+*               folder of the copy, with the file count of every folder
+*               and the size and FNV-1a hash of every file downloaded. A
+*               file is downloaded again only if it is new, if its local
+*               copy is missing or differs from the manifest, or if it is
+*               in the last pair of a folder that is not closed yet.
+*
+*               The device may still be writing the last pair of the
+*               newest folder of a user, with no change in the file count.
+*               A folder is closed in the manifest once it was synced while
+*               a newer folder of its user existed: from then on it is not
+*               written anymore, and its last pair is not read again unless
+*               its file count changes. The card gives no size nor hash
+*               without the content, so the other files are never read
+*               again.
+*
+*               Each file is written to a .part file and renamed when
+*               complete, then appended to the manifest: a sync that stops
+*               halfway resumes from the first file it did not finish.
+*/
+
+#ifndef SD_SYNC_H_INCLUDED
+#define SD_SYNC_H_INCLUDED
+
+#include "../../qbAPI/src/qbmove_communications.h"
+
+#define SD_SYNC_MANIFEST        "manifest.csv"
+#define SD_SYNC_FILE_LEN        20000   ///< Buffer of commGetSDFile
+#define SD_SYNC_RETRIES         20      ///< Empty answers before a file is given up
+#define SD_SYNC_RETRY_PAUSE     500000  ///< Between two requests of a file [us]
+
+/** Download the folders of tree (as GET_SD_FS_TREE returns it) into
+ *  folder, asking for each user whether to save its files. folder may
+ *  already hold a previous copy. Returns 0 on success, -1 if the folder
+ *  cannot be created or a file could not be downloaded.
+ */
+int sd_sync(comm_settings* cs, int id, const char* tree, const char* folder);
+
+#endif
+/* [] END OF FILE */
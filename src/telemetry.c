@@ -0,0 +1,283 @@
+// ----------------------------------------------------------------------------
+// BSD 3-Clause License
+
+// Copyright (c) 2016, qbrobotics
+// Copyright (c) 2017-2024, Centro "E.Piaggio"
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// POSSIBILITY OF SUCH DAMAGE.
+// ----------------------------------------------------------------------------
+
+/**
+* \file         telemetry.c
+*
+* \brief        Shared memory publisher of the samples read by qbadmin
+* \author       _Centro "E.Piaggio"_
+* \copyright    (C) 2017-2024 Centro "E.Piaggio". All rights reserved.
+*/
+
+#include "telemetry.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if !(defined(_WIN32) || defined(_WIN64))
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+
+/** Segment names start with '/'
+ */
+static void telemetry_name(telemetry* t, const char* name) {
+    if (name[0] == '/')
+        snprintf(t->name, sizeof(t->name), "%s", name);
+    else
+        snprintf(t->name, sizeof(t->name), "/%s", name);
+}
+
+static telemetry_slot* telemetry_slot_at(telemetry* t, uint64_t n) {
+    telemetry_header* h = t->header;
+
+    return (telemetry_slot*)((uint8_t*)h + TELEMETRY_HEADER_LEN +
+            (size_t)(n & (h->num_slots - 1)) * h->slot_size);
+}
+
+#if !(defined(_WIN32) || defined(_WIN64))
+
+//==============================================================================
+//                                                                        writer
+//==============================================================================
+
+int telemetry_create(telemetry* t, const char* name, int device_id, int max_values) {
+    telemetry_header* h;
+    uint32_t slot_size;
+    int fd;
+
+    telemetry_name(t, name);
+    t->header = NULL;
+
+    slot_size = (TELEMETRY_SLOT_HEADER + 4 * max_values + 7) & ~7u;
+    t->size = TELEMETRY_HEADER_LEN + (size_t)slot_size * TELEMETRY_NUM_SLOTS;
+
+    // Shrinking a segment that a reader has mapped would SIGBUS it: the
+    // old one is unlinked and stays valid until its readers unmap it
+    shm_unlink(t->name);
+    fd = shm_open(t->name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0 || ftruncate(fd, t->size)) {
+        perror("Cannot create the telemetry segment");
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+
+    h = (telemetry_header*) mmap(NULL, t->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (h == MAP_FAILED) {
+        perror("Cannot map the telemetry segment");
+        return -1;
+    }
+
+    // the magic is written last, readers wait for a complete header
+    h->version = TELEMETRY_VERSION;
+    h->slot_size = slot_size;
+    h->num_slots = TELEMETRY_NUM_SLOTS;
+    h->max_values = max_values;
+    h->device_id = device_id;
+    h->head = 0;
+    h->pid = getpid();
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(h->magic, TELEMETRY_MAGIC, 4);
+
+    t->header = h;
+
+    return 0;
+}
+
+void telemetry_publish(telemetry* t, char source, const float* values, int count) {
+    telemetry_header* h = t->header;
+    telemetry_slot* slot;
+    struct timespec now;
+    uint64_t n;
+
+    if (h == NULL)
+        return;
+    if (count > (int)h->max_values)
+        count = h->max_values;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    n = h->head;
+    slot = telemetry_slot_at(t, n);
+
+    __atomic_store_n(&slot->seq, 2 * n + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    slot->time = now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+    slot->source = (uint16_t) source;
+    slot->count = (uint16_t) count;
+    memcpy(slot->values, values, count * sizeof(float));
+
+    __atomic_store_n(&slot->seq, 2 * n + 2, __ATOMIC_RELEASE);
+    __atomic_store_n(&h->head, n + 1, __ATOMIC_RELEASE);
+}
+
+void telemetry_publish_short(telemetry* t, char source, const short int* values, int count) {
+    float f[TELEMETRY_MAX_VALUES];
+    int k;
+
+    if (count > TELEMETRY_MAX_VALUES)
+        count = TELEMETRY_MAX_VALUES;
+    for (k = 0; k < count; k++)
+        f[k] = values[k];
+
+    telemetry_publish(t, source, f, count);
+}
+
+//==============================================================================
+//                                                                        reader
+//==============================================================================
+
+int telemetry_open(telemetry* t, const char* name) {
+    struct stat st;
+    telemetry_header* h;
+    int fd;
+
+    telemetry_name(t, name);
+    t->header = NULL;
+
+    fd = shm_open(t->name, O_RDONLY, 0);
+    if (fd < 0 || fstat(fd, &st)) {
+        printf("No telemetry segment %s\n", t->name);
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+
+    t->size = st.st_size;
+    t->inode = st.st_ino;
+    if (t->size < TELEMETRY_HEADER_LEN) {
+        printf("Telemetry segment %s is not ready\n", t->name);
+        close(fd);
+        return -1;
+    }
+
+    h = (telemetry_header*) mmap(NULL, t->size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (h == MAP_FAILED) {
+        perror("Cannot map the telemetry segment");
+        return -1;
+    }
+
+    if (memcmp(h->magic, TELEMETRY_MAGIC, 4) || h->version != TELEMETRY_VERSION ||
+            TELEMETRY_HEADER_LEN + (size_t)h->slot_size * h->num_slots > t->size) {
+        printf("Telemetry segment %s is not ready\n", t->name);
+        munmap(h, t->size);
+        return -1;
+    }
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+    t->header = h;
+
+    return 0;
+}
+
+int telemetry_replaced(telemetry* t) {
+    struct stat st;
+    int fd = shm_open(t->name, O_RDONLY, 0);
+    int replaced;
+
+    // no segment at all is not a new one yet
+    if (fd < 0)
+        return 0;
+    replaced = !fstat(fd, &st) && (unsigned long) st.st_ino != t->inode && st.st_size >= TELEMETRY_HEADER_LEN;
+    close(fd);
+
+    return replaced;
+}
+
+uint64_t telemetry_head(telemetry* t) {
+    return __atomic_load_n(&t->header->head, __ATOMIC_ACQUIRE);
+}
+
+int telemetry_read(telemetry* t, uint64_t n, telemetry_slot* copy) {
+    telemetry_slot* slot = telemetry_slot_at(t, n);
+    uint64_t seq;
+
+    seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    if (seq != 2 * n + 2)
+        return 0;
+
+    memcpy(copy, slot, t->header->slot_size);
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == seq;
+}
+
+void telemetry_close(telemetry* t) {
+    if (t->header != NULL)
+        munmap(t->header, t->size);
+    t->header = NULL;
+}
+
+#else
+
+int telemetry_create(telemetry* t, const char* name, int device_id, int max_values) {
+    puts("Shared memory telemetry is only available on Linux and macOS.");
+    t->header = NULL;
+    return -1;
+}
+
+void telemetry_publish(telemetry* t, char source, const float* values, int count) {}
+
+void telemetry_publish_short(telemetry* t, char source, const short int* values, int count) {}
+
+int telemetry_open(telemetry* t, const char* name) {
+    puts("Shared memory telemetry is only available on Linux and macOS.");
+    t->header = NULL;
+    return -1;
+}
+
+int telemetry_replaced(telemetry* t) {
+    return 0;
+}
+
+uint64_t telemetry_head(telemetry* t) {
+    return 0;
+}
+
+int telemetry_read(telemetry* t, uint64_t n, telemetry_slot* copy) {
+    return 0;
+}
+
+void telemetry_close(telemetry* t) {}
+
+#endif
+
+/* [] END OF FILE */
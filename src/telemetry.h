@@ -0,0 +1,159 @@
+// ----------------------------------------------------------------------------
+// BSD 3-Clause License
+
+// Copyright (c) 2016, qbrobotics
+// Copyright (c) 2017-2024, Centro "E.Piaggio"
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// POSSIBILITY OF SUCH DAMAGE.
+// ----------------------------------------------------------------------------
+
+/**
+* \file         telemetry.h
+*
+* \brief        Shared memory publisher of the samples read by qbadmin
+* \author       _Centro "E.Piaggio"_
+* \copyright    (C) 2017-2024 Centro "E.Piaggio". All rights reserved.
+*
+* \details      The sampling loops write every sample in a POSIX shared
+*               memory ring. Any number of local processes map it read-only
+*               and take the latest sample or the whole history straight
+*               from memory, with no syscall and without disturbing the
+*               writer. Each slot is guarded by a sequence counter
+*               (seqlock): readers copy the slot and retry if the counter
+*               changed meanwhile.
+*
+*               Layout, native endianness, 8 byte aligned:
+*               header (64 bytes)
+*               [ 0] char     magic[4] = "QBSH"
+*               [ 4] uint32   version = 1
+*               [ 8] uint32   slot_size [bytes]
+*               [12] uint32   num_slots, power of 2
+*               [16] uint32   max_values, floats in a slot
+*               [20] uint32   device id
+*               [24] uint64   head, samples published so far; sample n is
+*                             in slot n % num_slots
+*               [32] uint32   pid of the writer
+*               [36] reserved
+*               slot (at 64 + i * slot_size)
+*               [ 0] uint64   seq, odd while the slot is written, 2n + 2
+*                             once sample n is complete
+*               [ 8] int64    time of the sample, CLOCK_MONOTONIC [us]
+*               [16] uint16   source, letter of the qbadmin option:
+*                             'g' measurements, 'i' velocities,
+*                             'o' accelerations, 'c' currents, 'q' emg,
+*                             'Q' imu readings
+*               [18] uint16   count, values in this sample
+*               [20] uint32   reserved
+*               [24] float    values[max_values]
+*
+*               Reading sample n: load seq with acquire semantics, it must
+*               be 2n + 2; copy the slot; acquire fence; load seq again, the
+*               copy is valid if it did not change. telemetry_read does
+*               exactly this.
+*/
+
+#ifndef TELEMETRY_H_INCLUDED
+#define TELEMETRY_H_INCLUDED
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define TELEMETRY_MAGIC         "QBSH"
+#define TELEMETRY_VERSION       1
+#define TELEMETRY_HEADER_LEN    64
+#define TELEMETRY_SLOT_HEADER   24
+#define TELEMETRY_NUM_SLOTS     4096
+#define TELEMETRY_MAX_VALUES    4       ///< Enough for measurements, currents and emg
+
+typedef struct telemetry_header {
+    char magic[4];
+    uint32_t version;
+    uint32_t slot_size;
+    uint32_t num_slots;
+    uint32_t max_values;
+    uint32_t device_id;
+    uint64_t head;
+    uint32_t pid;
+    uint8_t reserved[28];
+} telemetry_header;
+
+typedef struct telemetry_slot {
+    uint64_t seq;
+    int64_t time;
+    uint16_t source;
+    uint16_t count;
+    uint32_t reserved;
+    float values[1];                    ///< max_values in the segment
+} telemetry_slot;
+
+typedef struct telemetry {
+    char name[255];
+    telemetry_header* header;           ///< NULL if not mapped
+    size_t size;
+    unsigned long inode;                ///< Of the mapped segment, tells if the name was reused
+} telemetry;
+
+/** Create the segment name for samples of up to max_values. A previous
+ *  segment of the same name is unlinked, never resized: its readers keep
+ *  a valid mapping and can move to the new one (telemetry_replaced).
+ *  Returns 0 on success.
+ */
+int telemetry_create(telemetry* t, const char* name, int device_id, int max_values);
+
+/** Publish a sample, never blocks
+ */
+void telemetry_publish(telemetry* t, char source, const float* values, int count);
+
+/** Same, from the short int values of the qbAPI
+ */
+void telemetry_publish_short(telemetry* t, char source, const short int* values, int count);
+
+/** Map an existing segment read-only. Returns 0 on success.
+ */
+int telemetry_open(telemetry* t, const char* name);
+
+/** 1 if a new writer has replaced the mapped segment since
+ *  telemetry_open, the reader should open it again
+ */
+int telemetry_replaced(telemetry* t);
+
+/** Samples published so far
+ */
+uint64_t telemetry_head(telemetry* t);
+
+/** Copy sample n in slot (max_values values long). Returns 1 on success,
+ *  0 if sample n is not published yet or has been overwritten.
+ */
+int telemetry_read(telemetry* t, uint64_t n, telemetry_slot* slot);
+
+/** Unmap the segment, the segment itself stays for the readers
+ */
+void telemetry_close(telemetry* t);
+
+#endif
+/* [] END OF FILE */
@@ -0,0 +1,370 @@
+// ----------------------------------------------------------------------------
+// BSD 3-Clause License
+
+// Copyright (c) 2016, qbrobotics
+// Copyright (c) 2017-2024, Centro "E.Piaggio"
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// POSSIBILITY OF SUCH DAMAGE.
+// ----------------------------------------------------------------------------
+
+/**
+* \file         traj_reader.c
+*
+* \brief        Streaming reader of the -f trajectory files
+* \author       _Centro "E.Piaggio"_
+* \copyright    (C) 2017-2024 Centro "E.Piaggio". All rights reserved.
+*/
+
+#include "traj_reader.h"
+#include "byte_order.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if !(defined(_WIN32) || defined(_WIN64))
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+
+/** Parse up to TRAJ_MAX_CHANNELS comma separated values of a CSV row,
+ *  return their number
+ */
+static int traj_parse_row(char* line, short int* values) {
+    char* next = line;
+    char* end;
+    int k;
+
+    for (k = 0; k < TRAJ_MAX_CHANNELS; k++) {
+        float value = strtof(next, &end);
+        if (end == next)
+            break;
+        values[k] = value;              // truncated as commSetInputs always did
+        next = end;
+        while (*next == ',' || *next == ' ' || *next == '\t')
+            next++;
+    }
+
+    return k;
+}
+
+//==============================================================================
+//                                                                 reader thread
+//==============================================================================
+
+static void* traj_reader_thread(void* arg) {
+    traj_reader* traj = (traj_reader*) arg;
+    char line[1024];
+    unsigned long head = 0;
+    int rows = 0;
+
+    while (rows < traj->num_values && !__atomic_load_n(&traj->stop, __ATOMIC_ACQUIRE)) {
+
+        // Ring full, wait for the control loop
+        if (head - __atomic_load_n(&traj->tail, __ATOMIC_ACQUIRE) >= TRAJ_RING_SIZE) {
+            usleep(1000);
+            continue;
+        }
+
+        if (fgets(line, sizeof(line), traj->file) == NULL)
+            break;
+
+        // blank lines are not setpoints, as with the former fscanf
+        memset(traj->ring[head % TRAJ_RING_SIZE], 0, sizeof(traj->ring[0]));
+        if (traj_parse_row(line, traj->ring[head % TRAJ_RING_SIZE]) == 0)
+            continue;
+
+        __atomic_store_n(&traj->head, ++head, __ATOMIC_RELEASE);
+        rows++;
+    }
+
+    __atomic_store_n(&traj->eof, 1, __ATOMIC_RELEASE);
+
+    return NULL;
+}
+
+//==============================================================================
+//                                                                          open
+//==============================================================================
+
+/** Map a binary trajectory, return 0 on success
+ */
+static int traj_open_binary(traj_reader* traj, const char* filename) {
+    const uint8_t* header;
+    uint16_t version;
+
+#if !(defined(_WIN32) || defined(_WIN64))
+    struct stat st;
+    int fd = open(filename, O_RDONLY);
+
+    if (fd < 0 || fstat(fd, &st)) {
+        perror("Error opening file");
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+
+    traj->map_len = st.st_size;
+    traj->map = mmap(NULL, traj->map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (traj->map == MAP_FAILED) {
+        perror("Error mapping file");
+        traj->map = NULL;
+        return -1;
+    }
+    madvise(traj->map, traj->map_len, MADV_SEQUENTIAL);
+#else
+    FILE* file = fopen(filename, "rb");
+
+    if (file == NULL) {
+        perror("Error opening file");
+        return -1;
+    }
+    fseek(file, 0, SEEK_END);
+    traj->map_len = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    traj->map = malloc(traj->map_len);
+    if (fread(traj->map, 1, traj->map_len, file) != traj->map_len) {
+        perror("Error reading file");
+        fclose(file);
+        free(traj->map);
+        traj->map = NULL;
+        return -1;
+    }
+    fclose(file);
+#endif
+
+    if (traj->map_len < TRAJ_HEADER_LEN) {
+        printf("Corrupted trajectory file %s\n", filename);
+        traj_close(traj);
+        return -1;
+    }
+
+    header = (const uint8_t*) traj->map;
+    version = QB_LE16(*(const uint16_t*)(header + 4));
+    traj->channels = QB_LE16(*(const uint16_t*)(header + 6));
+    traj->deltat = QB_LE32(*(const uint32_t*)(header + 8));
+    traj->num_values = QB_LE32(*(const uint32_t*)(header + 12));
+    traj->data = (const int16_t*)(header + TRAJ_HEADER_LEN);
+
+    if (version != TRAJ_VERSION || traj->channels < 1 || traj->channels > TRAJ_MAX_CHANNELS ||
+            TRAJ_HEADER_LEN + (size_t)traj->num_values * traj->channels * 2 > traj->map_len) {
+        printf("Corrupted trajectory file %s\n", filename);
+        traj_close(traj);
+        return -1;
+    }
+
+    return 0;
+}
+
+int traj_open(traj_reader* traj, const char* filename) {
+    char magic[4] = "";
+    char line[1024];
+    short int first[TRAJ_MAX_CHANNELS];
+    long offset;
+
+    traj->head = 0;
+    traj->tail = 0;
+    traj->eof = 0;
+    traj->stop = 0;
+    traj->underruns = 0;
+    traj->map = NULL;
+    traj->data = NULL;
+
+    traj->file = fopen(filename, "rb");
+    if (traj->file == NULL) {
+        perror("Error opening file");
+        return -1;
+    }
+
+    if (fread(magic, 1, 4, traj->file) == 4 && !memcmp(magic, TRAJ_MAGIC, 4)) {
+        fclose(traj->file);
+        traj->file = NULL;
+        return traj_open_binary(traj, filename);
+    }
+    rewind(traj->file);
+
+    traj->deltat = 0;
+    traj->num_values = 0;
+    if (fscanf(traj->file, "%d,%d\n", &traj->deltat, &traj->num_values) != 2) {
+        printf("Wrong header in %s, expected millisecs,num_rows\n", filename);
+        fclose(traj->file);
+        return -1;
+    }
+
+    // The first row tells the number of channels
+    offset = ftell(traj->file);
+    traj->channels = 0;
+    while (traj->channels == 0 && fgets(line, sizeof(line), traj->file))
+        traj->channels = traj_parse_row(line, first);
+    if (traj->channels == 0)
+        traj->channels = 2;
+    fseek(traj->file, offset, SEEK_SET);
+
+    if (pthread_create(&traj->thread, NULL, traj_reader_thread, traj)) {
+        puts("Cannot start the trajectory reader thread");
+        fclose(traj->file);
+        return -1;
+    }
+
+    // Wait for the first row so that the first tick does not underrun
+    while (!__atomic_load_n(&traj->head, __ATOMIC_ACQUIRE) && !__atomic_load_n(&traj->eof, __ATOMIC_ACQUIRE))
+        usleep(100);
+
+    return 0;
+}
+
+//==============================================================================
+//                                                                          next
+//==============================================================================
+
+int traj_next(traj_reader* traj, short int* values) {
+    unsigned long head;
+    int k;
+
+    if (traj->map != NULL) {
+        if (traj->tail >= (unsigned long)traj->num_values)
+            return 0;
+        for (k = 0; k < traj->channels; k++)
+            values[k] = (int16_t)QB_LE16(traj->data[traj->tail * traj->channels + k]);
+        traj->tail++;
+        return 1;
+    }
+
+    head = __atomic_load_n(&traj->head, __ATOMIC_ACQUIRE);
+    if (traj->tail == head) {
+        // Check eof before head again, rows may have been added in between
+        if (__atomic_load_n(&traj->eof, __ATOMIC_ACQUIRE) && __atomic_load_n(&traj->head, __ATOMIC_ACQUIRE) == traj->tail)
+            return 0;
+        traj->underruns++;
+        return -1;
+    }
+
+    for (k = 0; k < traj->channels; k++)
+        values[k] = traj->ring[traj->tail % TRAJ_RING_SIZE][k];
+
+    __atomic_store_n(&traj->tail, traj->tail + 1, __ATOMIC_RELEASE);
+
+    return 1;
+}
+
+//==============================================================================
+//                                                                         close
+//==============================================================================
+
+void traj_close(traj_reader* traj) {
+    if (traj->map != NULL) {
+#if !(defined(_WIN32) || defined(_WIN64))
+        munmap(traj->map, traj->map_len);
+#else
+        free(traj->map);
+#endif
+        traj->map = NULL;
+        return;
+    }
+
+    __atomic_store_n(&traj->stop, 1, __ATOMIC_RELEASE);
+    pthread_join(traj->thread, NULL);
+    fclose(traj->file);
+}
+
+//==============================================================================
+//                                                                       convert
+//==============================================================================
+
+int traj_convert(const char* csv_name, const char* bin_name) {
+    FILE* csv;
+    FILE* bin;
+    char line[1024];
+    short int values[TRAJ_MAX_CHANNELS];
+    int16_t row[TRAJ_MAX_CHANNELS];
+    uint8_t header[TRAJ_HEADER_LEN];
+    int deltat = 0, num_values = 0;
+    int channels = 0;
+    int rows = 0;
+    int n, k;
+    uint16_t u16;
+    uint32_t u32;
+
+    csv = fopen(csv_name, "r");
+    if (csv == NULL) {
+        perror("Error opening file");
+        return -1;
+    }
+
+    if (fscanf(csv, "%d,%d\n", &deltat, &num_values) != 2) {
+        printf("Wrong header in %s, expected millisecs,num_rows\n", csv_name);
+        fclose(csv);
+        return -1;
+    }
+
+    bin = fopen(bin_name, "wb");
+    if (bin == NULL) {
+        perror("Error opening file");
+        fclose(csv);
+        return -1;
+    }
+
+    // Header is written again at the end with the actual number of rows
+    memset(header, 0, sizeof(header));
+    fwrite(header, 1, TRAJ_HEADER_LEN, bin);
+
+    while (rows < num_values && fgets(line, sizeof(line), csv)) {
+        memset(values, 0, sizeof(values));
+        n = traj_parse_row(line, values);
+        if (n == 0)
+            continue;
+        if (channels == 0)
+            channels = n;
+
+        for (k = 0; k < channels; k++)
+            row[k] = (int16_t)QB_LE16((int16_t)values[k]);
+        fwrite(row, sizeof(int16_t), channels, bin);
+        rows++;
+    }
+
+    memcpy(header, TRAJ_MAGIC, 4);
+    u16 = QB_LE16((uint16_t)TRAJ_VERSION);
+    memcpy(header + 4, &u16, 2);
+    u16 = QB_LE16((uint16_t)channels);
+    memcpy(header + 6, &u16, 2);
+    u32 = QB_LE32((uint32_t)deltat);
+    memcpy(header + 8, &u32, 4);
+    u32 = QB_LE32((uint32_t)rows);
+    memcpy(header + 12, &u32, 4);
+    fseek(bin, 0, SEEK_SET);
+    fwrite(header, 1, TRAJ_HEADER_LEN, bin);
+
+    fclose(csv);
+    fclose(bin);
+
+    return rows;
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,120 @@
+// ----------------------------------------------------------------------------
+// BSD 3-Clause License
+
+// Copyright (c) 2016, qbrobotics
+// Copyright (c) 2017-2024, Centro "E.Piaggio"
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// POSSIBILITY OF SUCH DAMAGE.
+// ----------------------------------------------------------------------------
+
+/**
+* \file         traj_reader.h
+*
+* \brief        Streaming reader of the -f trajectory files
+* \author       _Centro "E.Piaggio"_
+* \copyright    (C) 2017-2024 Centro "E.Piaggio". All rights reserved.
+*
+* \details      Two file formats are accepted.
+*
+*               CSV files are parsed by a reader thread into a bounded
+*               single-producer/single-consumer ring, while the control loop
+*               takes one row per tick. Memory use does not depend on the
+*               length of the file and the first row is available as soon
+*               as it has been parsed.
+*               millisecs,num_rows
+*               input1_1,input2_1
+*               ...
+*
+*               Binary files (.qbt) are memory mapped and the rows are used
+*               as they are, with no parsing at all. All fields are little
+*               endian:
+*               [ 0] char     magic[4] = "QBTR"
+*               [ 4] uint16   version = 1
+*               [ 6] uint16   channels, values in every row
+*               [ 8] uint32   millisecs between rows
+*               [12] uint32   num_rows
+*               [16] int16    values[num_rows][channels], as sent by commSetInputs
+*/
+
+#ifndef TRAJ_READER_H_INCLUDED
+#define TRAJ_READER_H_INCLUDED
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#define TRAJ_RING_SIZE      4096        ///< Rows buffered ahead of the control loop (power of 2)
+#define TRAJ_MAX_CHANNELS   32          ///< Max values in every row
+#define TRAJ_MAGIC          "QBTR"
+#define TRAJ_VERSION        1
+#define TRAJ_HEADER_LEN     16
+
+typedef struct traj_reader {
+    int deltat;                         ///< Time between rows [ms]
+    int num_values;                     ///< Rows declared in the header
+    int channels;                       ///< Values in every row
+
+    // CSV files
+    FILE* file;
+    short int ring[TRAJ_RING_SIZE][TRAJ_MAX_CHANNELS];
+    unsigned long head;                 ///< Rows written by the reader thread
+    unsigned long tail;                 ///< Rows taken by the control loop
+    int eof;                            ///< The reader thread is done
+    int stop;                           ///< Asks the reader thread to quit
+    pthread_t thread;
+
+    // Binary files
+    void* map;                          ///< Whole file, NULL for CSV files
+    size_t map_len;
+    const int16_t* data;                ///< First row
+
+    long underruns;                     ///< Ticks that found the ring empty
+} traj_reader;
+
+/** Open filename (CSV or binary) and, for CSV files, start the reader thread.
+ *  Returns 0 on success, -1 if the file cannot be read.
+ */
+int traj_open(traj_reader* traj, const char* filename);
+
+/** Take the next row, channels values. Returns 1 if values was filled, 0 at
+ *  the end of the trajectory and -1 if the reader thread is late (underrun,
+ *  values is left untouched).
+ */
+int traj_next(traj_reader* traj, short int* values);
+
+/** Stop the reader thread and close the file
+ */
+void traj_close(traj_reader* traj);
+
+/** Convert the CSV trajectory csv_name to the binary file bin_name.
+ *  Returns the number of rows written or -1 on error.
+ */
+int traj_convert(const char* csv_name, const char* bin_name);
+
+#endif
+/* [] END OF FILE */